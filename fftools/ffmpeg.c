@@ -101,6 +101,7 @@ atomic_uint nb_output_dumped = 0;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *sched_stats_avio = NULL;
 
 InputFile   **input_files   = NULL;
 int        nb_input_files   = 0;
@@ -331,6 +332,8 @@ static void ffmpeg_cleanup(int ret)
         dec_free(&decoders[i]);
     av_freep(&decoders);
 
+    av_thread_budget_free(&thread_budget);
+
     if (vstats_file) {
         if (fclose(vstats_file))
             av_log(NULL, AV_LOG_ERROR,
@@ -727,6 +730,41 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     first_report = 0;
 }
 
+static void print_sched_stats(Scheduler *sch, int is_last_report,
+                              int64_t timer_start, int64_t cur_time)
+{
+    static int64_t last_time = -1;
+    AVBPrint buf;
+    int ret;
+
+    if (!sched_stats_avio)
+        return;
+
+    if (!is_last_report) {
+        if (last_time != -1 && cur_time - last_time < stats_period)
+            return;
+        last_time = cur_time;
+    }
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    av_bprintf(&buf, "{\"time_us\":%"PRId64",\"progress\":\"%s\",\"tasks\":",
+               cur_time - timer_start, is_last_report ? "end" : "continue");
+    sch_stats_print(sch, &buf);
+    av_bprintf(&buf, "}\n");
+
+    if (av_bprint_is_complete(&buf))
+        avio_write(sched_stats_avio, buf.str, buf.len);
+    avio_flush(sched_stats_avio);
+    av_bprint_finalize(&buf, NULL);
+
+    if (is_last_report) {
+        if ((ret = avio_closep(&sched_stats_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing scheduler stats log, loss of information possible: %s\n", av_err2str(ret));
+    }
+}
+
 static void print_stream_maps(void)
 {
     av_log(NULL, AV_LOG_INFO, "Stream mapping:\n");
@@ -912,6 +950,7 @@ static int transcode(Scheduler *sch)
 
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time, transcode_ts);
+        print_sched_stats(sch, 0, timer_start, cur_time);
     }
 
     ret = sch_stop(sch, &transcode_ts);
@@ -926,6 +965,7 @@ static int transcode(Scheduler *sch)
 
     /* dump report by using the first video and audio streams */
     print_report(1, timer_start, av_gettime_relative(), transcode_ts);
+    print_sched_stats(sch, 1, timer_start, av_gettime_relative());
 
     return ret;
 }
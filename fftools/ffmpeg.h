@@ -47,6 +47,7 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/rational.h"
 #include "libavutil/thread.h"
+#include "libavutil/threadbudget.h"
 #include "libavutil/threadmessage.h"
 
 #include "libswresample/swresample.h"
@@ -770,16 +771,20 @@ extern int print_stats;
 extern int64_t stats_period;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
+extern AVIOContext *sched_stats_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int threads_total;
+extern AVThreadBudget *thread_budget;
 extern int filter_buffered_frames;
 extern int vstats_version;
 extern int print_graphs;
 extern char *print_graphs_file;
 extern char *print_graphs_format;
 extern int auto_conversion_filters;
+extern int scale_cascade;
 
 extern const AVIOInterruptCB int_cb;
 
@@ -795,6 +800,16 @@ extern int recast_media;
 
 extern FILE *vstats_file;
 
+/**
+ * Draw worker threads for a decoder, encoder or filtergraph from the global
+ * thread budget (-threads_total).
+ *
+ * @return number of threads the caller should use, or 0 if there is no
+ *         budget and the caller should pick its own thread count
+ */
+int thread_budget_acquire(void);
+void thread_budget_release(int nb_threads);
+
 void term_init(void);
 void term_exit(void);
 
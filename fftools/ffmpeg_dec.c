@@ -84,6 +84,9 @@ typedef struct DecoderPriv {
     // user specified decoder multiview options manually
     int                 multiview_user_config;
 
+    // number of threads drawn from the global thread budget
+    int                 budget_threads;
+
     struct {
         ViewSpecifier   vs;
         unsigned        out_idx;
@@ -126,6 +129,8 @@ void dec_free(Decoder **pdec)
 
     avcodec_free_context(&dp->dec_ctx);
 
+    thread_budget_release(dp->budget_threads);
+
     av_frame_free(&dp->frame);
     av_frame_free(&dp->frame_tmp_ref);
     av_packet_free(&dp->pkt);
@@ -1570,8 +1575,17 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
     dp->dec_ctx->get_buffer2           = get_buffer;
     dp->dec_ctx->pkt_timebase          = o->time_base;
 
-    if (!av_dict_get(*dec_opts, "threads", NULL, 0))
-        av_dict_set(dec_opts, "threads", "auto", 0);
+    if (!av_dict_get(*dec_opts, "threads", NULL, 0)) {
+        if (codec->capabilities & (AV_CODEC_CAP_FRAME_THREADS  |
+                                   AV_CODEC_CAP_SLICE_THREADS  |
+                                   AV_CODEC_CAP_OTHER_THREADS))
+            dp->budget_threads = thread_budget_acquire();
+
+        if (dp->budget_threads)
+            av_dict_set_int(dec_opts, "threads", dp->budget_threads, 0);
+        else
+            av_dict_set(dec_opts, "threads", "auto", 0);
+    }
 
     ret = hw_device_setup_for_decode(dp, codec, o->hwaccel_device);
     if (ret < 0) {
@@ -53,6 +53,9 @@ typedef struct EncoderPriv {
     int opened;
     int attach_par;
 
+    // number of threads drawn from the global thread budget
+    int budget_threads;
+
     Scheduler      *sch;
     unsigned        sch_idx;
 } EncoderPriv;
@@ -79,6 +82,8 @@ void enc_free(Encoder **penc)
         av_freep(&enc->enc_ctx->stats_in);
     avcodec_free_context(&enc->enc_ctx);
 
+    thread_budget_release(ep_from_enc(enc)->budget_threads);
+
     av_freep(penc);
 }
 
@@ -341,6 +346,16 @@ int enc_open(void *opaque, const AVFrame *frame)
         return ret;
     }
 
+    // automatic thread count, take it from the global budget if there is one
+    if (!enc_ctx->thread_count &&
+        (enc->capabilities & (AV_CODEC_CAP_FRAME_THREADS  |
+                              AV_CODEC_CAP_SLICE_THREADS  |
+                              AV_CODEC_CAP_OTHER_THREADS))) {
+        ep->budget_threads = thread_budget_acquire();
+        if (ep->budget_threads)
+            enc_ctx->thread_count = ep->budget_threads;
+    }
+
     if ((ret = avcodec_open2(enc_ctx, enc, NULL)) < 0) {
         if (ret != AVERROR_EXPERIMENTAL)
             av_log(e, AV_LOG_ERROR, "Error while opening encoder - maybe "
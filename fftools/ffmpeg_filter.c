@@ -60,6 +60,12 @@ typedef struct FilterGraphPriv {
     unsigned         nb_outputs_done;
 
     int              nb_threads;
+    // number of threads drawn from the global thread budget
+    int              budget_threads;
+
+    // for simple filtergraphs that do nothing but scale frames from this
+    // input stream, so their output may feed scaling of other outputs
+    InputStream     *cascade_ist;
 
     // frame for temporarily holding output from the filtergraph
     AVFrame         *frame;
@@ -1068,6 +1074,8 @@ void fg_free(FilterGraph **pfg)
     av_frame_free(&fgp->frame);
     av_frame_free(&fgp->frame_enc);
 
+    thread_budget_release(fgp->budget_threads);
+
     av_freep(pfg);
 }
 
@@ -1245,6 +1253,112 @@ fail:
     return 0;
 }
 
+/**
+ * Check whether a simple filtergraph with these options only scales its input
+ * to a fixed size, so it can take part in cascaded scaling.
+ */
+static int cascade_eligible(const FilterGraph *fg, const InputStream *ist,
+                            const OutputFilterOptions *opts)
+{
+    return ist->par->codec_type == AVMEDIA_TYPE_VIDEO  &&
+           !strcmp(fg->graph_desc, "null")               &&
+           opts->width > 0 && opts->height > 0           &&
+           (opts->flags & OFILTER_FLAG_AUTOSCALE)        &&
+           !(opts->flags & OFILTER_FLAG_DISABLE_CONVERT) &&
+           (!opts->vs || opts->vs->type == VIEW_SPECIFIER_TYPE_NONE) &&
+           opts->trim_start_us == AV_NOPTS_VALUE         &&
+           !opts->ts_offset;
+}
+
+/**
+ * Find the output of a previously created simple filtergraph that can feed
+ * the input of a new simple filtergraph with the given options, instead of
+ * the input stream itself. The output must scale frames from the same input
+ * stream to a size no smaller than the requested one, and produce frames that
+ * are otherwise identical to what the new filtergraph would output.
+ *
+ * Out of all such outputs, the smallest one is chosen, so that a ladder of
+ * decreasing sizes forms a chain.
+ */
+static OutputFilter *cascade_find_source(const InputStream *ist,
+                                         const OutputFilterOptions *opts)
+{
+    OutputFilter *best = NULL;
+    int64_t best_area = INT64_MAX;
+
+    for (int i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        for (int j = 0; j < of->nb_streams; j++) {
+            FilterGraph *fg = of->streams[j]->fg_simple;
+            const OutputFilterPriv *ofp;
+            int64_t area;
+
+            if (!fg || fgp_from_fg(fg)->cascade_ist != ist)
+                continue;
+            ofp = ofp_from_ofilter(fg->outputs[0]);
+
+            if (ofp->width  < opts->width || ofp->height < opts->height)
+                continue;
+
+            if (ofp->format       != opts->format       ||
+                ofp->formats      != opts->formats      ||
+                ofp->color_space  != opts->color_space  ||
+                ofp->color_spaces != opts->color_spaces ||
+                ofp->color_range  != opts->color_range  ||
+                ofp->color_ranges != opts->color_ranges ||
+                ofp->alpha_mode   != opts->alpha_mode   ||
+                ofp->alpha_modes  != opts->alpha_modes)
+                continue;
+
+            // compare the rates field by field, av_cmp_q() does not
+            // consider two unset (0/0) rates equal
+            if (ofp->fps.vsync_method        != opts->vsync_method         ||
+                ofp->fps.framerate.num       != opts->frame_rate.num       ||
+                ofp->fps.framerate.den       != opts->frame_rate.den       ||
+                ofp->fps.framerate_max.num   != opts->max_frame_rate.num   ||
+                ofp->fps.framerate_max.den   != opts->max_frame_rate.den   ||
+                ofp->fps.framerate_supported != opts->frame_rates          ||
+                ofp->trim_duration_us        != opts->trim_duration_us)
+                continue;
+
+            area = (int64_t)ofp->width * ofp->height;
+            if (area < best_area) {
+                best      = fg->outputs[0];
+                best_area = area;
+            }
+        }
+    }
+
+    return best;
+}
+
+static int ifilter_bind_cascade(InputFilterPriv *ifp, OutputFilter *ofilter_src)
+{
+    FilterGraphPriv *fgp     = fgp_from_fg(ifp->ifilter.graph);
+    FilterGraphPriv *fgp_src = fgp_from_fg(ofilter_src->graph);
+
+    av_assert0(!ifp->bound);
+    ifp->bound = 1;
+
+    ifp->type_src    = ifp->ifilter.type;
+    ifp->ofilter_src = ofilter_src;
+
+    ifp->opts.name = av_strdup(ofilter_src->output_name);
+    if (!ifp->opts.name)
+        return AVERROR(ENOMEM);
+
+    ifp->ifilter.input_name = av_strdup(ifp->opts.name);
+    if (!ifp->ifilter.input_name)
+        return AVERROR(ENOMEM);
+
+    av_log(fgp, AV_LOG_VERBOSE, "Scaling from the output of %s\n",
+           fgp_src->log_name);
+
+    return sch_connect(fgp->sch, SCH_FILTER_OUT(fgp_src->sch_idx, ofilter_src->index),
+                                 SCH_FILTER_IN(fgp->sch_idx, ifp->ifilter.index));
+}
+
 int fg_create_simple(FilterGraph **pfg,
                      InputStream *ist,
                      char **graph_desc,
@@ -1283,9 +1397,21 @@ int fg_create_simple(FilterGraph **pfg,
         return AVERROR(EINVAL);
     }
 
-    ret = ifilter_bind_ist(fg->inputs[0], ist, opts->vs);
-    if (ret < 0)
-        return ret;
+    if (scale_cascade && cascade_eligible(fg, ist, opts)) {
+        OutputFilter *ofilter_src = cascade_find_source(ist, opts);
+
+        ret = ofilter_src ?
+              ifilter_bind_cascade(ifp_from_ifilter(fg->inputs[0]), ofilter_src) :
+              ifilter_bind_ist(fg->inputs[0], ist, opts->vs);
+        if (ret < 0)
+            return ret;
+
+        fgp->cascade_ist = ist;
+    } else {
+        ret = ifilter_bind_ist(fg->inputs[0], ist, opts->vs);
+        if (ret < 0)
+            return ret;
+    }
 
     ret = ofilter_bind_enc(fg->outputs[0], sched_idx_enc, opts);
     if (ret < 0)
@@ -2086,6 +2212,14 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             ret = av_opt_set_int(fgt->graph, "threads", fgp->nb_threads, 0);
             if (ret < 0)
                 return ret;
+        } else if (ofp->ofilter.type == AVMEDIA_TYPE_VIDEO) {
+            if (!fgp->budget_threads)
+                fgp->budget_threads = thread_budget_acquire();
+            if (fgp->budget_threads) {
+                ret = av_opt_set_int(fgt->graph, "threads", fgp->budget_threads, 0);
+                if (ret < 0)
+                    return ret;
+            }
         }
 
         if (av_dict_count(ofp->sws_opts)) {
@@ -2105,7 +2239,11 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             av_free(args);
         }
     } else {
-        fgt->graph->nb_threads = filter_complex_nbthreads;
+        if (!filter_complex_nbthreads && !fgp->budget_threads)
+            fgp->budget_threads = thread_budget_acquire();
+
+        fgt->graph->nb_threads = filter_complex_nbthreads ? filter_complex_nbthreads :
+                                                            fgp->budget_threads;
     }
 
     if (filter_buffered_frames) {
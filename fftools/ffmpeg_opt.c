@@ -75,17 +75,23 @@ int stdin_interaction = 1;
 float max_error_rate  = 2.0/3;
 char *filter_nbthreads;
 int filter_complex_nbthreads = 0;
+int threads_total = 0;
+AVThreadBudget *thread_budget;
 int filter_buffered_frames = 0;
 int vstats_version = 2;
 int print_graphs = 0;
 char *print_graphs_file = NULL;
 char *print_graphs_format = NULL;
 int auto_conversion_filters = 1;
+int scale_cascade = 0;
 int64_t stats_period = 500000;
 
 
 static int file_overwrite     = 0;
 static int no_file_overwrite  = 0;
+// number of threads each budget user asks for
+static int thread_budget_share;
+
 int ignore_unknown_streams = 0;
 int copy_unknown_streams = 0;
 int recast_media = 0;
@@ -717,6 +723,28 @@ static int opt_sdp_file(void *optctx, const char *opt, const char *arg)
     return sch_sdp_filename(go->sch, arg);
 }
 
+int thread_budget_acquire(void)
+{
+    return thread_budget ? av_thread_budget_acquire(thread_budget, thread_budget_share) : 0;
+}
+
+void thread_budget_release(int nb_threads)
+{
+    if (thread_budget)
+        av_thread_budget_release(thread_budget, nb_threads);
+}
+
+static int opt_max_active_tasks(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    double num;
+    int ret = parse_number(opt, arg, OPT_TYPE_INT, -1, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    return sch_max_active_tasks(go->sch, (int)num);
+}
+
 #if CONFIG_VAAPI
 static int opt_vaapi_device(void *optctx, const char *opt, const char *arg)
 {
@@ -1491,6 +1519,26 @@ int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch)
         goto fail;
     }
 
+    if (threads_total) {
+        /* Split the budget evenly between the components that will use it.
+         * Their exact number is not known until all the files are opened,
+         * so estimate it as one decoder per input, an encoder and a
+         * filtergraph per output, plus the complex filtergraphs. */
+        int nb_users = octx.groups[GROUP_INFILE].nb_groups +
+                       octx.groups[GROUP_OUTFILE].nb_groups * 2 +
+                       go.nb_filtergraphs;
+
+        thread_budget = av_thread_budget_alloc(threads_total);
+        if (!thread_budget) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        thread_budget_share = FFMAX(av_thread_budget_total(thread_budget) /
+                                    FFMAX(nb_users, 1), 1);
+
+        sch_thread_budget(sch, thread_budget);
+    }
+
     /* configure terminal and setup signal handlers */
     term_init();
 
@@ -1566,6 +1614,27 @@ static int opt_progress(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_sched_stats(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open scheduler stats URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+    avio_closep(&sched_stats_avio);
+    sched_stats_avio = avio;
+
+    sch_enable_stats(go->sch);
+    return 0;
+}
+
 int opt_timelimit(void *optctx, const char *opt, const char *arg)
 {
 #if HAVE_SETRLIMIT
@@ -1712,6 +1781,9 @@ const OptionDef options[] = {
     { "progress",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
+    { "sched_stats",            OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_stats },
+      "write per-task scheduling statistics as JSON", "url" },
     { "stdin",                  OPT_TYPE_BOOL, OPT_EXPERT,
         { &stdin_interaction },
       "enable or disable interaction on standard input" },
@@ -1825,6 +1897,12 @@ const OptionDef options[] = {
     { "filter_complex_threads", OPT_TYPE_INT, OPT_EXPERT,
         { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "threads_total",          OPT_TYPE_INT, OPT_EXPERT,
+        { &threads_total },
+        "total number of worker threads shared by all decoders, encoders and filtergraphs (-1 = number of CPUs)", "number" },
+    { "max_active_tasks",       OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_max_active_tasks },
+        "maximum number of transcoding tasks processing data concurrently (0 = unlimited, -1 = number of CPUs)", "number" },
     { "lavfi",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
@@ -1845,6 +1923,9 @@ const OptionDef options[] = {
     { "auto_conversion_filters", OPT_TYPE_BOOL, OPT_EXPERT,
         { &auto_conversion_filters },
         "enable automatic conversion filters globally" },
+    { "scale_cascade",       OPT_TYPE_BOOL, OPT_EXPERT,
+        { &scale_cascade },
+        "scale outputs from the output of a larger one fed by the same input stream" },
     { "stats",               OPT_TYPE_BOOL, 0,
         { &print_stats },
         "print progress report during encoding", },
@@ -32,11 +32,14 @@
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
+#include "libavutil/cpu.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/threadbudget.h"
 #include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 
@@ -60,6 +63,42 @@ typedef struct SchWaiter {
     int                 choked_next;
 } SchWaiter;
 
+// number of log2-spaced buckets in the latency and queue depth histograms
+#define STATS_HIST_SIZE 32
+
+enum TaskWait {
+    // not waiting on other tasks, i.e. task startup/shutdown
+    TASK_WAIT_NONE,
+    // waiting for input data
+    TASK_WAIT_INPUT,
+    // waiting for downstream tasks to accept output or to be unchoked
+    TASK_WAIT_OUTPUT,
+};
+
+typedef struct SchTaskStats {
+    // number of items (packets or frames) received/sent by the task
+    atomic_uint_least64_t nb_in;
+    atomic_uint_least64_t nb_out;
+
+    // total time in microseconds spent running the task's own code, blocked
+    // on input, blocked on output, and waiting for an activity slot
+    atomic_uint_least64_t time_busy;
+    atomic_uint_least64_t time_wait_in;
+    atomic_uint_least64_t time_wait_out;
+    atomic_uint_least64_t time_wait_slot;
+
+    // bucket i counts values in [2^(i-1), 2^i), bucket 0 counts zeros;
+    // processing time per item in microseconds
+    atomic_uint_least64_t latency[STATS_HIST_SIZE];
+    // number of items waiting in the input queue when a new one is requested
+    atomic_uint_least64_t queue_depth[STATS_HIST_SIZE];
+
+    // the following are only accessed from the task's own thread
+    int64_t             last_ts;
+    int64_t             item_busy;
+    int                 item_pending;
+} SchTaskStats;
+
 typedef struct SchTask {
     Scheduler          *parent;
     SchedulerNode       node;
@@ -69,6 +108,12 @@ typedef struct SchTask {
 
     pthread_t           thread;
     int                 thread_running;
+
+    // the task currently holds one of Scheduler.max_active slots;
+    // only accessed from the task's own thread
+    int                 active;
+
+    SchTaskStats        stats;
 } SchTask;
 
 typedef struct SchDecOutput {
@@ -239,7 +284,9 @@ typedef struct SchFilterIn {
 } SchFilterIn;
 
 typedef struct SchFilterOut {
-    SchedulerNode       dst;
+    SchedulerNode      *dst;
+    uint8_t            *dst_finished;
+    unsigned         nb_dst;
 } SchFilterOut;
 
 typedef struct SchFilterGraph {
@@ -253,6 +300,9 @@ typedef struct SchFilterGraph {
     SchFilterOut       *outputs;
     unsigned         nb_outputs;
 
+    // temporary storage used by sch_filter_send()
+    AVFrame            *send_frame;
+
     SchTask             task;
     // input queue, nb_inputs+1 streams
     // last stream is control
@@ -308,6 +358,20 @@ struct Scheduler {
 
     pthread_mutex_t     schedule_lock;
 
+    /* Maximum number of tasks that may be processing data at the same time,
+     * 0 means no limit. A task holds an activity slot while running its own
+     * code and gives it up whenever it enters the scheduler to exchange data
+     * with other tasks, which is where it may block. */
+    unsigned            max_active;
+    unsigned            nb_active;
+    // provides the default for max_active
+    const AVThreadBudget *thread_budget;
+    pthread_mutex_t     active_lock;
+    pthread_cond_t      active_cond;
+
+    // collect per-task SchTaskStats
+    int                 stats;
+
     atomic_int_least64_t last_dts;
 };
 
@@ -369,8 +433,121 @@ static void waiter_uninit(SchWaiter *w)
     pthread_cond_destroy(&w->cond);
 }
 
+static void stats_hist_add(atomic_uint_least64_t *hist, uint64_t val)
+{
+    int bucket = val ? FFMIN(av_log2(FFMIN(val, UINT_MAX)) + 1, STATS_HIST_SIZE - 1) : 0;
+    atomic_fetch_add_explicit(&hist[bucket], 1, memory_order_relaxed);
+}
+
+/**
+ * Account for the time since the task last entered or left the scheduler.
+ */
+static void task_stats_update(SchTask *task, enum TaskWait wait, int leaving)
+{
+    SchTaskStats *st = &task->stats;
+    int64_t now = av_gettime_relative();
+
+    if (leaving) {
+        atomic_uint_least64_t *dst = wait == TASK_WAIT_INPUT  ? &st->time_wait_in  :
+                                     wait == TASK_WAIT_OUTPUT ? &st->time_wait_out : NULL;
+        if (dst)
+            atomic_fetch_add_explicit(dst, now - st->last_ts, memory_order_relaxed);
+    } else {
+        // an item is done when the task asks for the next one; demuxers have
+        // no inputs, so for them every output marks the end of an item
+        enum TaskWait item_end = task->node.type == SCH_NODE_TYPE_DEMUX ?
+                                 TASK_WAIT_OUTPUT : TASK_WAIT_INPUT;
+
+        atomic_fetch_add_explicit(&st->time_busy, now - st->last_ts,
+                                  memory_order_relaxed);
+        st->item_busy += now - st->last_ts;
+
+        if (wait == item_end || wait == TASK_WAIT_NONE) {
+            if (st->item_pending)
+                stats_hist_add(st->latency, st->item_busy);
+            st->item_busy    = 0;
+            st->item_pending = wait != TASK_WAIT_NONE;
+        }
+    }
+
+    st->last_ts = now;
+}
+
+/**
+ * Called by the task's own thread when it returns from the scheduler to its
+ * own code. Waits until an activity slot is available and claims it.
+ */
+static void task_activate(SchTask *task, enum TaskWait wait)
+{
+    Scheduler *sch = task->parent;
+    int waited = 0;
+
+    if (sch->stats)
+        task_stats_update(task, wait, 1);
+
+    if (!sch->max_active || task->active)
+        return;
+
+    pthread_mutex_lock(&sch->active_lock);
+
+    // let everything run freely when terminating, so that the tasks can drain
+    while (sch->nb_active >= sch->max_active && !atomic_load(&sch->terminate)) {
+        pthread_cond_wait(&sch->active_cond, &sch->active_lock);
+        waited = 1;
+    }
+
+    sch->nb_active++;
+    task->active = 1;
+
+    pthread_mutex_unlock(&sch->active_lock);
+
+    if (sch->stats && waited) {
+        int64_t now = av_gettime_relative();
+        atomic_fetch_add_explicit(&task->stats.time_wait_slot,
+                                  now - task->stats.last_ts, memory_order_relaxed);
+        task->stats.last_ts = now;
+    }
+}
+
+/**
+ * Called by the task's own thread when it enters the scheduler, where it may
+ * block on other tasks. Releases the activity slot held by this task, if any.
+ */
+static void task_deactivate(SchTask *task, enum TaskWait wait)
+{
+    Scheduler *sch = task->parent;
+
+    if (sch->stats)
+        task_stats_update(task, wait, 0);
+
+    if (!task->active)
+        return;
+
+    pthread_mutex_lock(&sch->active_lock);
+
+    av_assert0(sch->nb_active > 0);
+    sch->nb_active--;
+    task->active = 0;
+    pthread_cond_signal(&sch->active_cond);
+
+    pthread_mutex_unlock(&sch->active_lock);
+}
+
+static void task_stats_queue(SchTask *task, ThreadQueue *tq)
+{
+    if (task->parent->stats)
+        stats_hist_add(task->stats.queue_depth, tq_occupancy(tq));
+}
+
+static void task_stats_count(SchTask *task, int out, int processed)
+{
+    if (task->parent->stats && processed)
+        atomic_fetch_add_explicit(out ? &task->stats.nb_out : &task->stats.nb_in,
+                                  1, memory_order_relaxed);
+}
+
 static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+                       enum QueueType type, unsigned flags)
 {
     ThreadQueue *tq;
 
@@ -391,7 +568,8 @@ static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_si
     }
 
     tq = tq_alloc(nb_streams, queue_size,
-                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES);
+                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES,
+                  flags);
     if (!tq)
         return AVERROR(ENOMEM);
 
@@ -457,6 +635,18 @@ static int64_t trailing_dts(const Scheduler *sch, int count_finished)
     return min_dts == INT64_MAX ? AV_NOPTS_VALUE : min_dts;
 }
 
+static void filter_outputs_free(SchFilterGraph *fg)
+{
+    for (unsigned i = 0; i < fg->nb_outputs; i++) {
+        SchFilterOut *fo = &fg->outputs[i];
+
+        av_freep(&fo->dst);
+        av_freep(&fo->dst_finished);
+    }
+    av_freep(&fg->outputs);
+    fg->nb_outputs = 0;
+}
+
 void sch_remove_filtergraph(Scheduler *sch, int idx)
 {
     SchFilterGraph *fg = &sch->filters[idx];
@@ -468,8 +658,9 @@ void sch_remove_filtergraph(Scheduler *sch, int idx)
 
     av_freep(&fg->inputs);
     fg->nb_inputs = 0;
-    av_freep(&fg->outputs);
-    fg->nb_outputs = 0;
+    filter_outputs_free(fg);
+
+    av_frame_free(&fg->send_frame);
 
     fg->task_exited = 1;
 }
@@ -569,7 +760,9 @@ void sch_free(Scheduler **psch)
         tq_free(&fg->queue);
 
         av_freep(&fg->inputs);
-        av_freep(&fg->outputs);
+        filter_outputs_free(fg);
+
+        av_frame_free(&fg->send_frame);
 
         waiter_uninit(&fg->waiter);
     }
@@ -584,6 +777,9 @@ void sch_free(Scheduler **psch)
     pthread_mutex_destroy(&sch->finish_lock);
     pthread_cond_destroy(&sch->finish_cond);
 
+    pthread_mutex_destroy(&sch->active_lock);
+    pthread_cond_destroy(&sch->active_cond);
+
     av_freep(psch);
 }
 
@@ -620,6 +816,14 @@ Scheduler *sch_alloc(void)
     if (ret)
         goto fail;
 
+    ret = pthread_mutex_init(&sch->active_lock, NULL);
+    if (ret)
+        goto fail;
+
+    ret = pthread_cond_init(&sch->active_cond, NULL);
+    if (ret)
+        goto fail;
+
     return sch;
 fail:
     sch_free(&sch);
@@ -633,6 +837,29 @@ int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
     return sch->sdp_filename ? 0 : AVERROR(ENOMEM);
 }
 
+int sch_max_active_tasks(Scheduler *sch, int max_active)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    if (max_active < 0)
+        max_active = av_cpu_count();
+
+    sch->max_active = max_active;
+    return 0;
+}
+
+void sch_thread_budget(Scheduler *sch, const AVThreadBudget *budget)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->thread_budget = budget;
+}
+
+void sch_enable_stats(Scheduler *sch)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->stats = 1;
+}
+
 static const AVClass sch_mux_class = {
     .class_name                = "SchMux",
     .version                   = LIBAVUTIL_VERSION_INT,
@@ -779,10 +1006,6 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
-    if (ret < 0)
-        return ret;
-
     if (send_end_ts) {
         ret = av_thread_message_queue_alloc(&dec->queue_end_ts, 1, sizeof(Timestamp));
         if (ret < 0)
@@ -823,10 +1046,6 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
-    if (ret < 0)
-        return ret;
-
     return idx;
 }
 
@@ -871,7 +1090,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES, 0);
     if (ret < 0)
         return ret;
 
@@ -1032,8 +1251,11 @@ int sch_connect(Scheduler *sch, SchedulerNode src, SchedulerNode dst)
                    src.idx_stream < sch->filters[src.idx].nb_outputs);
         fo = &sch->filters[src.idx].outputs[src.idx_stream];
 
-        av_assert0(!fo->dst.type);
-        fo->dst = dst;
+        ret = GROW_ARRAY(fo->dst, fo->nb_dst);
+        if (ret < 0)
+            return ret;
+
+        fo->dst[fo->nb_dst - 1] = dst;
 
         // filtered frames go to encoding or another filtergraph
         switch (dst.type) {
@@ -1535,6 +1757,23 @@ fail:
     return ret;
 }
 
+static int dec_is_heartbeat_dst(const Scheduler *sch, unsigned dec_idx)
+{
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        const SchMux *mux = &sch->mux[i];
+
+        for (unsigned j = 0; j < mux->nb_streams; j++) {
+            const SchMuxStream *ms = &mux->streams[j];
+
+            for (unsigned k = 0; k < ms->nb_sub_heartbeat_dst; k++)
+                if (ms->sub_heartbeat_dst[k] == dec_idx)
+                    return 1;
+        }
+    }
+
+    return 0;
+}
+
 static int start_prepare(Scheduler *sch)
 {
     int ret;
@@ -1579,6 +1818,13 @@ static int start_prepare(Scheduler *sch)
             if (!o->dst_finished)
                 return AVERROR(ENOMEM);
         }
+
+        // packets are sent to the decoder by its source, and additionally by
+        // muxers when it is a subtitle heartbeat destination
+        ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS,
+                          dec_is_heartbeat_dst(sch, i) ? 0 : THREAD_QUEUE_FLAG_SPSC);
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_enc; i++) {
@@ -1598,6 +1844,13 @@ static int start_prepare(Scheduler *sch)
         enc->dst_finished = av_calloc(enc->nb_dst, sizeof(*enc->dst_finished));
         if (!enc->dst_finished)
             return AVERROR(ENOMEM);
+
+        // encoders in a sync queue get frames from whichever thread
+        // happens to be flushing the sync queue
+        ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES,
+                          enc->sq_idx[0] >= 0 ? 0 : THREAD_QUEUE_FLAG_SPSC);
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_mux; i++) {
@@ -1614,7 +1867,7 @@ static int start_prepare(Scheduler *sch)
         }
 
         ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
-                          QUEUE_PACKETS);
+                          QUEUE_PACKETS, 0);
         if (ret < 0)
             return ret;
     }
@@ -1635,11 +1888,21 @@ static int start_prepare(Scheduler *sch)
         for (unsigned j = 0; j < fg->nb_outputs; j++) {
             SchFilterOut *fo = &fg->outputs[j];
 
-            if (!fo->dst.type) {
+            if (!fo->nb_dst) {
                 av_log(fg, AV_LOG_ERROR,
                        "Filtergraph %u output %u not connected to a sink\n", i, j);
                 return AVERROR(EINVAL);
             }
+
+            fo->dst_finished = av_calloc(fo->nb_dst, sizeof(*fo->dst_finished));
+            if (!fo->dst_finished)
+                return AVERROR(ENOMEM);
+
+            if (fo->nb_dst > 1 && !fg->send_frame) {
+                fg->send_frame = av_frame_alloc();
+                if (!fg->send_frame)
+                    return AVERROR(ENOMEM);
+            }
         }
     }
 
@@ -1662,6 +1925,9 @@ int sch_start(Scheduler *sch)
     av_assert0(sch->state == SCH_STATE_UNINIT);
     sch->state = SCH_STATE_STARTED;
 
+    if (!sch->max_active && sch->thread_budget)
+        sch->max_active = av_thread_budget_total(sch->thread_budget);
+
     for (unsigned i = 0; i < sch->nb_mux; i++) {
         SchMux *mux = &sch->mux[i];
 
@@ -1742,6 +2008,123 @@ int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts)
     return ret;
 }
 
+static void stats_print_str(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
+static void stats_print_hist(AVBPrint *bp, const char *key,
+                             atomic_uint_least64_t *hist)
+{
+    uint64_t vals[STATS_HIST_SIZE], total = 0;
+    int nb_vals = 0;
+
+    for (int i = 0; i < STATS_HIST_SIZE; i++) {
+        vals[i] = atomic_load_explicit(&hist[i], memory_order_relaxed);
+        total  += vals[i];
+        if (vals[i])
+            nb_vals = i + 1;
+    }
+
+    av_bprintf(bp, "\"%s\":{\"count\":%"PRIu64, key, total);
+
+    // report the upper bound of the bucket containing each percentile
+    if (total) {
+        static const int percentiles[] = { 50, 90, 99, 100 };
+
+        for (int i = 0; i < FF_ARRAY_ELEMS(percentiles); i++) {
+            uint64_t target = (total * percentiles[i] + 99) / 100, sum = 0;
+            int bucket = 0;
+
+            while ((sum += vals[bucket]) < target)
+                bucket++;
+
+            if (percentiles[i] == 100) av_bprintf(bp, ",\"max\":");
+            else                       av_bprintf(bp, ",\"p%d\":", percentiles[i]);
+            av_bprintf(bp, "%"PRIu64, bucket ? UINT64_C(1) << bucket : 0);
+        }
+    }
+
+    av_bprintf(bp, ",\"hist\":[");
+    for (int i = 0; i < nb_vals; i++)
+        av_bprintf(bp, "%s%"PRIu64, i ? "," : "", vals[i]);
+    av_bprintf(bp, "]}");
+}
+
+static void stats_print_task(AVBPrint *bp, SchTask *task, int *first)
+{
+    static const char * const type_names[] = {
+        [SCH_NODE_TYPE_DEMUX]     = "demux",
+        [SCH_NODE_TYPE_MUX]       = "mux",
+        [SCH_NODE_TYPE_DEC]       = "dec",
+        [SCH_NODE_TYPE_ENC]       = "enc",
+        [SCH_NODE_TYPE_FILTER_IN] = "filter",
+    };
+    SchTaskStats  *st = &task->stats;
+    const AVClass *cls;
+
+    // removed filtergraph
+    if (!task->parent)
+        return;
+
+    cls = *(const AVClass**)task->func_arg;
+
+    av_bprintf(bp, "%s{\"type\":\"%s\",\"index\":%u,\"name\":",
+               *first ? "" : ",", type_names[task->node.type], task->node.idx);
+    stats_print_str(bp, cls->item_name ? cls->item_name(task->func_arg) :
+                                         cls->class_name);
+    *first = 0;
+
+#define PRINT_COUNTER(key, field)                                             \
+    av_bprintf(bp, ",\"" key "\":%"PRIu64,                                   \
+               (uint64_t)atomic_load_explicit(&st->field, memory_order_relaxed))
+    PRINT_COUNTER("items_in",         nb_in);
+    PRINT_COUNTER("items_out",        nb_out);
+    PRINT_COUNTER("busy_us",          time_busy);
+    PRINT_COUNTER("wait_input_us",    time_wait_in);
+    PRINT_COUNTER("wait_output_us",   time_wait_out);
+    PRINT_COUNTER("wait_slot_us",     time_wait_slot);
+#undef PRINT_COUNTER
+
+    av_bprint_chars(bp, ',', 1);
+    stats_print_hist(bp, "latency_us", st->latency);
+    av_bprint_chars(bp, ',', 1);
+    stats_print_hist(bp, "queue_depth", st->queue_depth);
+
+    av_bprint_chars(bp, '}', 1);
+}
+
+void sch_stats_print(Scheduler *sch, AVBPrint *bp)
+{
+    int first = 1;
+
+    av_assert0(sch->stats);
+
+    av_bprint_chars(bp, '[', 1);
+
+    for (unsigned i = 0; i < sch->nb_demux; i++)
+        stats_print_task(bp, &sch->demux[i].task, &first);
+    for (unsigned i = 0; i < sch->nb_dec; i++)
+        stats_print_task(bp, &sch->dec[i].task, &first);
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        stats_print_task(bp, &sch->filters[i].task, &first);
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        stats_print_task(bp, &sch->enc[i].task, &first);
+    for (unsigned i = 0; i < sch->nb_mux; i++)
+        stats_print_task(bp, &sch->mux[i].task, &first);
+
+    av_bprint_chars(bp, ']', 1);
+}
+
 static int enc_open(Scheduler *sch, SchEnc *enc, const AVFrame *frame)
 {
     int ret;
@@ -2089,15 +2472,11 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
     return 0;
 }
 
-int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
-                   unsigned flags)
+static int demux_send(Scheduler *sch, SchDemux *d, AVPacket *pkt,
+                      unsigned flags)
 {
-    SchDemux *d;
     int terminate;
 
-    av_assert0(demux_idx < sch->nb_demux);
-    d = &sch->demux[demux_idx];
-
     terminate = waiter_wait(sch, &d->waiter);
     if (terminate)
         return AVERROR_EXIT;
@@ -2111,6 +2490,23 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
+int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                   unsigned flags)
+{
+    SchDemux *d;
+    int ret;
+
+    av_assert0(demux_idx < sch->nb_demux);
+    d = &sch->demux[demux_idx];
+
+    task_deactivate(&d->task, TASK_WAIT_OUTPUT);
+    ret = demux_send(sch, d, pkt, flags);
+    task_activate(&d->task, TASK_WAIT_OUTPUT);
+    task_stats_count(&d->task, 1, ret >= 0);
+
+    return ret;
+}
+
 static int demux_done(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d = &sch->demux[demux_idx];
@@ -2141,7 +2537,12 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
     av_assert0(mux_idx < sch->nb_mux);
     mux = &sch->mux[mux_idx];
 
+    task_deactivate(&mux->task, TASK_WAIT_INPUT);
+    task_stats_queue(&mux->task, mux->queue);
     ret = tq_receive(mux->queue, &stream_idx, pkt);
+    task_activate(&mux->task, TASK_WAIT_INPUT);
+    task_stats_count(&mux->task, 0, ret >= 0);
+
     pkt->stream_index = stream_idx;
     return ret;
 }
@@ -2184,7 +2585,9 @@ int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
         if (ret < 0)
             return ret;
 
+        task_deactivate(&mux->task, TASK_WAIT_OUTPUT);
         tq_send(dst->queue, 0, mux->sub_heartbeat_pkt);
+        task_activate(&mux->task, TASK_WAIT_OUTPUT);
     }
 
     return 0;
@@ -2225,17 +2628,24 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
     av_assert0(dec_idx < sch->nb_dec);
     dec = &sch->dec[dec_idx];
 
+    task_deactivate(&dec->task, TASK_WAIT_INPUT);
+
     // the decoder should have given us post-flush end timestamp in pkt
     if (dec->expect_end_ts) {
         Timestamp ts = (Timestamp){ .ts = pkt->pts, .tb = pkt->time_base };
         ret = av_thread_message_queue_send(dec->queue_end_ts, &ts, 0);
-        if (ret < 0)
+        if (ret < 0) {
+            task_activate(&dec->task, TASK_WAIT_INPUT);
             return ret;
+        }
 
         dec->expect_end_ts = 0;
     }
 
+    task_stats_queue(&dec->task, dec->queue);
     ret = tq_receive(dec->queue, &dummy, pkt);
+    task_activate(&dec->task, TASK_WAIT_INPUT);
+    task_stats_count(&dec->task, 0, ret >= 0);
     av_assert0(dummy <= 0);
 
     // got a flush packet, on the next call to this function the decoder
@@ -2263,8 +2673,8 @@ static int send_to_filter(Scheduler *sch, SchFilterGraph *fg,
     return 0;
 }
 
-static int dec_send_to_dst(Scheduler *sch, const SchedulerNode dst,
-                           uint8_t *dst_finished, AVFrame *frame)
+static int frame_send_to_dst(Scheduler *sch, const SchedulerNode dst,
+                             uint8_t *dst_finished, AVFrame *frame)
 {
     int ret;
 
@@ -2293,20 +2703,12 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx,
-                 unsigned out_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, SchDec *dec, SchDecOutput *o,
+                    AVFrame *frame)
 {
-    SchDec *dec;
-    SchDecOutput *o;
     int ret;
     unsigned nb_done = 0;
 
-    av_assert0(dec_idx < sch->nb_dec);
-    dec = &sch->dec[dec_idx];
-
-    av_assert0(out_idx < dec->nb_outputs);
-    o = &dec->outputs[out_idx];
-
     for (unsigned i = 0; i < o->nb_dst; i++) {
         uint8_t *finished = &o->dst_finished[i];
         AVFrame *to_send  = frame;
@@ -2323,7 +2725,7 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
                 return ret;
         }
 
-        ret = dec_send_to_dst(sch, o->dst[i], finished, to_send);
+        ret = frame_send_to_dst(sch, o->dst[i], finished, to_send);
         if (ret < 0) {
             av_frame_unref(to_send);
             if (ret == AVERROR_EOF) {
@@ -2337,6 +2739,25 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     return (nb_done == o->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx,
+                 unsigned out_idx, AVFrame *frame)
+{
+    SchDec *dec;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    dec = &sch->dec[dec_idx];
+
+    av_assert0(out_idx < dec->nb_outputs);
+
+    task_deactivate(&dec->task, TASK_WAIT_OUTPUT);
+    ret = dec_send(sch, dec, &dec->outputs[out_idx], frame);
+    task_activate(&dec->task, TASK_WAIT_OUTPUT);
+    task_stats_count(&dec->task, 1, frame && ret >= 0);
+
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
@@ -2353,7 +2774,7 @@ static int dec_done(Scheduler *sch, unsigned dec_idx)
         SchDecOutput *o = &dec->outputs[i];
 
         for (unsigned j = 0; j < o->nb_dst; j++) {
-            int err = dec_send_to_dst(sch, o->dst[j], &o->dst_finished[j], NULL);
+            int err = frame_send_to_dst(sch, o->dst[j], &o->dst_finished[j], NULL);
             if (err < 0 && err != AVERROR_EOF)
                 ret = err_merge(ret, err);
         }
@@ -2370,7 +2791,11 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
     av_assert0(enc_idx < sch->nb_enc);
     enc = &sch->enc[enc_idx];
 
+    task_deactivate(&enc->task, TASK_WAIT_INPUT);
+    task_stats_queue(&enc->task, enc->queue);
     ret = tq_receive(enc->queue, &dummy, frame);
+    task_activate(&enc->task, TASK_WAIT_INPUT);
+    task_stats_count(&enc->task, 0, ret >= 0);
     av_assert0(dummy <= 0);
 
     return ret;
@@ -2406,14 +2831,10 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, SchEnc *enc, AVPacket *pkt)
 {
-    SchEnc *enc;
     int ret;
 
-    av_assert0(enc_idx < sch->nb_enc);
-    enc = &sch->enc[enc_idx];
-
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         uint8_t *finished = &enc->dst_finished[i];
         AVPacket *to_send = pkt;
@@ -2439,6 +2860,22 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    SchEnc *enc;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+
+    task_deactivate(&enc->task, TASK_WAIT_OUTPUT);
+    ret = enc_send(sch, enc, pkt);
+    task_activate(&enc->task, TASK_WAIT_OUTPUT);
+    task_stats_count(&enc->task, 1, pkt && ret >= 0);
+
+    return ret;
+}
+
 static int enc_done(Scheduler *sch, unsigned enc_idx)
 {
     SchEnc *enc = &sch->enc[enc_idx];
@@ -2455,16 +2892,9 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int filter_receive(Scheduler *sch, SchFilterGraph *fg,
+                          unsigned *in_idx, AVFrame *frame)
 {
-    SchFilterGraph *fg;
-
-    av_assert0(fg_idx < sch->nb_filters);
-    fg = &sch->filters[fg_idx];
-
-    av_assert0(*in_idx <= fg->nb_inputs);
-
     // update scheduling to account for desired input stream, if it changed
     //
     // this check needs no locking because only the filtering thread
@@ -2499,6 +2929,32 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    SchFilterGraph *fg;
+    enum TaskWait wait;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    fg = &sch->filters[fg_idx];
+
+    av_assert0(*in_idx <= fg->nb_inputs);
+
+    // with no input requested, the graph only waits to be unchoked
+    wait = *in_idx == fg->nb_inputs ? TASK_WAIT_OUTPUT : TASK_WAIT_INPUT;
+
+    task_deactivate(&fg->task, wait);
+    if (wait == TASK_WAIT_INPUT)
+        task_stats_queue(&fg->task, fg->queue);
+    ret = filter_receive(sch, fg, in_idx, frame);
+    task_activate(&fg->task, wait);
+    if (wait == TASK_WAIT_INPUT)
+        task_stats_count(&fg->task, 0, ret >= 0);
+
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2526,27 +2982,58 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
     pthread_mutex_unlock(&sch->schedule_lock);
 }
 
+static int filter_send(Scheduler *sch, SchFilterGraph *fg, SchFilterOut *fo,
+                       AVFrame *frame)
+{
+    int ret;
+    unsigned nb_done = 0;
+
+    for (unsigned i = 0; i < fo->nb_dst; i++) {
+        uint8_t *finished = &fo->dst_finished[i];
+        AVFrame *to_send  = frame;
+
+        // sending a frame consumes it, so make a temporary reference if needed;
+        // NULL signals EOF to every destination
+        if (frame && i < fo->nb_dst - 1) {
+            to_send = fg->send_frame;
+
+            // frame may contain props only, e.g. when a filtergraph output
+            // produced no frames and is initializing its consumers
+            ret = frame->buf[0] ? av_frame_ref(to_send, frame) :
+                                  av_frame_copy_props(to_send, frame);
+            if (ret < 0)
+                return ret;
+        }
+
+        ret = frame_send_to_dst(sch, fo->dst[i], finished, to_send);
+        if (ret < 0) {
+            av_frame_unref(to_send);
+            if (ret == AVERROR_EOF) {
+                nb_done++;
+                continue;
+            }
+            return ret;
+        }
+    }
+
+    return (nb_done == fo->nb_dst) ? AVERROR_EOF : 0;
+}
+
 int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
-    SchedulerNode  dst;
     int ret;
 
     av_assert0(fg_idx < sch->nb_filters);
     fg = &sch->filters[fg_idx];
 
     av_assert0(out_idx < fg->nb_outputs);
-    dst = fg->outputs[out_idx].dst;
 
-    if (dst.type == SCH_NODE_TYPE_ENC) {
-        ret = send_to_enc(sch, &sch->enc[dst.idx], frame);
-        if (ret == AVERROR_EOF)
-            send_to_enc(sch, &sch->enc[dst.idx], NULL);
-    } else {
-        ret = send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
-        if (ret == AVERROR_EOF)
-            send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, NULL);
-    }
+    task_deactivate(&fg->task, TASK_WAIT_OUTPUT);
+    ret = filter_send(sch, fg, &fg->outputs[out_idx], frame);
+    task_activate(&fg->task, TASK_WAIT_OUTPUT);
+    task_stats_count(&fg->task, 1, frame && ret >= 0);
+
     return ret;
 }
 
@@ -2559,13 +3046,13 @@ static int filter_done(Scheduler *sch, unsigned fg_idx)
         tq_receive_finish(fg->queue, i);
 
     for (unsigned i = 0; i < fg->nb_outputs; i++) {
-        SchedulerNode dst = fg->outputs[i].dst;
-        int err = (dst.type == SCH_NODE_TYPE_ENC)                                   ?
-                  send_to_enc   (sch, &sch->enc[dst.idx],                     NULL) :
-                  send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, NULL);
+        SchFilterOut *fo = &fg->outputs[i];
 
-        if (err < 0 && err != AVERROR_EOF)
-            ret = err_merge(ret, err);
+        for (unsigned j = 0; j < fo->nb_dst; j++) {
+            int err = frame_send_to_dst(sch, fo->dst[j], &fo->dst_finished[j], NULL);
+            if (err < 0 && err != AVERROR_EOF)
+                ret = err_merge(ret, err);
+        }
     }
 
     pthread_mutex_lock(&sch->schedule_lock);
@@ -2620,7 +3107,12 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    task->stats.last_ts = av_gettime_relative();
+
+    task_activate(task, TASK_WAIT_NONE);
     ret = task->func(task->func_arg);
+    task_deactivate(task, TASK_WAIT_NONE);
+
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
                "Task finished with error code: %d (%s)\n", ret, av_err2str(ret));
@@ -2673,6 +3165,11 @@ int sch_stop(Scheduler *sch, int64_t *finish_ts)
 
     atomic_store(&sch->terminate, 1);
 
+    // wake up any tasks waiting for an activity slot
+    pthread_mutex_lock(&sch->active_lock);
+    pthread_cond_broadcast(&sch->active_cond);
+    pthread_mutex_unlock(&sch->active_lock);
+
     for (unsigned type = 0; type < 2; type++)
         for (unsigned i = 0; i < (type ? sch->nb_demux : sch->nb_filters); i++) {
             SchWaiter *w = type ? &sch->demux[i].waiter : &sch->filters[i].waiter;
@@ -74,9 +74,10 @@
  * - encoding and muxing output from filtergraph(s) that have no inputs;
  * - creating a file that contains nothing but attachments and/or metadata.
  *
- * N.B. 2: a filtergraph output could, in principle, feed multiple encoders, but
- * this is unnecessary because the (a)split filter provides the same
- * functionality.
+ * N.B. 2: a filtergraph output may feed multiple destinations. Users should
+ * normally use the (a)split filter for that, but it allows the CLI to feed
+ * the output of one simple filtergraph both to its encoder and to another
+ * filtergraph, e.g. to build cascaded scaling chains.
  *
  * The scheduler, in the above model, is the master object that oversees and
  * facilitates the transcoding process. The basic idea is that all instances
@@ -85,8 +86,10 @@
  * knowledge about the whole transcoding pipeline.
  */
 
+struct AVBPrint;
 struct AVFrame;
 struct AVPacket;
+struct AVThreadBudget;
 
 typedef struct Scheduler Scheduler;
 
@@ -300,6 +303,48 @@ int sch_mux_stream_ready(Scheduler *sch, unsigned mux_idx, unsigned stream_idx);
  */
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename);
 
+/**
+ * Limit the number of tasks that may be processing data at the same time.
+ *
+ * Every task still runs in its own thread, but only max_active of them are
+ * allowed to execute their own code (decoding, filtering, encoding, etc.)
+ * concurrently. A task gives up its slot whenever it calls into the scheduler
+ * to receive or send data, i.e. whenever it might block waiting on other
+ * tasks, so the limit can never cause a deadlock.
+ *
+ * Must be called before sch_start().
+ *
+ * @param max_active maximum number of concurrently active tasks; 0 means no
+ *                   limit, a negative value means the number of CPUs
+ */
+int sch_max_active_tasks(Scheduler *sch, int max_active);
+
+/**
+ * Bound the number of concurrently active tasks by the size of the given
+ * process-wide thread budget, unless a limit was explicitly set with
+ * sch_max_active_tasks(). The budget must outlive the scheduler.
+ *
+ * Must be called before sch_start().
+ */
+void sch_thread_budget(Scheduler *sch, const struct AVThreadBudget *budget);
+
+/**
+ * Make the scheduler collect per-task statistics: number of items processed,
+ * time spent processing, blocked on input, blocked on output and waiting for
+ * an activity slot, histograms of per-item processing time and of input
+ * queue depth.
+ *
+ * Must be called before sch_start().
+ */
+void sch_enable_stats(Scheduler *sch);
+
+/**
+ * Print the statistics collected for every task as a JSON array to bp.
+ * May be called at any time after sch_start() and before sch_free(), as long
+ * as statistics were enabled with sch_enable_stats().
+ */
+void sch_stats_print(Scheduler *sch, struct AVBPrint *bp);
+
 /**
  * Add an encoder to the scheduler.
  *
@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -49,6 +50,23 @@ struct ThreadQueue {
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
+
+    /* THREAD_QUEUE_FLAG_SPSC state, used instead of everything above except
+     * lock and cond, which only serve for waiting.
+     *
+     * Items are stored in a ring of preallocated frames/packets, the
+     * positions are monotonically increasing counters written only by the
+     * sender (ring_write) or the receiver (ring_read). A thread that cannot
+     * proceed increments nb_waiting and sleeps on cond; the other side only
+     * takes the lock to wake it up when nb_waiting is non-zero. */
+    int             spsc;
+    void          **ring;
+    size_t          ring_size;
+    atomic_size_t   ring_read;
+    atomic_size_t   ring_write;
+    atomic_int      spsc_finished;
+    atomic_int      spsc_choked;
+    atomic_int      nb_waiting;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -61,6 +79,14 @@ void tq_free(ThreadQueue **ptq)
     av_container_fifo_free(&tq->fifo);
     av_fifo_freep2(&tq->fifo_stream_index);
 
+    for (size_t i = 0; tq->ring && i < tq->ring_size; i++) {
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_free((AVFrame**)&tq->ring[i]);
+        else
+            av_packet_free((AVPacket**)&tq->ring[i]);
+    }
+    av_freep(&tq->ring);
+
     av_freep(&tq->finished);
 
     pthread_cond_destroy(&tq->cond);
@@ -69,8 +95,33 @@ void tq_free(ThreadQueue **ptq)
     av_freep(ptq);
 }
 
+static int spsc_init(ThreadQueue *tq, size_t queue_size)
+{
+    tq->ring = av_calloc(queue_size, sizeof(*tq->ring));
+    if (!tq->ring)
+        return AVERROR(ENOMEM);
+    tq->ring_size = queue_size;
+
+    for (size_t i = 0; i < queue_size; i++) {
+        tq->ring[i] = (tq->type == THREAD_QUEUE_FRAMES) ?
+                      (void*)av_frame_alloc() : (void*)av_packet_alloc();
+        if (!tq->ring[i])
+            return AVERROR(ENOMEM);
+    }
+
+    atomic_init(&tq->ring_read,     0);
+    atomic_init(&tq->ring_write,    0);
+    atomic_init(&tq->spsc_finished, 0);
+    atomic_init(&tq->spsc_choked,   0);
+    atomic_init(&tq->nb_waiting,    0);
+
+    tq->spsc = 1;
+
+    return 0;
+}
+
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type)
+                      enum ThreadQueueType type, unsigned flags)
 {
     ThreadQueue *tq;
     int ret;
@@ -99,6 +150,13 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
 
     tq->type = type;
 
+    if (flags & THREAD_QUEUE_FLAG_SPSC) {
+        av_assert0(nb_streams == 1 && queue_size > 0);
+        if (spsc_init(tq, queue_size) < 0)
+            goto fail;
+        return tq;
+    }
+
     tq->fifo = (type == THREAD_QUEUE_FRAMES) ?
                av_container_fifo_alloc_avframe(0) : av_container_fifo_alloc_avpacket(0);
     if (!tq->fifo)
@@ -114,12 +172,120 @@ fail:
     return NULL;
 }
 
+static int spsc_can_send(ThreadQueue *tq)
+{
+    return (atomic_load(&tq->spsc_finished) & FINISHED_RECV) ||
+           atomic_load(&tq->ring_write) - atomic_load(&tq->ring_read) < tq->ring_size;
+}
+
+static int spsc_can_receive(ThreadQueue *tq)
+{
+    return !atomic_load(&tq->spsc_choked) &&
+           (atomic_load(&tq->spsc_finished) ||
+            atomic_load(&tq->ring_write) != atomic_load(&tq->ring_read));
+}
+
+/**
+ * Sleep until ready() is true. Every change that can make it true must be
+ * followed by spsc_wake().
+ */
+static void spsc_wait(ThreadQueue *tq, int (*ready)(ThreadQueue *tq))
+{
+    if (ready(tq))
+        return;
+
+    pthread_mutex_lock(&tq->lock);
+
+    // the increment must be visible before ready() is checked again, so that
+    // the other thread either sees it or we see the change it made
+    atomic_fetch_add(&tq->nb_waiting, 1);
+    while (!ready(tq))
+        pthread_cond_wait(&tq->cond, &tq->lock);
+    atomic_fetch_sub(&tq->nb_waiting, 1);
+
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static void spsc_wake(ThreadQueue *tq)
+{
+    if (!atomic_load(&tq->nb_waiting))
+        return;
+
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static int spsc_send(ThreadQueue *tq, void *data)
+{
+    size_t pos;
+
+    if (atomic_load(&tq->spsc_finished) & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    spsc_wait(tq, spsc_can_send);
+
+    if (atomic_load(&tq->spsc_finished) & FINISHED_RECV) {
+        atomic_fetch_or(&tq->spsc_finished, FINISHED_SEND);
+        return AVERROR_EOF;
+    }
+
+    pos = atomic_load_explicit(&tq->ring_write, memory_order_relaxed);
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_move_ref(tq->ring[pos % tq->ring_size], data);
+    else
+        av_packet_move_ref(tq->ring[pos % tq->ring_size], data);
+    atomic_store(&tq->ring_write, pos + 1);
+
+    spsc_wake(tq);
+
+    return 0;
+}
+
+static int spsc_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    while (1) {
+        size_t pos;
+
+        spsc_wait(tq, spsc_can_receive);
+
+        pos = atomic_load_explicit(&tq->ring_read, memory_order_relaxed);
+        if (pos != atomic_load(&tq->ring_write)) {
+            void *item = tq->ring[pos % tq->ring_size];
+            int discard = atomic_load(&tq->spsc_finished) & FINISHED_RECV;
+
+            if (tq->type == THREAD_QUEUE_FRAMES)
+                discard ? av_frame_unref(item) : av_frame_move_ref(data, item);
+            else
+                discard ? av_packet_unref(item) : av_packet_move_ref(data, item);
+            atomic_store(&tq->ring_read, pos + 1);
+
+            spsc_wake(tq);
+
+            if (discard)
+                continue;
+
+            *stream_idx = 0;
+            return 0;
+        }
+
+        // the queue is empty and finished from either side;
+        // return EOF for the stream to the consumer at most once
+        if (!(atomic_fetch_or(&tq->spsc_finished, FINISHED_RECV) & FINISHED_RECV))
+            *stream_idx = 0;
+        return AVERROR_EOF;
+    }
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
     int *finished;
     int ret;
 
     av_assert0(stream_idx < tq->nb_streams);
+
+    if (tq->spsc)
+        return spsc_send(tq, data);
     finished = &tq->finished[stream_idx];
 
     pthread_mutex_lock(&tq->lock);
@@ -200,6 +366,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 
     *stream_idx = -1;
 
+    if (tq->spsc)
+        return spsc_receive(tq, stream_idx, data);
+
     pthread_mutex_lock(&tq->lock);
 
     while (1) {
@@ -228,6 +397,13 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->spsc) {
+        atomic_fetch_or(&tq->spsc_finished, FINISHED_SEND);
+        atomic_store(&tq->spsc_choked, 0);
+        spsc_wake(tq);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as send-finished;
@@ -244,6 +420,12 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->spsc) {
+        atomic_fetch_or(&tq->spsc_finished, FINISHED_RECV);
+        spsc_wake(tq);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as recv-finished;
@@ -255,8 +437,28 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
     pthread_mutex_unlock(&tq->lock);
 }
 
+size_t tq_occupancy(ThreadQueue *tq)
+{
+    size_t ret;
+
+    if (tq->spsc)
+        return atomic_load(&tq->ring_write) - atomic_load(&tq->ring_read);
+
+    pthread_mutex_lock(&tq->lock);
+    ret = av_fifo_can_read(tq->fifo_stream_index);
+    pthread_mutex_unlock(&tq->lock);
+
+    return ret;
+}
+
 void tq_choke(ThreadQueue *tq, int choked)
 {
+    if (tq->spsc) {
+        if (atomic_exchange(&tq->spsc_choked, choked) != choked)
+            spsc_wake(tq);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     int prev_choked = tq->choked;
@@ -26,6 +26,16 @@ enum ThreadQueueType {
     THREAD_QUEUE_PACKETS,
 };
 
+enum ThreadQueueFlags {
+    /**
+     * The queue has a single stream, all items are sent from one thread and
+     * received from one (different) thread. Such a queue exchanges items
+     * without taking any locks, unless one of the threads needs to wait for
+     * the other.
+     */
+    THREAD_QUEUE_FLAG_SPSC = (1 << 0),
+};
+
 typedef struct ThreadQueue ThreadQueue;
 
 /**
@@ -35,9 +45,10 @@ typedef struct ThreadQueue ThreadQueue;
  *                   maintained
  * @param queue_size number of items that can be stored in the queue without
  *                   blocking
+ * @param flags a combination of THREAD_QUEUE_FLAG_*
  */
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type);
+                      enum ThreadQueueType type, unsigned flags);
 void         tq_free(ThreadQueue **tq);
 
 /**
@@ -87,4 +98,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * @return the number of items currently stored in the queue
+ */
+size_t tq_occupancy(ThreadQueue *tq);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
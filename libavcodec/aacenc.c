@@ -821,6 +821,83 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+typedef struct ElementJobs {
+    const FFPsyWindowInfo *windows;
+    int start_ch[AAC_MAX_CHANNELS];
+    int bitres_alloc[AAC_MAX_CHANNELS];
+    int cutoff[AAC_MAX_CHANNELS];
+} ElementJobs;
+
+/**
+ * Search the coding parameters of a channel element and apply the coding
+ * tools to its coefficients. Channel elements are independent of each other
+ * at this point, so this is run for all of them in parallel.
+ */
+static int search_element(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    AACEncContext     *s = avctx->priv_data;
+    AACEncContext    *ws = s->workers[threadnr];
+    ElementJobs    *jobs = arg;
+    const int start_ch = jobs->start_ch[jobnr];
+    const FFPsyWindowInfo *wi = jobs->windows + start_ch;
+    const int tag      = s->chan_map[jobnr + 1];
+    const int chans    = tag == TYPE_CPE ? 2 : 1;
+    ChannelElement *cpe = &s->cpe[jobnr];
+    int ch, w;
+
+    ws->psy.bitres.alloc = jobs->bitres_alloc[jobnr];
+    ws->cur_type         = tag;
+    ws->random_state     = cpe->random_state;
+
+    for (ch = 0; ch < chans; ch++) {
+        ws->cur_channel = start_ch + ch;
+        if (ws->options.pns && ws->coder->mark_pns)
+            ws->coder->mark_pns(ws, avctx, &cpe->ch[ch]);
+        ws->coder->search_for_quantizers(avctx, ws, &cpe->ch[ch], ws->lambda);
+    }
+    if (chans > 1
+        && wi[0].window_type[0] == wi[1].window_type[0]
+        && wi[0].window_shape   == wi[1].window_shape) {
+
+        cpe->common_window = 1;
+        for (w = 0; w < wi[0].num_windows; w++) {
+            if (wi[0].grouping[w] != wi[1].grouping[w]) {
+                cpe->common_window = 0;
+                break;
+            }
+        }
+    }
+    for (ch = 0; ch < chans; ch++) { /* TNS and PNS */
+        SingleChannelElement *sce = &cpe->ch[ch];
+        ws->cur_channel = start_ch + ch;
+        if (ws->options.tns && ws->coder->search_for_tns)
+            ws->coder->search_for_tns(ws, sce);
+        if (ws->options.tns && ws->coder->apply_tns_filt)
+            ws->coder->apply_tns_filt(ws, sce);
+        if (ws->options.pns && ws->coder->search_for_pns)
+            ws->coder->search_for_pns(ws, avctx, sce);
+    }
+    ws->cur_channel = start_ch;
+    if (ws->options.intensity_stereo) { /* Intensity Stereo */
+        if (ws->coder->search_for_is)
+            ws->coder->search_for_is(ws, avctx, cpe);
+        apply_intensity_stereo(cpe);
+    }
+    if (ws->options.mid_side) { /* Mid/Side stereo */
+        if (ws->options.mid_side == -1 && ws->coder->search_for_ms)
+            ws->coder->search_for_ms(ws, cpe);
+        else if (cpe->common_window)
+            memset(cpe->ms_mask, 1, sizeof(cpe->ms_mask));
+        apply_mid_side_stereo(cpe);
+    }
+    adjust_frame_information(cpe, chans);
+
+    cpe->random_state   = ws->random_state;
+    jobs->cutoff[jobnr] = ws->psy.cutoff;
+
+    return 0;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
@@ -834,6 +911,7 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
     int chan_el_counter[4];
     FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
+    ElementJobs jobs = { .windows = windows };
 
     /* add current frame to queue */
     if (frame) {
@@ -948,7 +1026,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             put_bitstream_info(s, LIBAVCODEC_IDENT);
         start_ch = 0;
         target_bits = 0;
-        memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
             FFPsyWindowInfo* wi = windows + start_ch;
             const float *coeffs[2];
@@ -958,8 +1035,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             cpe->common_window = 0;
             memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
             memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
-            put_bits(&s->pb, 3, tag);
-            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             for (ch = 0; ch < chans; ch++) {
                 sce = &cpe->ch[ch];
                 coeffs[ch] = sce->coeffs;
@@ -968,6 +1043,8 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     if (sce->band_type[w] > RESERVED_BT)
                         sce->band_type[w] = 0;
             }
+            /* the psy model carries its bit reservoir state from one element
+             * to the next, so this part stays sequential */
             s->psy.bitres.alloc = -1;
             s->psy.bitres.bits = s->last_frame_pb_count / s->channels;
             s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
@@ -977,52 +1054,35 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
                 s->psy.bitres.alloc /= chans;
             }
+            jobs.start_ch[i]     = start_ch;
+            jobs.bitres_alloc[i] = s->psy.bitres.alloc;
+            start_ch += chans;
+        }
+
+        /* the jobs must not touch the main context, so hand the state they
+         * read to the workers before starting them */
+        for (i = 0; i < s->nb_workers; i++) {
+            s->workers[i]->lambda = s->lambda;
+            s->workers[i]->psy    = s->psy;
+        }
+        avctx->execute2(avctx, search_element, &jobs, NULL, s->chan_map[0]);
+        /* keep the cutoff of the last element, as a sequential search would */
+        s->psy.cutoff = jobs.cutoff[s->chan_map[0] - 1];
+
+        start_ch = 0;
+        memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        for (i = 0; i < s->chan_map[0]; i++) {
+            tag      = s->chan_map[i+1];
+            chans    = tag == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
             s->cur_type = tag;
-            for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                if (s->options.pns && s->coder->mark_pns)
-                    s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
-            }
-            if (chans > 1
-                && wi[0].window_type[0] == wi[1].window_type[0]
-                && wi[0].window_shape   == wi[1].window_shape) {
-
-                cpe->common_window = 1;
-                for (w = 0; w < wi[0].num_windows; w++) {
-                    if (wi[0].grouping[w] != wi[1].grouping[w]) {
-                        cpe->common_window = 0;
-                        break;
-                    }
-                }
-            }
-            for (ch = 0; ch < chans; ch++) { /* TNS and PNS */
-                sce = &cpe->ch[ch];
-                s->cur_channel = start_ch + ch;
-                if (s->options.tns && s->coder->search_for_tns)
-                    s->coder->search_for_tns(s, sce);
-                if (s->options.tns && s->coder->apply_tns_filt)
-                    s->coder->apply_tns_filt(s, sce);
-                if (sce->tns.present)
+            for (ch = 0; ch < chans; ch++)
+                if (cpe->ch[ch].tns.present)
                     tns_mode = 1;
-                if (s->options.pns && s->coder->search_for_pns)
-                    s->coder->search_for_pns(s, avctx, sce);
-            }
-            s->cur_channel = start_ch;
-            if (s->options.intensity_stereo) { /* Intensity Stereo */
-                if (s->coder->search_for_is)
-                    s->coder->search_for_is(s, avctx, cpe);
-                if (cpe->is_mode) is_mode = 1;
-                apply_intensity_stereo(cpe);
-            }
-            if (s->options.mid_side) { /* Mid/Side stereo */
-                if (s->options.mid_side == -1 && s->coder->search_for_ms)
-                    s->coder->search_for_ms(s, cpe);
-                else if (cpe->common_window)
-                    memset(cpe->ms_mask, 1, sizeof(cpe->ms_mask));
-                apply_mid_side_stereo(cpe);
-            }
-            adjust_frame_information(cpe, chans);
+            if (cpe->is_mode)
+                is_mode = 1;
+            put_bits(&s->pb, 3, tag);
+            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             if (chans == 2) {
                 put_bits(&s->pb, 1, cpe->common_window);
                 if (cpe->common_window) {
@@ -1139,6 +1199,12 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     av_tx_uninit(&s->mdct128);
     ff_psy_end(&s->psy);
     ff_lpc_end(&s->lpc);
+    for (int i = 0; i < s->nb_workers; i++) {
+        if (s->workers[i])
+            ff_lpc_end(&s->workers[i]->lpc);
+        av_freep(&s->workers[i]);
+    }
+    av_freep(&s->workers);
     av_freep(&s->buffer.samples);
     av_freep(&s->cpe);
     av_freep(&s->fdsp);
@@ -1146,6 +1212,35 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     return 0;
 }
 
+static av_cold int alloc_workers(AVCodecContext *avctx, AACEncContext *s)
+{
+    int nb_workers = 1;
+
+    if (avctx->active_thread_type & FF_THREAD_SLICE)
+        nb_workers = av_clip(avctx->thread_count, 1, s->chan_map[0]);
+
+    s->workers = av_calloc(nb_workers, sizeof(*s->workers));
+    if (!s->workers)
+        return AVERROR(ENOMEM);
+    s->nb_workers = nb_workers;
+
+    for (int i = 0; i < nb_workers; i++) {
+        AACEncContext *ws = av_memdup(s, sizeof(*s));
+        if (!ws)
+            return AVERROR(ENOMEM);
+        s->workers[i] = ws;
+
+        ws->workers    = NULL;
+        ws->nb_workers = 0;
+        memset(&ws->lpc, 0, sizeof(ws->lpc));
+        if (ff_lpc_init(&ws->lpc, 2*avctx->frame_size, TNS_MAX_ORDER,
+                        FF_LPC_TYPE_LEVINSON) < 0)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
 static av_cold int dsp_init(AVCodecContext *avctx, AACEncContext *s)
 {
     int ret = 0;
@@ -1291,13 +1386,14 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
                            s->chan_map[0], grouping)) < 0)
         return ret;
     ff_lpc_init(&s->lpc, 2*avctx->frame_size, TNS_MAX_ORDER, FF_LPC_TYPE_LEVINSON);
-    s->random_state = 0x1f2e3d4c;
+    for (i = 0; i < s->chan_map[0]; i++)
+        s->cpe[i].random_state = 0x1f2e3d4c;
 
     ff_aacenc_dsp_init(&s->aacdsp);
 
     ff_af_queue_init(avctx, &s->afq);
 
-    return 0;
+    return alloc_workers(avctx, s);
 }
 
 #define AACENC_FLAGS AV_OPT_FLAG_ENCODING_PARAM | AV_OPT_FLAG_AUDIO_PARAM
@@ -1332,7 +1428,8 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
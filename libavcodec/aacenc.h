@@ -133,6 +133,7 @@ typedef struct ChannelElement {
     uint8_t is_mask[128];     ///< Set if intensity stereo is used
     // shared
     SingleChannelElement ch[2];
+    int random_state;         ///< PNS noise generator state
 } ChannelElement;
 
 struct AACEncContext;
@@ -201,7 +202,7 @@ typedef struct AACEncContext {
     FFPsyContext psy;
     const AACCoefficientsEncoder *coder;
     int cur_channel;                             ///< current channel for coder context
-    int random_state;
+    int random_state;                            ///< noise generator state of the element being searched
     float lambda;
     int last_frame_pb_count;                     ///< number of bits for the previous frame
     float lambda_sum;                            ///< sum(lambda), for Qvg reporting
@@ -220,6 +221,14 @@ typedef struct AACEncContext {
     struct {
         float *samples;
     } buffer;
+
+    /**
+     * Contexts used by each slice thread for searching the coding parameters
+     * of a channel element. They are copies of the main context with their
+     * own scratch buffers; the main context itself is never used by a job.
+     */
+    struct AACEncContext **workers;
+    int nb_workers;
 } AACEncContext;
 
 void ff_quantize_band_cost_cache_init(struct AACEncContext *s);
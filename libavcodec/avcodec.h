@@ -2937,6 +2937,27 @@ int avcodec_fill_audio_frame(AVFrame *frame, int nb_channels,
  */
 void avcodec_flush_buffers(AVCodecContext *avctx);
 
+/**
+ * Reset an opened decoder to decode a new, unrelated stream.
+ *
+ * In addition to what avcodec_flush_buffers() does, this drops all state
+ * the decoder derived from the previous stream, like parameter sets, and
+ * applies the codec parameters of the new stream as if the context had been
+ * opened with them. Threads, frame pools and other resources that do not
+ * depend on the stream are kept, which makes this much cheaper than closing
+ * and reopening the context when decoding many short streams.
+ *
+ * @param avctx an opened decoder context
+ * @param par   parameters of the new stream, with the same codec type and
+ *              codec ID as avctx
+ * @return 0 on success; AVERROR(ENOSYS) if the decoder does not support
+ *         being reset, in which case the context is left untouched;
+ *         another negative error code on failure, after which the context
+ *         must be closed.
+ */
+int avcodec_reset_decoder(AVCodecContext *avctx,
+                          const struct AVCodecParameters *par);
+
 /**
  * Return audio frame duration.
  *
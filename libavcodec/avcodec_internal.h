@@ -87,6 +87,16 @@ void ff_thread_free(struct AVCodecContext *s);
  */
 void ff_thread_flush(struct AVCodecContext *avctx);
 
+/**
+ * Reset the decoding threads for a new stream, using the stream parameters
+ * set on the user's context. Called by avcodec_reset_decoder() after
+ * ff_thread_flush().
+ *
+ * @param avctx The context.
+ * @return 0 on success, negative error code on failure
+ */
+int ff_thread_reset(struct AVCodecContext *avctx);
+
 /**
  * Submit available packets for decoding to worker threads, return a
  * decoded frame if available. Returns AVERROR(EAGAIN) if none is available.
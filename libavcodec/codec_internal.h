@@ -253,6 +253,15 @@ typedef struct FFCodec {
      */
     void (*flush)(struct AVCodecContext *);
 
+    /**
+     * Decoding only, reset the decoder for a new stream.
+     * Called by avcodec_reset_decoder() after flush(), with the parameters
+     * of the new stream, including extradata, already set on the context.
+     * Must bring the decoder to the state it has after init(), while
+     * keeping the resources that do not depend on the stream.
+     */
+    int (*reset)(struct AVCodecContext *);
+
     /**
      * Decoding only, a comma-separated list of bitstream filters to apply to
      * packets before decoding.
@@ -2322,6 +2322,52 @@ av_cold void ff_decode_flush_buffers(AVCodecContext *avctx)
     dc->draining_started   = 0;
 }
 
+int avcodec_reset_decoder(AVCodecContext *avctx, const AVCodecParameters *par)
+{
+    AVCodecInternal *avci;
+    DecodeContext     *dc;
+    const FFCodec *codec;
+    int ret;
+
+    if (!avcodec_is_open(avctx) || !av_codec_is_decoder(avctx->codec))
+        return AVERROR(EINVAL);
+
+    codec = ffcodec(avctx->codec);
+    if (!codec->reset)
+        return AVERROR(ENOSYS);
+    if (par->codec_type != avctx->codec_type || par->codec_id != avctx->codec_id)
+        return AVERROR(EINVAL);
+
+    avci = avctx->internal;
+    dc   = decode_ctx(avci);
+
+    /* This also waits for all frame threads to become idle. */
+    avcodec_flush_buffers(avctx);
+
+    avctx->coded_width = avctx->coded_height = 0;
+    ret = avcodec_parameters_to_context(avctx, par);
+    if (ret < 0)
+        return ret;
+    if (avctx->width && avctx->height)
+        ff_set_dimensions(avctx, avctx->width, avctx->height);
+
+    avctx->frame_num = 0;
+    dc->pts_correction_num_faulty_pts =
+    dc->pts_correction_num_faulty_dts = 0;
+
+    /* The bitstream filters may depend on the extradata. */
+    if (codec->bsfs) {
+        av_bsf_free(&avci->bsf);
+        ret = decode_bsfs_init(avctx);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME)
+        return ff_thread_reset(avctx);
+    return codec->reset(avctx);
+}
+
 av_cold AVCodecInternal *ff_decode_internal_alloc(void)
 {
     return av_mallocz(sizeof(DecodeContext));
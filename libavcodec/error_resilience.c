@@ -29,6 +29,7 @@
 
 #include "libavutil/avassert.h"
 #include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
 #include "avcodec.h"
 #include "error_resilience.h"
 #include "mathops.h"
@@ -56,9 +57,12 @@ static void set_mv_strides(ERContext *s, ptrdiff_t *mv_step, ptrdiff_t *stride)
 
 /**
  * Replace the current MB with a flat dc-only version.
+ * @param chroma_w width of the chroma part of the MB
+ * @param chroma_h height of the chroma part of the MB
  */
 static void put_dc(ERContext *s, uint8_t *dest_y, uint8_t *dest_cb,
-                   uint8_t *dest_cr, int mb_x, int mb_y)
+                   uint8_t *dest_cr, int mb_x, int mb_y,
+                   int chroma_w, int chroma_h)
 {
     int *linesize = s->cur_pic.f->linesize;
     int dc, dcu, dcv, y, i;
@@ -86,9 +90,9 @@ static void put_dc(ERContext *s, uint8_t *dest_y, uint8_t *dest_cb,
         dcv = 2040;
 
     if (dest_cr)
-    for (y = 0; y < 8; y++) {
+    for (y = 0; y < chroma_h; y++) {
         int x;
-        for (x = 0; x < 8; x++) {
+        for (x = 0; x < chroma_w; x++) {
             dest_cb[x + y * linesize[1]] = dcu / 8;
             dest_cr[x + y * linesize[2]] = dcv / 8;
         }
@@ -770,11 +774,11 @@ static int is_intra_more_likely(ERContext *s)
                 if (s->avctx->codec_id == AV_CODEC_ID_H264) {
                     // FIXME
                 } else {
-                    ff_thread_progress_await(s->last_pic.progress, mb_y);
+                    /* the row below is compared as well */
+                    ff_thread_progress_await(s->last_pic.progress, mb_y + 1);
                 }
                 is_intra_likely += s->sad(NULL, last_mb_ptr, mb_ptr,
                                           linesize[0], 16);
-                // FIXME need await_progress() here
                 is_intra_likely -= s->sad(NULL, last_mb_ptr,
                                           last_mb_ptr + linesize[0] * 16,
                                           linesize[0], 16);
@@ -905,6 +909,7 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
     int is_intra_likely;
     int size = s->b8_stride * 2 * s->mb_height;
     int guessed_mb_type;
+    int chroma_x_shift, chroma_y_shift, chroma_w, chroma_h, chroma_dc_shift;
 
     /* We do not support ER of field pictures yet,
      * though it should not crash if enabled. */
@@ -917,6 +922,13 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
     }
     linesize = s->cur_pic.f->linesize;
 
+    av_pix_fmt_get_chroma_sub_sample(s->cur_pic.f->format,
+                                     &chroma_x_shift, &chroma_y_shift);
+    chroma_w = 16 >> chroma_x_shift;
+    chroma_h = 16 >> chroma_y_shift;
+    /* the DC values are 8 times the mean, as for the 8x8 luma blocks */
+    chroma_dc_shift = 5 - chroma_x_shift - chroma_y_shift;
+
     if (   s->avctx->codec_id == AV_CODEC_ID_MPEG2VIDEO
         && (FFALIGN(s->avctx->height, 16)&16)
         && atomic_load(&s->error_count) == 3 * s->mb_width * (s->avctx->skip_top + s->avctx->skip_bottom + 1)) {
@@ -1242,8 +1254,8 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
             //     continue; // inter data damaged FIXME is this good?
 
             dest_y  = s->cur_pic.f->data[0] + mb_x * 16 + mb_y * 16 * linesize[0];
-            dest_cb = s->cur_pic.f->data[1] + mb_x *  8 + mb_y *  8 * linesize[1];
-            dest_cr = s->cur_pic.f->data[2] + mb_x *  8 + mb_y *  8 * linesize[2];
+            dest_cb = s->cur_pic.f->data[1] + mb_x * chroma_w + mb_y * chroma_h * linesize[1];
+            dest_cr = s->cur_pic.f->data[2] + mb_x * chroma_w + mb_y * chroma_h * linesize[2];
 
             dc_ptr = &s->dc_val[0][mb_x * 2 + mb_y * 2 * s->b8_stride];
             for (n = 0; n < 4; n++) {
@@ -1261,15 +1273,15 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
                 continue;
 
             dcu = dcv = 0;
-            for (y = 0; y < 8; y++) {
+            for (y = 0; y < chroma_h; y++) {
                 int x;
-                for (x = 0; x < 8; x++) {
+                for (x = 0; x < chroma_w; x++) {
                     dcu += dest_cb[x + y * linesize[1]];
                     dcv += dest_cr[x + y * linesize[2]];
                 }
             }
-            s->dc_val[1][mb_x + mb_y * s->mb_stride] = (dcu + 4) >> 3;
-            s->dc_val[2][mb_x + mb_y * s->mb_stride] = (dcv + 4) >> 3;
+            s->dc_val[1][mb_x + mb_y * s->mb_stride] = (dcu + (1 << chroma_dc_shift >> 1)) >> chroma_dc_shift;
+            s->dc_val[2][mb_x + mb_y * s->mb_stride] = (dcv + (1 << chroma_dc_shift >> 1)) >> chroma_dc_shift;
         }
     }
 #if 1
@@ -1298,12 +1310,12 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
                 continue; // undamaged
 
             dest_y  = s->cur_pic.f->data[0] + mb_x * 16 + mb_y * 16 * linesize[0];
-            dest_cb = s->cur_pic.f->data[1] + mb_x *  8 + mb_y *  8 * linesize[1];
-            dest_cr = s->cur_pic.f->data[2] + mb_x *  8 + mb_y *  8 * linesize[2];
+            dest_cb = s->cur_pic.f->data[1] + mb_x * chroma_w + mb_y * chroma_h * linesize[1];
+            dest_cr = s->cur_pic.f->data[2] + mb_x * chroma_w + mb_y * chroma_h * linesize[2];
             if (!s->cur_pic.f->data[2])
                 dest_cb = dest_cr = NULL;
 
-            put_dc(s, dest_y, dest_cb, dest_cr, mb_x, mb_y);
+            put_dc(s, dest_y, dest_cb, dest_cr, mb_x, mb_y, chroma_w, chroma_h);
         }
     }
 #endif
@@ -1317,7 +1329,8 @@ void ff_er_frame_end(ERContext *s, int *decode_error_flags)
         v_block_filter(s, s->cur_pic.f->data[0], s->mb_width * 2,
                        s->mb_height * 2, linesize[0], 1);
 
-        if (s->cur_pic.f->data[2]) {
+        /* the chroma filters map 8x8 blocks to MBs as in 4:2:0 */
+        if (s->cur_pic.f->data[2] && chroma_w == 8 && chroma_h == 8) {
             h_block_filter(s, s->cur_pic.f->data[1], s->mb_width,
                         s->mb_height, linesize[1], 0);
             h_block_filter(s, s->cur_pic.f->data[2], s->mb_width,
@@ -120,7 +120,10 @@ typedef struct FlacEncodeContext {
     FlacFrame frame;
     CompressionOptions options;
     AVCodecContext *avctx;
-    LPCContext lpc_ctx;
+    /* one per channel with slice threading, as channels are then encoded
+     * concurrently, a single one otherwise */
+    LPCContext lpc_ctx[FLAC_MAX_CHANNELS];
+    int nb_lpc_ctx;
     struct AVMD5 *md5ctx;
     uint8_t *md5_buffer;
     unsigned int md5_buffer_size;
@@ -464,8 +467,13 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
         }
     }
 
-    ret = ff_lpc_init(&s->lpc_ctx, avctx->frame_size,
-                      s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+    s->nb_lpc_ctx = (avctx->active_thread_type & FF_THREAD_SLICE) ? channels : 1;
+    for (i = 0; i < s->nb_lpc_ctx; i++) {
+        ret = ff_lpc_init(&s->lpc_ctx[i], avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+    }
 
     ff_bswapdsp_init(&s->bdsp);
     ff_flacencdsp_init(&s->flac_dsp);
@@ -1048,7 +1056,8 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         for (i = 0; i < n; i++)
             smp[i] = smp_33bps[i] >> 1;
 
-    opt_order = ff_lpc_calc_coefs(&s->lpc_ctx, smp, n, min_order, max_order,
+    opt_order = ff_lpc_calc_coefs(&s->lpc_ctx[s->nb_lpc_ctx > 1 ? ch : 0],
+                                  smp, n, min_order, max_order,
                                   s->options.lpc_coeff_precision, coefs, shift, s->options.lpc_type,
                                   s->options.lpc_passes, omethod,
                                   MIN_LPC_SHIFT, MAX_LPC_SHIFT, 0);
@@ -1206,6 +1215,12 @@ static int count_frame_header(FlacEncodeContext *s)
 }
 
 
+static int encode_residual_ch_thread(AVCodecContext *avctx, void *arg,
+                                     int jobnr, int threadnr)
+{
+    return encode_residual_ch(avctx->priv_data, jobnr);
+}
+
 static int encode_frame(FlacEncodeContext *s)
 {
     int ch;
@@ -1213,8 +1228,19 @@ static int encode_frame(FlacEncodeContext *s)
 
     count = count_frame_header(s);
 
-    for (ch = 0; ch < s->channels; ch++)
-        count += encode_residual_ch(s, ch);
+    /* subframes are independent of each other once the channel
+     * decorrelation has been done */
+    if (s->nb_lpc_ctx > 1) {
+        int ch_count[FLAC_MAX_CHANNELS];
+
+        s->avctx->execute2(s->avctx, encode_residual_ch_thread, NULL,
+                           ch_count, s->channels);
+        for (ch = 0; ch < s->channels; ch++)
+            count += ch_count[ch];
+    } else {
+        for (ch = 0; ch < s->channels; ch++)
+            count += encode_residual_ch(s, ch);
+    }
 
     count += (8 - (count & 7)) & 7; // byte alignment
     count += 16;                    // CRC-16
@@ -1705,7 +1731,8 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
-    ff_lpc_end(&s->lpc_ctx);
+    for (int i = 0; i < s->nb_lpc_ctx; i++)
+        ff_lpc_end(&s->lpc_ctx[i]);
     return 0;
 }
 
@@ -1755,6 +1782,7 @@ const FFCodec ff_flac_encoder = {
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                       AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
@@ -383,21 +383,10 @@ static av_cold int h264_decode_end(AVCodecContext *avctx)
 
 static AVOnce h264_vlc_init = AV_ONCE_INIT;
 
-static av_cold int h264_decode_init(AVCodecContext *avctx)
+static av_cold int h264_init_extradata(AVCodecContext *avctx, H264Context *h)
 {
-    H264Context *h = avctx->priv_data;
     int ret;
 
-    ret = h264_init_context(avctx, h);
-    if (ret < 0)
-        return ret;
-
-    ret = ff_thread_once(&h264_vlc_init, ff_h264_decode_init_vlc);
-    if (ret != 0) {
-        av_log(avctx, AV_LOG_ERROR, "pthread_once has failed.");
-        return AVERROR_UNKNOWN;
-    }
-
     if (!avctx->internal->is_copy) {
         if (avctx->extradata_size > 0 && avctx->extradata) {
             ret = ff_h264_decode_extradata(avctx->extradata, avctx->extradata_size,
@@ -410,7 +399,6 @@ static av_cold int h264_decode_init(AVCodecContext *avctx)
                if (explode) {
                    return ret;
                }
-               ret = 0;
            }
         }
     }
@@ -420,6 +408,28 @@ static av_cold int h264_decode_init(AVCodecContext *avctx)
         h->avctx->has_b_frames = h->ps.sps->num_reorder_frames;
     }
 
+    return 0;
+}
+
+static av_cold int h264_decode_init(AVCodecContext *avctx)
+{
+    H264Context *h = avctx->priv_data;
+    int ret;
+
+    ret = h264_init_context(avctx, h);
+    if (ret < 0)
+        return ret;
+
+    ret = ff_thread_once(&h264_vlc_init, ff_h264_decode_init_vlc);
+    if (ret != 0) {
+        av_log(avctx, AV_LOG_ERROR, "pthread_once has failed.");
+        return AVERROR_UNKNOWN;
+    }
+
+    ret = h264_init_extradata(avctx, h);
+    if (ret < 0)
+        return ret;
+
     ff_h264_flush_change(h);
 
     if (h->enable_er < 0 && (avctx->active_thread_type & FF_THREAD_SLICE))
@@ -500,6 +510,27 @@ static av_cold void h264_decode_flush(AVCodecContext *avctx)
         FF_HW_SIMPLE_CALL(avctx, flush);
 }
 
+/* start over with a new stream, see avcodec_reset_decoder() */
+static av_cold int h264_decode_reset(AVCodecContext *avctx)
+{
+    H264Context *h = avctx->priv_data;
+
+    ff_h264_ps_uninit(&h->ps);
+    h->is_avc             = 0;
+    h->nal_length_size    = 0;
+    h->has_recovery_point = 0;
+
+    h->cur_chroma_format_idc = -1;
+    h->cur_bit_depth_luma    = 0;
+    h->width_from_caller     = avctx->width;
+    h->height_from_caller    = avctx->height;
+    h->poc.prev_poc_msb      = 1 << 16;
+    h->sei.common.frame_packing.arrangement_cancel_flag = -1;
+    h->sei.common.unregistered.x264_build = -1;
+
+    return h264_init_extradata(avctx, h);
+}
+
 static int get_last_needed_nal(H264Context *h)
 {
     int nals_needed = 0;
@@ -1152,6 +1183,7 @@ const FFCodec ff_h264_decoder = {
     .caps_internal         = FF_CODEC_CAP_EXPORTS_CROPPING |
                              FF_CODEC_CAP_INIT_CLEANUP,
     .flush                 = h264_decode_flush,
+    .reset                 = h264_decode_reset,
     UPDATE_THREAD_CONTEXT(ff_h264_update_thread_context),
     UPDATE_THREAD_CONTEXT_FOR_USER(ff_h264_update_thread_context_for_user),
     .p.profiles            = NULL_IF_CONFIG_SMALL(ff_h264_profiles),
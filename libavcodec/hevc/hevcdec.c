@@ -44,6 +44,7 @@
 #include "cabac_functions.h"
 #include "codec_internal.h"
 #include "decode.h"
+#include "executor.h"
 #include "golomb.h"
 #include "h274.h"
 #include "hevc.h"
@@ -2746,6 +2747,23 @@ static void hls_decode_neighbour(HEVCLocalContext *lc,
     lc->ctb_up_left_flag = ((x_ctb > 0) && (y_ctb > 0)  && (ctb_addr_in_slice-1 >= sps->ctb_width) && (pps->tile_id[ctb_addr_ts] == pps->tile_id[pps->ctb_addr_rs_to_ts[ctb_addr_rs-1 - sps->ctb_width]]));
 }
 
+/**
+ * Run the in-loop filters that became possible after decoding the CTB at
+ * x_ctb, y_ctb, or only signal its completion if they are offloaded.
+ */
+static void hls_filters(HEVCLocalContext *lc, const HEVCLayerContext *l,
+                        const HEVCPPS *pps, int x_ctb, int y_ctb, int ctb_size)
+{
+    const HEVCContext *const s = lc->parent;
+    int log2_ctb_size = pps->sps->log2_ctb_size;
+
+    if (s->filter_active)
+        ff_thread_progress_report(&s->rec_progress[y_ctb >> log2_ctb_size],
+                                  (x_ctb >> log2_ctb_size) + 1);
+    else
+        ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
+}
+
 static int hls_decode_entry(HEVCContext *s, GetBitContext *gb)
 {
     HEVCLocalContext *const lc = &s->local_ctx[0];
@@ -2790,27 +2808,24 @@ static int hls_decode_entry(HEVCContext *s, GetBitContext *gb)
 
         ctb_addr_ts++;
         ff_hevc_save_states(lc, pps, ctb_addr_ts);
-        ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
+        hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
     }
 
     if (x_ctb + ctb_size >= sps->width &&
-        y_ctb + ctb_size >= sps->height)
+        y_ctb + ctb_size >= sps->height && !s->filter_active)
         ff_hevc_hls_filter(lc, l, pps, x_ctb, y_ctb, ctb_size);
 
     return ctb_addr_ts;
 }
 
-static int hls_decode_entry_wpp(AVCodecContext *avctx, void *hevc_lclist,
-                                int job, int thread)
+static int decode_entry_wpp(HEVCLocalContext *lc, int ctb_row)
 {
-    HEVCLocalContext *lc = &((HEVCLocalContext*)hevc_lclist)[thread];
     const HEVCContext *const s = lc->parent;
     const HEVCLayerContext *const l = &s->layers[s->cur_layer];
     const HEVCPPS   *const pps = s->pps;
     const HEVCSPS   *const sps = pps->sps;
     int ctb_size    = 1 << sps->log2_ctb_size;
     int more_data   = 1;
-    int ctb_row = job;
     int ctb_addr_rs = s->sh.slice_ctb_addr_rs + ctb_row * ((sps->width + ctb_size - 1) >> sps->log2_ctb_size);
     int ctb_addr_ts = pps->ctb_addr_rs_to_ts[ctb_addr_rs];
 
@@ -2863,7 +2878,7 @@ static int hls_decode_entry_wpp(AVCodecContext *avctx, void *hevc_lclist,
 
         ff_hevc_save_states(lc, pps, ctb_addr_ts);
         ff_thread_progress_report(&s->wpp_progress[ctb_row], ++progress);
-        ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
+        hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
 
         if (!more_data && (x_ctb+ctb_size) < sps->width && ctb_row != s->sh.num_entry_point_offsets) {
             /* Casting const away here is safe, because it is an atomic operation. */
@@ -2873,7 +2888,8 @@ static int hls_decode_entry_wpp(AVCodecContext *avctx, void *hevc_lclist,
         }
 
         if ((x_ctb+ctb_size) >= sps->width && (y_ctb+ctb_size) >= sps->height ) {
-            ff_hevc_hls_filter(lc, l, pps, x_ctb, y_ctb, ctb_size);
+            if (!s->filter_active)
+                ff_hevc_hls_filter(lc, l, pps, x_ctb, y_ctb, ctb_size);
             ff_thread_progress_report(&s->wpp_progress[ctb_row], INT_MAX);
             return ctb_addr_ts;
         }
@@ -2895,32 +2911,246 @@ error:
     return ret;
 }
 
-static int wpp_progress_init(HEVCContext *s, unsigned count)
+static int hls_decode_entry_wpp(AVCodecContext *avctx, void *hevc_lclist,
+                                int job, int thread)
+{
+    HEVCLocalContext *lc = &((HEVCLocalContext*)hevc_lclist)[thread];
+
+    return decode_entry_wpp(lc, job);
+}
+
+typedef struct HEVCRowTask {
+    FFTask task;
+    int    row;
+    int    ret;
+    const HEVCLocalContext *lc;  ///< context the row was decoded on
+} HEVCRowTask;
+
+static int hevc_row_task_run(FFTask *t, void *local_context, void *user_data)
+{
+    HEVCRowTask       *task = (HEVCRowTask*)t;
+    HEVCLocalContext    *lc = local_context;
+    HEVCContext          *s = user_data;
+    const HEVCLocalContext *lc0 = &s->local_ctx[0];
+
+    if (!lc->parent) {
+        lc->logctx             = s->avctx;
+        lc->parent             = s;
+        lc->common_cabac_state = &s->cabac;
+    }
+
+    /* The first row continues the state set up by the slice header,
+     * the others start a new quantization group. */
+    if (!task->row) {
+        lc->first_qp_group = lc0->first_qp_group;
+        lc->qPy_pred       = lc0->qPy_pred;
+    } else
+        lc->first_qp_group = 1;
+    lc->qp_y               = lc0->qp_y;
+    lc->tu.cu_qp_offset_cb = 0;
+    lc->tu.cu_qp_offset_cr = 0;
+
+    task->ret = decode_entry_wpp(lc, task->row);
+    task->lc  = lc;
+
+    if (atomic_fetch_sub(&s->wpp_rows_left, 1) == 1)
+        ff_thread_progress_report(&s->wpp_done, 1);
+    return 0;
+}
+
+static int wpp_execute(HEVCContext *s, int nb_rows)
 {
-    if (s->nb_wpp_progress < count) {
-        void *tmp = av_realloc_array(s->wpp_progress, count,
-                                     sizeof(*s->wpp_progress));
+    int res = 0;
+
+    if (s->nb_wpp_tasks < nb_rows) {
+        void *tmp = av_realloc_array(s->wpp_tasks, nb_rows, sizeof(*s->wpp_tasks));
         if (!tmp)
             return AVERROR(ENOMEM);
+        s->wpp_tasks    = tmp;
+        s->nb_wpp_tasks = nb_rows;
+    }
+
+    atomic_store(&s->wpp_rows_left, nb_rows);
+    ff_thread_progress_reset(&s->wpp_done);
 
-        s->wpp_progress = tmp;
-        memset(s->wpp_progress + s->nb_wpp_progress, 0,
-               (count - s->nb_wpp_progress) * sizeof(*s->wpp_progress));
+    for (int i = 0; i < nb_rows; i++) {
+        HEVCRowTask *t = &s->wpp_tasks[i];
 
-        for (int i = s->nb_wpp_progress; i < count; i++) {
-            int ret = ff_thread_progress_init(&s->wpp_progress[i], 1);
+        memset(t, 0, sizeof(*t));
+        t->row = i;
+        ff_executor_execute(s->executor, &t->task);
+    }
+
+    ff_thread_progress_await(&s->wpp_done, 1);
+
+    /* A dependent slice segment starting in the middle of the last row
+     * continues its CABAC and QP state, and is decoded on local_ctx[0]. */
+    if (nb_rows) {
+        const HEVCLocalContext *last = s->wpp_tasks[nb_rows - 1].lc;
+        HEVCLocalContext        *lc0 = &s->local_ctx[0];
+
+        memcpy(lc0->cabac_state, last->cabac_state, sizeof(lc0->cabac_state));
+        memcpy(lc0->stat_coeff,  last->stat_coeff,  sizeof(lc0->stat_coeff));
+        lc0->qPy_pred = last->qPy_pred;
+    }
+
+    for (int i = 0; i < nb_rows; i++)
+        res += s->wpp_tasks[i].ret;
+
+    return res;
+}
+
+static int progress_array_init(ThreadProgress **pprogress, unsigned *nb_progress,
+                               unsigned count)
+{
+    if (*nb_progress < count) {
+        ThreadProgress *tmp = av_realloc_array(*pprogress, count, sizeof(*tmp));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+
+        *pprogress = tmp;
+        memset(tmp + *nb_progress, 0, (count - *nb_progress) * sizeof(*tmp));
+
+        for (int i = *nb_progress; i < count; i++) {
+            int ret = ff_thread_progress_init(&tmp[i], 1);
             if (ret < 0)
                 return ret;
-            s->nb_wpp_progress = i + 1;
+            *nb_progress = i + 1;
         }
     }
 
     for (int i = 0; i < count; i++)
-        ff_thread_progress_reset(&s->wpp_progress[i]);
+        ff_thread_progress_reset(&(*pprogress)[i]);
 
     return 0;
 }
 
+static void progress_array_free(ThreadProgress **pprogress, unsigned *nb_progress)
+{
+    for (int i = 0; i < *nb_progress; i++)
+        ff_thread_progress_destroy(&(*pprogress)[i]);
+    av_freep(pprogress);
+    *nb_progress = 0;
+}
+
+static int wpp_progress_init(HEVCContext *s, unsigned count)
+{
+    return progress_array_init(&s->wpp_progress, &s->nb_wpp_progress, count);
+}
+
+typedef struct HEVCFilterTask {
+    FFTask task;
+    const HEVCLayerContext *l;
+    const HEVCPPS *pps;
+    int row;
+} HEVCFilterTask;
+
+/**
+ * Deblock and SAO one CTB row. Every CTB is filtered at the point where
+ * the inline path would do it: once the CTB to its lower right has been
+ * reconstructed. Adjacent rows run as a wavefront with the same lag the
+ * WPP decoding path uses, which also keeps the frame progress reports
+ * in row order.
+ */
+static int hevc_filter_task_run(FFTask *t, void *local_context, void *user_data)
+{
+    HEVCFilterTask *task = (HEVCFilterTask*)t;
+    HEVCLocalContext *lc = local_context;
+    HEVCContext       *s = user_data;
+    const HEVCSPS   *sps = task->pps->sps;
+    int ctb_size = 1 << sps->log2_ctb_size;
+    int row      = task->row;
+    int dep_row  = FFMIN(row + 1, sps->ctb_height - 1);
+
+    if (!lc->parent) {
+        lc->logctx = s->avctx;
+        lc->parent = s;
+    }
+
+    for (int x = 0; x < sps->ctb_width; x++) {
+        int needed = FFMIN(x + 2, sps->ctb_width);
+
+        ff_thread_progress_await(&s->rec_progress[dep_row], needed);
+        if (row)
+            ff_thread_progress_await(&s->filter_progress[row - 1], needed);
+
+        ff_hevc_hls_filter(lc, task->l, task->pps,
+                           x << sps->log2_ctb_size, row << sps->log2_ctb_size,
+                           ctb_size);
+        ff_thread_progress_report(&s->filter_progress[row], x + 1);
+    }
+
+    if (atomic_fetch_sub(&s->filter_rows_left, 1) == 1)
+        ff_thread_progress_report(&s->filter_done, 1);
+    return 0;
+}
+
+/**
+ * Start filtering the current picture on the filter threads. The loop
+ * filter is only offloaded if it runs in raster order and does not depend
+ * on per-slice state.
+ */
+static int hevc_filter_start(HEVCContext *s, const HEVCLayerContext *l,
+                             const HEVCPPS *pps)
+{
+    const HEVCSPS *sps = pps->sps;
+    int ret;
+
+    if (!s->filter_executor || pps->tiles_enabled_flag ||
+        s->avctx->skip_loop_filter > AVDISCARD_DEFAULT)
+        return 0;
+
+    ret = progress_array_init(&s->rec_progress, &s->nb_rec_progress,
+                              sps->ctb_height);
+    if (ret < 0)
+        return ret;
+    ret = progress_array_init(&s->filter_progress, &s->nb_filter_progress,
+                              sps->ctb_height);
+    if (ret < 0)
+        return ret;
+
+    if (s->nb_filter_tasks < sps->ctb_height) {
+        void *tmp = av_realloc_array(s->filter_tasks, sps->ctb_height,
+                                     sizeof(*s->filter_tasks));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        s->filter_tasks    = tmp;
+        s->nb_filter_tasks = sps->ctb_height;
+    }
+
+    atomic_store(&s->filter_rows_left, sps->ctb_height);
+    ff_thread_progress_reset(&s->filter_done);
+    s->filter_active = 1;
+
+    for (int i = 0; i < sps->ctb_height; i++) {
+        HEVCFilterTask *t = &s->filter_tasks[i];
+
+        memset(t, 0, sizeof(*t));
+        t->l   = l;
+        t->pps = pps;
+        t->row = i;
+        ff_executor_execute(s->filter_executor, &t->task);
+    }
+
+    return 0;
+}
+
+/**
+ * Wait until the current picture is completely filtered. Rows that were
+ * not reconstructed, e.g. due to missing slices, are released as well.
+ */
+static void hevc_filter_finish(HEVCContext *s)
+{
+    if (!s->filter_active)
+        return;
+
+    for (int i = 0; i < s->nb_rec_progress; i++)
+        ff_thread_progress_report(&s->rec_progress[i], INT_MAX);
+    ff_thread_progress_await(&s->filter_done, 1);
+
+    s->filter_active = 0;
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const HEVCPPS *const pps = s->pps;
@@ -3009,6 +3239,9 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     if (res < 0)
         return res;
 
+    if (pps->entropy_coding_sync_enabled_flag && s->executor)
+        return wpp_execute(s, s->sh.num_entry_point_offsets + 1);
+
     ret = av_calloc(s->sh.num_entry_point_offsets + 1, sizeof(*ret));
     if (!ret)
         return AVERROR(ENOMEM);
@@ -3069,7 +3302,13 @@ static int decode_slice_data(HEVCContext *s, const HEVCLayerContext *l,
     s->local_ctx[0].tu.cu_qp_offset_cb = 0;
     s->local_ctx[0].tu.cu_qp_offset_cr = 0;
 
-    if (s->avctx->active_thread_type == FF_THREAD_SLICE  &&
+    if (s->sh.first_slice_in_pic_flag) {
+        ret = hevc_filter_start(s, l, s->cur_frame->pps);
+        if (ret < 0)
+            return ret;
+    }
+
+    if ((s->avctx->active_thread_type == FF_THREAD_SLICE || s->executor) &&
         s->sh.num_entry_point_offsets > 0                &&
         pps->num_tile_rows == 1 && pps->num_tile_columns == 1)
         return hls_slice_data_wpp(s, nal);
@@ -3559,9 +3798,11 @@ static int decode_slice(HEVCContext *s, unsigned nal_idx, GetBitContext *gb)
 
     // switching to a new layer, mark previous layer's frame (if any) as done
     if (s->cur_layer != layer_idx &&
-        s->layers[s->cur_layer].cur_frame &&
-        s->avctx->active_thread_type == FF_THREAD_FRAME)
-        ff_progress_frame_report(&s->layers[s->cur_layer].cur_frame->tf, INT_MAX);
+        s->layers[s->cur_layer].cur_frame) {
+        hevc_filter_finish(s);
+        if (s->avctx->active_thread_type == FF_THREAD_FRAME)
+            ff_progress_frame_report(&s->layers[s->cur_layer].cur_frame->tf, INT_MAX);
+    }
 
     s->cur_layer = layer_idx;
     l = &s->layers[s->cur_layer];
@@ -3779,6 +4020,8 @@ static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
     }
 
 fail:
+    hevc_filter_finish(s);
+
     for (int i = 0; i < FF_ARRAY_ELEMS(s->layers); i++) {
         HEVCLayerContext *l = &s->layers[i];
 
@@ -3949,9 +4192,17 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
 
     ff_hevc_ps_uninit(&s->ps);
 
-    for (int i = 0; i < s->nb_wpp_progress; i++)
-        ff_thread_progress_destroy(&s->wpp_progress[i]);
-    av_freep(&s->wpp_progress);
+    progress_array_free(&s->wpp_progress, &s->nb_wpp_progress);
+
+    ff_executor_free(&s->executor);
+    av_freep(&s->wpp_tasks);
+    ff_thread_progress_destroy(&s->wpp_done);
+
+    ff_executor_free(&s->filter_executor);
+    av_freep(&s->filter_tasks);
+    progress_array_free(&s->rec_progress, &s->nb_rec_progress);
+    progress_array_free(&s->filter_progress, &s->nb_filter_progress);
+    ff_thread_progress_destroy(&s->filter_done);
 
     av_freep(&s->sh.entry_point_offset);
     av_freep(&s->sh.offset);
@@ -4000,6 +4251,38 @@ static av_cold int hevc_init_context(AVCodecContext *avctx)
 
     ff_bswapdsp_init(&s->bdsp);
 
+    if (s->wpp_threads > 0) {
+        FFTaskCallbacks cb = {
+            .user_data          = s,
+            .local_context_size = sizeof(HEVCLocalContext),
+            .priorities         = 1,
+            .run                = hevc_row_task_run,
+        };
+        int ret = ff_thread_progress_init(&s->wpp_done, 1);
+        if (ret < 0)
+            return ret;
+
+        s->executor = ff_executor_alloc(&cb, s->wpp_threads);
+        if (!s->executor)
+            return AVERROR(ENOMEM);
+    }
+
+    if (s->filter_threads > 0) {
+        FFTaskCallbacks cb = {
+            .user_data          = s,
+            .local_context_size = sizeof(HEVCLocalContext),
+            .priorities         = 1,
+            .run                = hevc_filter_task_run,
+        };
+        int ret = ff_thread_progress_init(&s->filter_done, 1);
+        if (ret < 0)
+            return ret;
+
+        s->filter_executor = ff_executor_alloc(&cb, s->filter_threads);
+        if (!s->filter_executor)
+            return AVERROR(ENOMEM);
+    }
+
     s->dovi_ctx.logctx = avctx;
     s->eos = 0;
 
@@ -4151,20 +4434,11 @@ static int hevc_sei_to_context(AVCodecContext *avctx, HEVCSEI *sei)
     return 0;
 }
 
-static av_cold int hevc_decode_init(AVCodecContext *avctx)
+static av_cold int hevc_init_extradata(AVCodecContext *avctx)
 {
     HEVCContext *s = avctx->priv_data;
     int ret;
 
-    ret = hevc_init_context(avctx);
-    if (ret < 0)
-        return ret;
-
-    s->sei.picture_timing.picture_struct = 0;
-    s->eos = 1;
-
-    atomic_init(&s->wpp_err, 0);
-
     if (!avctx->internal->is_copy) {
         const AVPacketSideData *sd;
 
@@ -4187,6 +4461,23 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     return 0;
 }
 
+static av_cold int hevc_decode_init(AVCodecContext *avctx)
+{
+    HEVCContext *s = avctx->priv_data;
+    int ret;
+
+    ret = hevc_init_context(avctx);
+    if (ret < 0)
+        return ret;
+
+    s->sei.picture_timing.picture_struct = 0;
+    s->eos = 1;
+
+    atomic_init(&s->wpp_err, 0);
+
+    return hevc_init_extradata(avctx);
+}
+
 static av_cold void hevc_decode_flush(AVCodecContext *avctx)
 {
     HEVCContext *s = avctx->priv_data;
@@ -4200,12 +4491,29 @@ static av_cold void hevc_decode_flush(AVCodecContext *avctx)
         FF_HW_SIMPLE_CALL(avctx, flush);
 }
 
+/* start over with a new stream, see avcodec_reset_decoder() */
+static av_cold int hevc_decode_reset(AVCodecContext *avctx)
+{
+    HEVCContext *s = avctx->priv_data;
+
+    ff_hevc_ps_uninit(&s->ps);
+    s->is_nalff        = 0;
+    s->nal_length_size = 0;
+    memset(&s->dovi_ctx.cfg, 0, sizeof(s->dovi_ctx.cfg));
+
+    return hevc_init_extradata(avctx);
+}
+
 #define OFFSET(x) offsetof(HEVCContext, x)
 #define PAR (AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_VIDEO_PARAM)
 
 static const AVOption options[] = {
     { "apply_defdispwin", "Apply default display window from VUI", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
+    { "wpp_threads", "Number of worker threads decoding WPP rows, combinable with frame threading",
+        OFFSET(wpp_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, PAR },
+    { "filter_threads", "Number of worker threads running deblocking and SAO behind CTU reconstruction",
+        OFFSET(filter_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, PAR },
     { "strict-displaywin", "strictly apply default display window size", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
     { "view_ids", "Array of view IDs that should be decoded and output; a single -1 to decode all views",
@@ -4242,6 +4550,7 @@ const FFCodec ff_hevc_decoder = {
     .close                 = hevc_decode_free,
     FF_CODEC_RECEIVE_FRAME_CB(hevc_receive_frame),
     .flush                 = hevc_decode_flush,
+    .reset                 = hevc_decode_reset,
     UPDATE_THREAD_CONTEXT(hevc_update_thread_context),
     .p.capabilities        = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                              AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS,
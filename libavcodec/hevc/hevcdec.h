@@ -34,6 +34,7 @@
 #include "libavcodec/dovi_rpu.h"
 #include "libavcodec/h2645_parse.h"
 #include "libavcodec/progressframe.h"
+#include "libavcodec/threadprogress.h"
 #include "libavcodec/videodsp.h"
 
 #include "dsp.h"
@@ -548,6 +549,33 @@ typedef struct HEVCContext {
 
     atomic_int wpp_err;
 
+    /**
+     * Worker pool decoding the WPP substreams of a slice, if wpp_threads
+     * is set; usable together with frame threading.
+     */
+    struct FFExecutor  *executor;
+    struct HEVCRowTask *wpp_tasks;
+    unsigned         nb_wpp_tasks;
+    atomic_int          wpp_rows_left;
+    ThreadProgress      wpp_done;
+
+    /**
+     * Worker pool running deblocking and SAO of the current picture row by
+     * row behind reconstruction, if filter_threads is set.
+     * rec_progress and filter_progress count the reconstructed and filtered
+     * CTBs of each CTB row.
+     */
+    struct FFExecutor     *filter_executor;
+    struct HEVCFilterTask *filter_tasks;
+    unsigned            nb_filter_tasks;
+    ThreadProgress        *rec_progress;
+    unsigned            nb_rec_progress;
+    ThreadProgress        *filter_progress;
+    unsigned            nb_filter_progress;
+    atomic_int             filter_rows_left;
+    ThreadProgress         filter_done;
+    int                    filter_active;
+
     const uint8_t *data;
 
     H2645Packet pkt;
@@ -560,6 +588,8 @@ typedef struct HEVCContext {
     int is_nalff;           ///< this flag is != 0 if bitstream is encapsulated
                             ///< as a format defined in 14496-15
     int apply_defdispwin;
+    int wpp_threads;
+    int filter_threads;
 
     // multi-layer AVOptions
     int         *view_ids;
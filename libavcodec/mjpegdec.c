@@ -30,6 +30,8 @@
  * MJPEG decoder.
  */
 
+#include <stdatomic.h>
+
 #include "config_components.h"
 
 #include "libavutil/attributes.h"
@@ -54,6 +56,7 @@
 #include "jpeglsdec.h"
 #include "profiles.h"
 #include "put_bits.h"
+#include "thread.h"
 
 
 static int init_default_huffman_tables(MJpegDecodeContext *s)
@@ -756,7 +759,7 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
         }
 
         av_frame_unref(s->picture_ptr);
-        if (ff_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
+        if (ff_thread_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
             return -1;
         s->picture_ptr->pict_type = AV_PICTURE_TYPE_I;
         s->picture_ptr->flags |= AV_FRAME_FLAG_KEY;
@@ -800,56 +803,56 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
         memset(s->coefs_finished, 0, sizeof(s->coefs_finished));
     }
 
+    /* the hwaccel frame is started at the first scan, once all the tables
+     * it uses are known */
     if (s->avctx->hwaccel) {
         const FFHWAccel *hwaccel = ffhwaccel(s->avctx->hwaccel);
+
         s->hwaccel_picture_private =
             av_mallocz(hwaccel->frame_priv_data_size);
         if (!s->hwaccel_picture_private)
             return AVERROR(ENOMEM);
-
-        ret = hwaccel->start_frame(s->avctx, NULL, s->raw_image_buffer,
-                                   s->raw_image_buffer_size);
-        if (ret < 0)
-            return ret;
     }
 
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index, int *val)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index, int *val)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_ERROR,
                "mjpeg_decode_dc: bad vlc: %d\n", dc_index);
         return AVERROR_INVALIDDATA;
     }
 
-    *val = code ? get_xbits(&s->gb, code) : 0;
+    *val = code ? get_xbits(gb, code) : 0;
     return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb, int *last_dc,
+                        int16_t *block, int component,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    int ret = mjpeg_decode_dc(s, dc_index, &val);
+    int ret = mjpeg_decode_dc(s, gb, dc_index, &val);
     if (ret < 0)
         return ret;
 
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
-    s->last_dc[component] = val;
+    val = val * (unsigned)quant_matrix[0] + last_dc[component];
+    last_dc[component] = val;
     block[0] = av_clip_int16(val);
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
@@ -858,12 +861,12 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             // So we have at least MIN_CACHE_BITS - 9 > 15 bits left here
             // and don't need to refill the cache.
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -873,7 +876,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -884,7 +887,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    int ret = mjpeg_decode_dc(s, dc_index, &val);
+    int ret = mjpeg_decode_dc(s, &s->gb, dc_index, &val);
     if (ret < 0)
         return ret;
 
@@ -1177,7 +1180,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                ret = mjpeg_decode_dc(s, s->dc_index[i], &dc);
+                ret = mjpeg_decode_dc(s, &s->gb, s->dc_index[i], &dc);
                 if (ret < 0)
                     return ret;
 
@@ -1312,7 +1315,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        ret = mjpeg_decode_dc(s, s->dc_index[i], &dc);
+                        ret = mjpeg_decode_dc(s, &s->gb, s->dc_index[i], &dc);
                         if (ret < 0)
                             return ret;
 
@@ -1384,7 +1387,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        ret = mjpeg_decode_dc(s, s->dc_index[i], &dc);
+                        ret = mjpeg_decode_dc(s, &s->gb, s->dc_index[i], &dc);
                         if (ret < 0)
                             return ret;
 
@@ -1454,6 +1457,139 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+typedef struct ScanSliceArgs {
+    uint8_t *data[MAX_COMPONENTS];
+    int linesize[MAX_COMPONENTS];
+    int nb_components;
+    int chroma_width, chroma_height;
+    int scan_start;         ///< offset of the first interval in the unescaped data
+    int scan_end;           ///< size of the unescaped data
+    int nb_intervals;
+    int nb_jobs;
+    int end_bits;           ///< bit position after the last interval
+    atomic_int error;
+} ScanSliceArgs;
+
+/**
+ * Decode a range of restart intervals of a sequential scan. The DC predictors
+ * are reset at each restart marker, so the ranges are independent and can be
+ * decoded by different threads.
+ */
+static int decode_scan_slice(AVCodecContext *avctx, void *arg,
+                             int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    ScanSliceArgs   *sa = arg;
+    const int bytes_per_pixel = 1 + (s->bits > 8);
+    const int nb_mbs = s->mb_width * s->mb_height;
+    const int first  = (int64_t)sa->nb_intervals *  jobnr      / sa->nb_jobs;
+    const int last   = (int64_t)sa->nb_intervals * (jobnr + 1) / sa->nb_jobs;
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+    int last_dc[MAX_COMPONENTS];
+    GetBitContext gb;
+    int start = 0, ret;
+
+    for (int n = first; n < last; n++) {
+        const int end    = n < sa->nb_intervals - 1 ? s->restart_offsets[n] : sa->scan_end;
+        const int mb_end = FFMIN((n + 1) * s->restart_interval, nb_mbs);
+
+        start = n ? s->restart_offsets[n - 1] + 2 : sa->scan_start;
+        ret   = init_get_bits8(&gb, s->gb.buffer + start, end - start);
+        if (ret < 0)
+            goto fail;
+
+        for (int i = 0; i < sa->nb_components; i++)
+            last_dc[i] = 4 << s->bits;
+
+        for (int mb = n * s->restart_interval; mb < mb_end; mb++) {
+            const int mb_x = mb % s->mb_width;
+            const int mb_y = mb / s->mb_width;
+
+            if (get_bits_left(&gb) < 0) {
+                av_log(avctx, AV_LOG_ERROR, "overread %d\n", -get_bits_left(&gb));
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+            for (int i = 0; i < sa->nb_components; i++) {
+                const int c = s->comp_index[i];
+                const int h = s->h_scount[i];
+                const int v = s->v_scount[i];
+                const int width  = c == 1 || c == 2 ? sa->chroma_width  : s->width;
+                const int height = c == 1 || c == 2 ? sa->chroma_height : s->height;
+                int x = 0, y = 0;
+
+                for (int j = 0; j < s->nb_blocks[i]; j++) {
+                    s->bdsp.clear_block(block);
+                    if (decode_block(s, &gb, last_dc, block, i,
+                                     s->dc_index[i], s->ac_index[i],
+                                     s->quant_matrixes[s->quant_sindex[i]]) < 0) {
+                        av_log(avctx, AV_LOG_ERROR,
+                               "error y=%d x=%d\n", mb_y, mb_x);
+                        ret = AVERROR_INVALIDDATA;
+                        goto fail;
+                    }
+                    if (8 * (h * mb_x + x) < width  &&
+                        8 * (v * mb_y + y) < height && sa->linesize[c]) {
+                        int block_offset = (((sa->linesize[c] * (v * mb_y + y) * 8) +
+                                             (h * mb_x + x) * 8 * bytes_per_pixel) >> avctx->lowres);
+                        uint8_t *ptr = sa->data[c] + block_offset;
+
+                        s->idsp.idct_put(ptr, sa->linesize[c], block);
+                        if (s->bits & 7)
+                            shift_output(s, ptr, sa->linesize[c]);
+                    }
+                    if (++x == h) {
+                        x = 0;
+                        y++;
+                    }
+                }
+            }
+        }
+    }
+
+    if (last == sa->nb_intervals)
+        sa->end_bits = start * 8 + get_bits_count(&gb);
+    emms_c();
+    return 0;
+fail:
+    atomic_store(&sa->error, ret);
+    emms_c();
+    return ret;
+}
+
+static int mjpeg_decode_scan_threaded(MJpegDecodeContext *s, int nb_components,
+                                      int nb_intervals, uint8_t *const data[],
+                                      const int linesize[],
+                                      int chroma_width, int chroma_height)
+{
+    ScanSliceArgs sa = {
+        .nb_components = nb_components,
+        .chroma_width  = chroma_width,
+        .chroma_height = chroma_height,
+        .scan_start    = get_bits_count(&s->gb) >> 3,
+        .scan_end      = (get_bits_count(&s->gb) + get_bits_left(&s->gb)) >> 3,
+        .nb_intervals  = nb_intervals,
+        .nb_jobs       = FFMIN(nb_intervals, s->avctx->thread_count),
+        .error         = 0,
+    };
+    int ret;
+
+    for (int i = 0; i < nb_components; i++) {
+        int c = s->comp_index[i];
+        sa.data[c]     = data[c];
+        sa.linesize[c] = linesize[c];
+    }
+
+    s->avctx->execute2(s->avctx, decode_scan_slice, &sa, NULL, sa.nb_jobs);
+
+    ret = atomic_load(&sa.error);
+    if (ret < 0)
+        return ret;
+
+    skip_bits_long(&s->gb, sa.end_bits - get_bits_count(&s->gb));
+    return 0;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
@@ -1489,6 +1625,20 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->coefs_finished[c] |= 1;
     }
 
+    /* Restart intervals of sequential scans can be decoded in parallel when
+     * all their markers were found while unescaping the scan. */
+    if (!mb_bitmask && !s->progressive && !s->interlaced && s->restart_interval &&
+        (s->avctx->active_thread_type & FF_THREAD_SLICE) &&
+        !(get_bits_count(&s->gb) & 7)) {
+        int nb_intervals = (s->mb_width * s->mb_height + s->restart_interval - 1) /
+                           s->restart_interval;
+        if (nb_intervals > 1 && s->nb_restart_offsets == nb_intervals - 1 &&
+            s->restart_offsets[0] >= get_bits_count(&s->gb) >> 3)
+            return mjpeg_decode_scan_threaded(s, nb_components, nb_intervals,
+                                              data, linesize,
+                                              chroma_width, chroma_height);
+    }
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1530,7 +1680,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
 
                         } else {
                             s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
+                            if (decode_block(s, &s->gb, s->last_dc, s->block, i,
                                              s->dc_index[i], s->ac_index[i],
                                              s->quant_matrixes[s->quant_sindex[i]]) < 0) {
                                 av_log(s->avctx, AV_LOG_ERROR,
@@ -2215,6 +2365,21 @@ found:
     return val;
 }
 
+/**
+ * Check whether only restart markers and EOI are left in the packet, in
+ * which case the scan starting at buf_ptr is the last one of the picture.
+ */
+static int is_last_scan(const uint8_t *buf_ptr, const uint8_t *buf_end)
+{
+    while (1) {
+        int start_code = find_marker(&buf_ptr, buf_end);
+        if (start_code < 0 || start_code == EOI)
+            return 1;
+        if (start_code < RST0 || start_code > RST7)
+            return 0;
+    }
+}
+
 int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                          const uint8_t **buf_ptr, const uint8_t *buf_end,
                          const uint8_t **unescaped_buf_ptr,
@@ -2242,9 +2407,12 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
             }                                         \
         } while (0)
 
+        s->nb_restart_offsets = 0;
+
         if (s->avctx->codec_id == AV_CODEC_ID_THP) {
             ptr = buf_end;
             copy_data_segment(0);
+            s->nb_restart_offsets = -1;
         } else {
             while (ptr < buf_end) {
                 uint8_t x = *(ptr++);
@@ -2270,6 +2438,18 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (s->nb_restart_offsets >= 0) {
+                        /* the marker is kept in the unescaped data, preceded
+                         * by a single 0xFF whatever the number of fill bytes;
+                         * remember where it starts */
+                        int *offsets = av_fast_realloc(s->restart_offsets,
+                                                       &s->restart_offsets_size,
+                                                       (s->nb_restart_offsets + 1) * sizeof(*offsets));
+                        if (offsets) {
+                            s->restart_offsets = offsets;
+                            offsets[s->nb_restart_offsets++] = (dst - s->buffer) + (ptr - src) - 2;
+                        } else
+                            s->nb_restart_offsets = -1;
                     }
                 }
             }
@@ -2559,6 +2739,31 @@ eoi_parser:
 
             s->cur_scan++;
 
+            /* Nothing the next picture depends on can change after the last
+             * scan, so let the next frame thread start decoding. Field pairs
+             * may be split across packets, so interlaced pictures are always
+             * decoded completely first. */
+            if ((avctx->active_thread_type & FF_THREAD_FRAME) &&
+                !avctx->hwaccel && !s->interlaced && !s->ls &&
+                is_last_scan(buf_ptr, buf_end))
+                ff_thread_finish_setup(avctx);
+
+            /* DQT and DHT segments may still follow the SOF, so the next
+             * frame thread can only copy the tables and the hwaccel frame
+             * can only be started at the first scan. No hwaccel calls may
+             * happen before the setup is finished, so with a hwaccel it is
+             * finished here for interlaced pictures too, at the first field;
+             * see update_thread_context(). */
+            if (avctx->hwaccel && s->got_picture && s->cur_scan == 1) {
+                if (!s->interlaced || s->bottom_field == s->interlace_polarity)
+                    ff_thread_finish_setup(avctx);
+
+                ret = FF_HW_CALL(avctx, start_frame, NULL,
+                                 s->raw_image_buffer, s->raw_image_buffer_size);
+                if (ret < 0)
+                    return ret;
+            }
+
             if ((ret = ff_mjpeg_decode_sos(s, NULL, 0, NULL)) < 0 &&
                 (avctx->err_recognition & AV_EF_EXPLODE))
                 goto fail;
@@ -2891,6 +3096,7 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->restart_offsets);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -2913,6 +3119,98 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     return 0;
 }
 
+#if HAVE_THREADS
+static int update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    MJpegDecodeContext *sdst = dst->priv_data;
+    const MJpegDecodeContext *ssrc = src->priv_data;
+    const AVPixFmtDescriptor *desc;
+    int ret;
+
+    if (dst == src)
+        return 0;
+
+    memcpy(sdst->quant_matrixes, ssrc->quant_matrixes, sizeof(sdst->quant_matrixes));
+    memcpy(sdst->qscale,         ssrc->qscale,         sizeof(sdst->qscale));
+
+    for (int class = 0; class < 2; class++) {
+        for (int index = 0; index < 4; index++) {
+            uint8_t bits_table[17] = { 0 };
+
+            if (!memcmp(sdst->raw_huffman_lengths[class][index],
+                        ssrc->raw_huffman_lengths[class][index], 16) &&
+                !memcmp(sdst->raw_huffman_values[class][index],
+                        ssrc->raw_huffman_values[class][index], 256))
+                continue;
+
+            memcpy(sdst->raw_huffman_lengths[class][index],
+                   ssrc->raw_huffman_lengths[class][index], 16);
+            memcpy(sdst->raw_huffman_values[class][index],
+                   ssrc->raw_huffman_values[class][index], 256);
+            memcpy(bits_table + 1, ssrc->raw_huffman_lengths[class][index], 16);
+
+            ff_vlc_free(&sdst->vlcs[class][index]);
+            ret = ff_mjpeg_build_vlc(&sdst->vlcs[class][index], bits_table,
+                                     sdst->raw_huffman_values[class][index],
+                                     class > 0, dst);
+            if (ret < 0)
+                return ret;
+            if (class > 0) {
+                ff_vlc_free(&sdst->vlcs[2][index]);
+                ret = ff_mjpeg_build_vlc(&sdst->vlcs[2][index], bits_table,
+                                         sdst->raw_huffman_values[class][index],
+                                         0, dst);
+                if (ret < 0)
+                    return ret;
+            }
+        }
+    }
+
+    sdst->first_picture      = ssrc->first_picture;
+    sdst->width              = ssrc->width;
+    sdst->height             = ssrc->height;
+    sdst->bits               = ssrc->bits;
+    sdst->nb_components      = ssrc->nb_components;
+    memcpy(sdst->h_count, ssrc->h_count, sizeof(sdst->h_count));
+    memcpy(sdst->v_count, ssrc->v_count, sizeof(sdst->v_count));
+    sdst->interlaced         = ssrc->interlaced;
+    sdst->interlace_polarity = ssrc->interlace_polarity;
+    sdst->buggy_avid         = ssrc->buggy_avid;
+    sdst->cs_itu601          = ssrc->cs_itu601;
+    sdst->multiscope         = ssrc->multiscope;
+    sdst->pegasus_rct        = ssrc->pegasus_rct;
+    sdst->rct                = ssrc->rct;
+    sdst->colr               = ssrc->colr;
+    sdst->xfrm               = ssrc->xfrm;
+    sdst->hwaccel_pix_fmt    = ssrc->hwaccel_pix_fmt;
+    sdst->hwaccel_sw_pix_fmt = ssrc->hwaccel_sw_pix_fmt;
+
+    sdst->got_picture = 0;
+
+    /* With a hwaccel, the setup is finished at the first field, while the
+     * field state is still changing, so the next packet has to start a new
+     * picture: field pairs cannot be split across packets then. */
+    desc = av_pix_fmt_desc_get(ssrc->hwaccel_pix_fmt);
+    if (desc && desc->flags & AV_PIX_FMT_FLAG_HWACCEL) {
+        sdst->bottom_field = ssrc->interlace_polarity;
+        return 0;
+    }
+
+    /* the second field of an interlaced picture may be in the next packet */
+    sdst->bottom_field = ssrc->bottom_field;
+    if (ssrc->interlaced && ssrc->got_picture) {
+        ret = av_frame_replace(sdst->picture_ptr, ssrc->picture_ptr);
+        if (ret < 0)
+            return ret;
+        memcpy(sdst->linesize, ssrc->linesize, sizeof(sdst->linesize));
+        sdst->pix_desc    = ssrc->pix_desc;
+        sdst->got_picture = 1;
+    }
+
+    return 0;
+}
+#endif
+
 static av_cold void decode_flush(AVCodecContext *avctx)
 {
     MJpegDecodeContext *s = avctx->priv_data;
@@ -2947,8 +3245,10 @@ const FFCodec ff_mjpeg_decoder = {
     .init           = ff_mjpeg_decode_init,
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_DECODE_CB(ff_mjpeg_decode_frame),
+    UPDATE_THREAD_CONTEXT(update_thread_context),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS |
+                      AV_CODEC_CAP_FRAME_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -124,6 +124,9 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *restart_offsets;       ///< offsets of the RSTn markers in the unescaped scan data
+    unsigned int restart_offsets_size;
+    int nb_restart_offsets;     ///< number of RSTn markers in the current scan, -1 if unknown
 
     int buggy_avid;
     int cs_itu601;
@@ -59,6 +59,8 @@
 #include "mpegvideodec.h"
 #include "profiles.h"
 #include "startcode.h"
+#include "thread.h"
+#include "threadprogress.h"
 
 #define A53_MAX_CC_COUNT 2000
 
@@ -99,6 +101,12 @@ typedef struct Mpeg1Context {
     int vbv_delay;
     int64_t bit_rate;
     int64_t timecode_frame_start;  /*< GOP timecode frame start number, in non drop frame format */
+
+    /* frame threading */
+    int setup_finished;         /* ff_thread_finish_setup() was called for this packet */
+    int64_t timecode_next;      /* timecode_frame_start as seen by the next thread */
+    int progress_mb;            /* first MB after the error-free area at the top of
+                                 * the picture, -1 if rows are not reported */
 } Mpeg1Context;
 
 /* as H.263, but only 17 codes */
@@ -856,6 +864,17 @@ static enum AVPixelFormat mpeg_get_pixelformat(AVCodecContext *avctx)
     return ff_get_format(avctx, pix_fmts);
 }
 
+static av_cold int mpeg_common_init(MPVContext *const s)
+{
+    int ret = ff_mpv_common_init(s);
+    if (ret < 0)
+        return ret;
+    if (!s->avctx->lowres)
+        for (int i = 0; i < s->slice_context_count; i++)
+            ff_mpv_framesize_disable(&s->thread_context[i]->sc);
+    return 0;
+}
+
 /* Call this function when we know all parameters.
  * It may be called in different places for MPEG-1 and MPEG-2. */
 static int mpeg_decode_postinit(AVCodecContext *avctx)
@@ -964,11 +983,9 @@ static int mpeg_decode_postinit(AVCodecContext *avctx)
 
         avctx->pix_fmt = mpeg_get_pixelformat(avctx);
 
-        if ((ret = ff_mpv_common_init(s)) < 0)
+        ret = mpeg_common_init(s);
+        if (ret < 0)
             return ret;
-        if (!s->avctx->lowres)
-            for (int i = 0; i < s->slice_context_count; i++)
-                ff_mpv_framesize_disable(&s->thread_context[i]->sc);
     }
     return 0;
 }
@@ -1236,6 +1253,12 @@ static int mpeg_field_start(Mpeg1Context *s1, const uint8_t *buf, int buf_size)
     if (s->first_field || s->picture_structure == PICT_FRAME) {
         AVFrameSideData *pan_scan;
 
+        /* With frame threading, the current picture can only be a first
+         * field that will not be completed anymore. */
+        if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME) &&
+            s->cur_pic.ptr)
+            ff_thread_progress_report(&s->cur_pic.ptr->progress, INT_MAX);
+
         if ((ret = ff_mpv_frame_start(s, avctx)) < 0)
             return ret;
 
@@ -1343,6 +1366,27 @@ static int mpeg_field_start(Mpeg1Context *s1, const uint8_t *buf, int buf_size)
         }
     }
 
+    if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME)) {
+        /* Rows are only reported early for 4:2:0, the layout error
+         * concealment was written for; with another chroma format, the
+         * picture is reported once complete unless concealment is off. */
+        s1->progress_mb = s->picture_structure == PICT_FRAME &&
+                          s->cur_pic.reference && !avctx->hwaccel &&
+                          (s->chroma_format == CHROMA_420 ||
+                           !avctx->error_concealment) ? 0 : -1;
+
+        if (s->picture_structure == PICT_FRAME || second_field) {
+            /* The picture is complete once this packet is decoded, so it is
+             * known whether it outputs a frame and consumes the timecode. */
+            int output = s->pict_type == AV_PICTURE_TYPE_B || s->low_delay ||
+                         (s->last_pic.ptr && !s->last_pic.ptr->dummy);
+
+            s1->timecode_next  = output ? -1 : s1->timecode_frame_start;
+            s1->setup_finished = 1;
+            ff_thread_finish_setup(avctx);
+        }
+    }
+
     return 0;
 }
 
@@ -1631,6 +1675,30 @@ eos: // end of slice
     return 0;
 }
 
+/**
+ * Report the rows of a reference frame picture that later pictures can use
+ * with frame threading. Only the error-free area at the top of the picture
+ * is reported, and a row only once the row below it is decoded too, as error
+ * concealment may still filter across the edge of a damaged row.
+ */
+static void mpeg_report_progress(Mpeg1Context *s1, int slice_ret)
+{
+    MPVContext *const s = &s1->slice.c;
+
+    if (s1->progress_mb < 0)
+        return;
+    if (slice_ret < 0 ||
+        s->resync_mb_y * s->mb_width + s->resync_mb_x != s1->progress_mb) {
+        s1->progress_mb = -1;
+        return;
+    }
+
+    s1->progress_mb = s->mb_y * s->mb_width + s->mb_x;
+    if (s1->progress_mb >= 2 * s->mb_width)
+        ff_thread_progress_report(&s->cur_pic.ptr->progress,
+                                  s1->progress_mb / s->mb_width - 2);
+}
+
 static int slice_decode_thread(AVCodecContext *c, void *arg)
 {
     Mpeg12SliceContext *const s = *(void **) arg;
@@ -1720,7 +1788,13 @@ static int slice_end(AVCodecContext *avctx, AVFrame *pict, int *got_output)
         } else {
             /* latency of 1 frame for I- and P-frames */
             if (s->last_pic.ptr && !s->last_pic.ptr->dummy) {
-                int ret = av_frame_ref(pict, s->last_pic.ptr->f);
+                int ret;
+
+                /* Its error concealment may still be running in another thread. */
+                if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME))
+                    ff_thread_progress_await(&s->last_pic.ptr->progress, INT_MAX);
+
+                ret = av_frame_ref(pict, s->last_pic.ptr->f);
                 if (ret < 0)
                     return ret;
                 ff_print_debug_info(s, s->last_pic.ptr, pict);
@@ -1842,11 +1916,8 @@ static int vcr2_init_sequence(AVCodecContext *avctx)
 
     avctx->pix_fmt = mpeg_get_pixelformat(avctx);
 
-    if ((ret = ff_mpv_common_init(s)) < 0)
+    if ((ret = mpeg_common_init(s)) < 0)
         return ret;
-    if (!s->avctx->lowres)
-        for (int i = 0; i < s->slice_context_count; i++)
-            ff_mpv_framesize_disable(&s->thread_context[i]->sc);
 
     for (i = 0; i < 64; i++) {
         int j = s->idsp.idct_permutation[i];
@@ -2267,6 +2338,12 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
             av_log(avctx, AV_LOG_DEBUG, "%3"PRIX32" at %"PTRDIFF_SPECIFIER" left %d\n",
                    start_code, buf_ptr - buf, input_size);
 
+        /* Once the setup is finished, the next frame thread may read the
+         * headers at any time, so they must not change anymore. */
+        if (s->setup_finished &&
+            (start_code == EXT_START_CODE || start_code == USER_START_CODE))
+            continue;
+
         /* prepare data for next start code */
         switch (start_code) {
         case SEQ_START_CODE:
@@ -2289,6 +2366,11 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
                av_log(avctx, AV_LOG_WARNING, "ignoring extra picture following a frame-picture\n");
                break;
             }
+            if (s->setup_finished) {
+               /* The next frame thread has already taken over. */
+               av_log(avctx, AV_LOG_WARNING, "ignoring extra picture following a field pair\n");
+               break;
+            }
             picture_start_code_seen = 1;
 
             if (buf == avctx->extradata && avctx->codec_tag == AV_RL32("AVmp")) {
@@ -2453,7 +2535,8 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
                         }
                     }
                 }
-                if (s2->pict_type == AV_PICTURE_TYPE_I || (s2->avctx->flags2 & AV_CODEC_FLAG2_SHOW_ALL))
+                if (!s->sync && (s2->pict_type == AV_PICTURE_TYPE_I ||
+                                 (s2->avctx->flags2 & AV_CODEC_FLAG2_SHOW_ALL)))
                     s->sync = 1;
                 if (!s2->next_pic.ptr) {
                     /* Skip P-frames if we do not have a reference frame or
@@ -2541,6 +2624,8 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
                                         s2->resync_mb_y, s2->mb_x - 1, s2->mb_y,
                                         ER_AC_END | ER_DC_END | ER_MV_END);
                     }
+                    if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME))
+                        mpeg_report_progress(s, ret);
                 }
             }
             break;
@@ -2557,10 +2642,20 @@ static int mpeg_decode_frame(AVCodecContext *avctx, AVFrame *picture,
     Mpeg1Context *s = avctx->priv_data;
     MPVContext *const s2 = &s->slice.c;
 
+    s->setup_finished = 0;
+
     if (buf_size == 0 || (buf_size == 4 && AV_RB32(buf) == SEQ_END_CODE)) {
         /* special case for last picture */
         if (s2->low_delay == 0 && s2->next_pic.ptr) {
-            int ret = av_frame_ref(picture, s2->next_pic.ptr->f);
+            int ret;
+
+            /* Its error concealment may still be running in another thread,
+             * unless it is a first field left to this one. */
+            if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME) &&
+                s2->next_pic.ptr != s2->cur_pic.ptr)
+                ff_thread_progress_await(&s2->next_pic.ptr->progress, INT_MAX);
+
+            ret = av_frame_ref(picture, s2->next_pic.ptr->f);
             if (ret < 0)
                 return ret;
 
@@ -2593,8 +2688,18 @@ static int mpeg_decode_frame(AVCodecContext *avctx, AVFrame *picture,
     }
 
     ret = decode_chunks(avctx, picture, got_output, buf, buf_size);
+
+    /* Unless it is a first field, the current picture is either complete
+     * or will not be continued; only a first field is kept for the next
+     * frame thread. */
+    if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME) &&
+        s2->cur_pic.ptr && !s2->first_field)
+        ff_thread_progress_report(&s2->cur_pic.ptr->progress, INT_MAX);
+
     if (ret<0 || *got_output) {
-        ff_mpv_unref_picture(&s2->cur_pic);
+        /* The next frame thread may still be copying it. */
+        if (!s->setup_finished)
+            ff_mpv_unref_picture(&s2->cur_pic);
 
         if (s->timecode_frame_start != -1 && *got_output) {
             char tcbuf[AV_TIMECODE_STR_SIZE];
@@ -2615,6 +2720,73 @@ static int mpeg_decode_frame(AVCodecContext *avctx, AVFrame *picture,
     return ret;
 }
 
+#if HAVE_THREADS
+static int mpeg_decode_update_thread_context(AVCodecContext *dst,
+                                             const AVCodecContext *src)
+{
+    Mpeg1Context *const s = dst->priv_data;
+    const Mpeg1Context *const s1 = src->priv_data;
+    MPVContext *const m = &s->slice.c;
+    const MPVContext *const m1 = &s1->slice.c;
+    int ret;
+
+    if (dst == src || !m1->context_initialized)
+        return 0;
+
+    if (!m->context_initialized         ||
+        m->width  != m1->width          ||
+        m->height != m1->height         ||
+        m->mb_height != m1->mb_height   ||
+        s->save_chroma_format != s1->save_chroma_format) {
+        if (m->context_initialized)
+            ff_mpv_common_end(m);
+
+        m->width                = m1->width;
+        m->height               = m1->height;
+        m->codec_id             = m1->codec_id;
+        m->progressive_sequence = m1->progressive_sequence;
+        m->chroma_format        = m1->chroma_format;
+
+        ret = mpeg_common_init(m);
+        if (ret < 0)
+            return ret;
+    }
+
+    ret = ff_mpeg_update_thread_context(dst, src);
+    if (ret < 0)
+        return ret;
+
+    /* Only a first field is continued by this thread, any other current
+     * picture belongs to the source thread. */
+    if (!m->first_field)
+        ff_mpv_unref_picture(&m->cur_pic);
+
+    memcpy(m->intra_matrix,        m1->intra_matrix,        sizeof(m->intra_matrix));
+    memcpy(m->chroma_intra_matrix, m1->chroma_intra_matrix, sizeof(m->chroma_intra_matrix));
+    memcpy(m->inter_matrix,        m1->inter_matrix,        sizeof(m->inter_matrix));
+    memcpy(m->chroma_inter_matrix, m1->chroma_inter_matrix, sizeof(m->chroma_inter_matrix));
+    m->codec_id = dst->codec_id = m1->codec_id;
+
+    s->pan_scan             = s1->pan_scan;
+    s->aspect_ratio_info    = s1->aspect_ratio_info;
+    s->save_progressive_seq = s1->save_progressive_seq;
+    s->save_chroma_format   = s1->save_chroma_format;
+    s->frame_rate_ext       = s1->frame_rate_ext;
+    s->frame_rate_index     = s1->frame_rate_index;
+    s->sync                 = s1->sync;
+    s->closed_gop           = s1->closed_gop;
+    s->tmpgexs              = s1->tmpgexs;
+    s->cc_format            = s1->cc_format;
+    s->extradata_decoded    = s1->extradata_decoded;
+    s->vbv_delay            = s1->vbv_delay;
+    s->bit_rate             = s1->bit_rate;
+    s->timecode_frame_start = s1->setup_finished ? s1->timecode_next :
+                                                   s1->timecode_frame_start;
+
+    return 0;
+}
+#endif
+
 static av_cold void flush(AVCodecContext *avctx)
 {
     Mpeg1Context *s = avctx->priv_data;
@@ -2626,6 +2798,22 @@ static av_cold void flush(AVCodecContext *avctx)
     ff_mpeg_flush(avctx);
 }
 
+/* start over with a new stream, see avcodec_reset_decoder() */
+static av_cold int mpeg_reset(AVCodecContext *avctx)
+{
+    Mpeg1Context *s = avctx->priv_data;
+    MPVContext *const s2 = &s->slice.c;
+
+    /* As in mpeg_decode_init(), do not trust dimensions from input;
+     * the next sequence header reinitializes the context if needed. */
+    if (s2->context_initialized)
+        ff_set_dimensions(avctx, s2->width, s2->height);
+
+    s->extradata_decoded    = 0;
+    s->timecode_frame_start = 0;
+    return 0;
+}
+
 static av_cold int mpeg_decode_end(AVCodecContext *avctx)
 {
     Mpeg1Context *s = avctx->priv_data;
@@ -2644,9 +2832,12 @@ const FFCodec ff_mpeg1video_decoder = {
     .close                 = mpeg_decode_end,
     FF_CODEC_DECODE_CB(mpeg_decode_frame),
     .p.capabilities        = AV_CODEC_CAP_DRAW_HORIZ_BAND | AV_CODEC_CAP_DR1 |
-                             AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
+                             AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                             AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal         = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
     .flush                 = flush,
+    .reset                 = mpeg_reset,
+    UPDATE_THREAD_CONTEXT(mpeg_decode_update_thread_context),
     .p.max_lowres          = 3,
     .hw_configs            = (const AVCodecHWConfigInternal *const []) {
 #if CONFIG_MPEG1_NVDEC_HWACCEL
@@ -2702,9 +2893,12 @@ const FFCodec ff_mpeg2video_decoder = {
     .close          = mpeg_decode_end,
     FF_CODEC_DECODE_CB(mpeg_decode_frame),
     .p.capabilities = AV_CODEC_CAP_DRAW_HORIZ_BAND | AV_CODEC_CAP_DR1 |
-                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
+                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                      AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal  = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
     .flush          = flush,
+    .reset          = mpeg_reset,
+    UPDATE_THREAD_CONTEXT(mpeg_decode_update_thread_context),
     .p.max_lowres   = 3,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mpeg2_video_profiles),
     .hw_configs     = (const AVCodecHWConfigInternal *const []) {
@@ -2747,9 +2941,12 @@ const FFCodec ff_mpegvideo_decoder = {
     .close          = mpeg_decode_end,
     FF_CODEC_DECODE_CB(mpeg_decode_frame),
     .p.capabilities = AV_CODEC_CAP_DRAW_HORIZ_BAND | AV_CODEC_CAP_DR1 |
-                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
+                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                      AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal  = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
     .flush          = flush,
+    .reset          = mpeg_reset,
+    UPDATE_THREAD_CONTEXT(mpeg_decode_update_thread_context),
     .p.max_lowres   = 3,
 };
 
@@ -269,8 +269,8 @@ typedef struct MpegEncContext {
 
     int progressive_frame;
     int full_pel[2];
-    int interlaced_dct;
     int first_field;         ///< is 1 for the first field of a field picture 0 otherwise
+    int interlaced_dct;      ///< per MB, thus not copied to the next frame thread
 
     void (*dct_unquantize_intra)(struct MpegEncContext *s, // unquantizer to use (MPEG-4 can use both)
                            int16_t *block/*align 16*/, int n, int qscale);
@@ -858,7 +858,7 @@ static inline void MPV_motion_lowres(MpegEncContext *s,
 static int lowest_referenced_row(MpegEncContext *s, int dir)
 {
     int my_max = INT_MIN, my_min = INT_MAX, qpel_shift = !s->quarter_sample;
-    int off, mvs;
+    int off, mvs, field_mvs = 0;
 
     if (s->picture_structure != PICT_FRAME || s->mcsel)
         goto unhandled;
@@ -873,6 +873,11 @@ static int lowest_referenced_row(MpegEncContext *s, int dir)
         case MV_TYPE_8X8:
             mvs = 4;
             break;
+        case MV_TYPE_FIELD:
+            /* vectors in field lines, plus one row for the field parity */
+            mvs       = 2;
+            field_mvs = 1;
+            break;
         default:
             goto unhandled;
     }
@@ -883,7 +888,8 @@ static int lowest_referenced_row(MpegEncContext *s, int dir)
         my_min = FFMIN(my_min, my);
     }
 
-    off = ((FFMAX(-my_min, my_max) << qpel_shift) + 63) >> 6;
+    off = ((FFMAX(-my_min, my_max) << (qpel_shift + field_mvs)) + 63) >> 6;
+    off += field_mvs;
 
     return av_clip(s->mb_y + off, 0, s->mb_height - 1);
 unhandled:
@@ -946,8 +952,7 @@ void mpv_reconstruct_mb_internal(MpegEncContext *s, int16_t block[12][64],
 
     if (!s->mb_intra) {
         /* motion handling */
-        if (HAVE_THREADS && is_mpeg12 != DEFINITELY_MPEG12_H261 &&
-            s->avctx->active_thread_type & FF_THREAD_FRAME) {
+        if (HAVE_THREADS && s->avctx->active_thread_type & FF_THREAD_FRAME) {
             if (s->mv_dir & MV_DIR_FORWARD) {
                 ff_thread_progress_await(&s->last_pic.ptr->progress,
                                          lowest_referenced_row(s, 0));
@@ -207,11 +207,11 @@ static int decode_frame_header(ProresContext *ctx, const uint8_t *buf,
     width  = AV_RB16(buf + 8);
     height = AV_RB16(buf + 10);
 
-    if (width != avctx->width || height != avctx->height) {
+    if (width != avctx->coded_width || height != avctx->coded_height) {
         int ret;
 
         av_log(avctx, AV_LOG_WARNING, "picture resolution change: %dx%d -> %dx%d\n",
-               avctx->width, avctx->height, width, height);
+               avctx->coded_width, avctx->coded_height, width, height);
         if ((ret = ff_set_dimensions(avctx, width, height)) < 0)
             return ret;
     }
@@ -258,12 +258,15 @@ static int decode_frame_header(ProresContext *ctx, const uint8_t *buf,
 
         ctx->pix_fmt = pix_fmt;
 
+        /* hardware decoding does not support lowres */
+        if (!avctx->lowres) {
 #if CONFIG_PRORES_VIDEOTOOLBOX_HWACCEL
-        *fmtp++ = AV_PIX_FMT_VIDEOTOOLBOX;
+            *fmtp++ = AV_PIX_FMT_VIDEOTOOLBOX;
 #endif
 #if CONFIG_PRORES_VULKAN_HWACCEL
-        *fmtp++ = AV_PIX_FMT_VULKAN;
+            *fmtp++ = AV_PIX_FMT_VULKAN;
 #endif
+        }
         *fmtp++ = ctx->pix_fmt;
         *fmtp = AV_PIX_FMT_NONE;
 
@@ -341,11 +344,11 @@ static int decode_picture_header(AVCodecContext *avctx, const uint8_t *buf, cons
     ctx->slice_mb_width  = 1 << log2_slice_mb_width;
     ctx->slice_mb_height = 1 << log2_slice_mb_height;
 
-    ctx->mb_width  = (avctx->width  + 15) >> 4;
+    ctx->mb_width  = (avctx->coded_width  + 15) >> 4;
     if (ctx->frame_type)
-        ctx->mb_height = (avctx->height + 31) >> 5;
+        ctx->mb_height = (avctx->coded_height + 31) >> 5;
     else
-        ctx->mb_height = (avctx->height + 15) >> 4;
+        ctx->mb_height = (avctx->coded_height + 15) >> 4;
 
     // QT ignores the written value
     // slice_count = AV_RB16(buf + 5);
@@ -529,6 +532,50 @@ static av_always_inline int decode_ac_coeffs(AVCodecContext *avctx, GetBitContex
     return 0;
 }
 
+/**
+ * Output a block scaled down by 1 << lowres, averaging the pixels of the
+ * full size block.
+ */
+static av_always_inline void idct_put_lowres(const ProresContext *ctx, uint16_t *dst,
+                                             int dst_stride, int16_t *block,
+                                             const int16_t *qmat, int lowres)
+{
+    LOCAL_ALIGNED_16(uint16_t, pixels, [64]);
+    const int size = 8 >> lowres, shift = 2 * lowres;
+
+    ctx->prodsp.idct_put(pixels, 8 * sizeof(*pixels), block, qmat);
+
+    /* only the DC coefficient was decoded, so the block is flat */
+    if (lowres == 3) {
+        dst[0] = pixels[0];
+        return;
+    }
+
+    for (int y = 0; y < size; y++, dst += dst_stride >> 1) {
+        for (int x = 0; x < size; x++) {
+            const uint16_t *src = pixels + ((y * 8 + x) << lowres);
+            int sum = 0;
+
+            for (int j = 0; j < 1 << lowres; j++)
+                for (int i = 0; i < 1 << lowres; i++)
+                    sum += src[j * 8 + i];
+            dst[x] = (sum + (1 << shift >> 1)) >> shift;
+        }
+    }
+}
+
+static av_always_inline void idct_put(const ProresContext *ctx, uint16_t *dst,
+                                      int dst_stride, int16_t *block,
+                                      const int16_t *qmat, int lowres)
+{
+    switch (lowres) {
+    case 0: ctx->prodsp.idct_put(dst, dst_stride, block, qmat);    break;
+    case 1: idct_put_lowres(ctx, dst, dst_stride, block, qmat, 1); break;
+    case 2: idct_put_lowres(ctx, dst, dst_stride, block, qmat, 2); break;
+    case 3: idct_put_lowres(ctx, dst, dst_stride, block, qmat, 3); break;
+    }
+}
+
 static int decode_slice_luma(AVCodecContext *avctx, SliceContext *slice,
                              uint16_t *dst, int dst_stride,
                              const uint8_t *buf, unsigned buf_size,
@@ -539,6 +586,8 @@ static int decode_slice_luma(AVCodecContext *avctx, SliceContext *slice,
     int16_t *block;
     GetBitContext gb;
     int i, blocks_per_slice = slice->mb_count<<2;
+    const int lowres = avctx->lowres;
+    const int bw = 8 >> lowres, bh = bw * (dst_stride >> 1);
     int ret;
 
     for (i = 0; i < blocks_per_slice; i++)
@@ -548,17 +597,19 @@ static int decode_slice_luma(AVCodecContext *avctx, SliceContext *slice,
 
     if ((ret = decode_dc_coeffs(&gb, blocks, blocks_per_slice)) < 0)
         return ret;
-    if ((ret = decode_ac_coeffs(avctx, &gb, blocks, blocks_per_slice)) < 0)
+    /* at 1/8 size, only the DC coefficients are needed */
+    if (lowres < 3 &&
+        (ret = decode_ac_coeffs(avctx, &gb, blocks, blocks_per_slice)) < 0)
         return ret;
 
     block = blocks;
     for (i = 0; i < slice->mb_count; i++) {
-        ctx->prodsp.idct_put(dst, dst_stride, block+(0<<6), qmat);
-        ctx->prodsp.idct_put(dst             +8, dst_stride, block+(1<<6), qmat);
-        ctx->prodsp.idct_put(dst+4*dst_stride  , dst_stride, block+(2<<6), qmat);
-        ctx->prodsp.idct_put(dst+4*dst_stride+8, dst_stride, block+(3<<6), qmat);
+        idct_put(ctx, dst,         dst_stride, block+(0<<6), qmat, lowres);
+        idct_put(ctx, dst     +bw, dst_stride, block+(1<<6), qmat, lowres);
+        idct_put(ctx, dst+bh,      dst_stride, block+(2<<6), qmat, lowres);
+        idct_put(ctx, dst+bh  +bw, dst_stride, block+(3<<6), qmat, lowres);
         block += 4*64;
-        dst += 16;
+        dst += 2 * bw;
     }
     return 0;
 }
@@ -573,6 +624,8 @@ static int decode_slice_chroma(AVCodecContext *avctx, SliceContext *slice,
     int16_t *block;
     GetBitContext gb;
     int i, j, blocks_per_slice = slice->mb_count << log2_blocks_per_mb;
+    const int lowres = avctx->lowres;
+    const int bw = 8 >> lowres, bh = bw * (dst_stride >> 1);
     int ret;
 
     for (i = 0; i < blocks_per_slice; i++)
@@ -584,17 +637,18 @@ static int decode_slice_chroma(AVCodecContext *avctx, SliceContext *slice,
 
         if ((ret = decode_dc_coeffs(&gb, blocks, blocks_per_slice)) < 0)
             return ret;
-        if ((ret = decode_ac_coeffs(avctx, &gb, blocks, blocks_per_slice)) < 0)
+        if (lowres < 3 &&
+            (ret = decode_ac_coeffs(avctx, &gb, blocks, blocks_per_slice)) < 0)
             return ret;
     }
 
     block = blocks;
     for (i = 0; i < slice->mb_count; i++) {
         for (j = 0; j < log2_blocks_per_mb; j++) {
-            ctx->prodsp.idct_put(dst,              dst_stride, block+(0<<6), qmat);
-            ctx->prodsp.idct_put(dst+4*dst_stride, dst_stride, block+(1<<6), qmat);
+            idct_put(ctx, dst,    dst_stride, block+(0<<6), qmat, lowres);
+            idct_put(ctx, dst+bh, dst_stride, block+(1<<6), qmat, lowres);
             block += 2*64;
-            dst += 8;
+            dst += bw;
         }
     }
     return 0;
@@ -606,7 +660,7 @@ static int decode_slice_chroma(AVCodecContext *avctx, SliceContext *slice,
 static void decode_slice_alpha(const ProresContext *ctx,
                                uint16_t *dst, int dst_stride,
                                const uint8_t *buf, int buf_size,
-                               int blocks_per_slice)
+                               int blocks_per_slice, int lowres)
 {
     GetBitContext gb;
     int i;
@@ -626,10 +680,20 @@ static void decode_slice_alpha(const ProresContext *ctx,
 
     block = blocks;
 
-    for (i = 0; i < 16; i++) {
-        memcpy(dst, block, 16 * blocks_per_slice * sizeof(*dst));
-        dst   += dst_stride >> 1;
-        block += 16 * blocks_per_slice;
+    if (!lowres) {
+        for (i = 0; i < 16; i++) {
+            memcpy(dst, block, 16 * blocks_per_slice * sizeof(*dst));
+            dst   += dst_stride >> 1;
+            block += 16 * blocks_per_slice;
+        }
+    } else {
+        /* the alpha values are not averaged, only subsampled */
+        for (i = 0; i < 16 >> lowres; i++) {
+            for (int x = 0; x < (16 * blocks_per_slice) >> lowres; x++)
+                dst[x] = block[x << lowres];
+            dst   += dst_stride >> 1;
+            block += (16 * blocks_per_slice) << lowres;
+        }
     }
 }
 
@@ -645,7 +709,7 @@ static int decode_slice_thread(AVCodecContext *avctx, void *arg, int jobnr, int
     uint8_t *dest_y, *dest_u, *dest_v;
     LOCAL_ALIGNED_16(int16_t, qmat_luma_scaled,  [64]);
     LOCAL_ALIGNED_16(int16_t, qmat_chroma_scaled,[64]);
-    int mb_x_shift;
+    int mb_x_shift, mb_y_shift = 4 - avctx->lowres;
     int ret;
 
     slice->ret = -1;
@@ -692,11 +756,12 @@ static int decode_slice_thread(AVCodecContext *avctx, void *arg, int jobnr, int
         mb_x_shift = 4;
         log2_chroma_blocks_per_mb = 1;
     }
+    mb_x_shift -= avctx->lowres;
 
-    offset = (slice->mb_y << 4) * luma_stride + (slice->mb_x << 5);
+    offset = (slice->mb_y << mb_y_shift) * luma_stride + (slice->mb_x << (5 - avctx->lowres));
     dest_y = pic->data[0] + offset;
-    dest_u = pic->data[1] + (slice->mb_y << 4) * chroma_stride + (slice->mb_x << mb_x_shift);
-    dest_v = pic->data[2] + (slice->mb_y << 4) * chroma_stride + (slice->mb_x << mb_x_shift);
+    dest_u = pic->data[1] + (slice->mb_y << mb_y_shift) * chroma_stride + (slice->mb_x << mb_x_shift);
+    dest_v = pic->data[2] + (slice->mb_y << mb_y_shift) * chroma_stride + (slice->mb_x << mb_x_shift);
 
     if (ctx->frame_type && ctx->first_field ^ !!(ctx->frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST)) {
         dest_y += pic->linesize[0];
@@ -729,7 +794,7 @@ static int decode_slice_thread(AVCodecContext *avctx, void *arg, int jobnr, int
         uint8_t *dest_a = pic->data[3] + offset;
         decode_slice_alpha(ctx, (uint16_t*)dest_a, luma_stride,
                            buf + y_data_size + u_data_size + v_data_size,
-                           a_data_size, slice->mb_count);
+                           a_data_size, slice->mb_count, avctx->lowres);
     }
 
     slice->ret = 0;
@@ -872,6 +937,7 @@ const FFCodec ff_prores_decoder = {
     UPDATE_THREAD_CONTEXT(update_thread_context),
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal  = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
+    .p.max_lowres   = 3,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_prores_profiles),
 #if HWACCEL_MAX
     .hw_configs     = (const AVCodecHWConfigInternal *const []) {
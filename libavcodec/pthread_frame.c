@@ -999,6 +999,57 @@ av_cold void ff_thread_flush(AVCodecContext *avctx)
     }
 }
 
+av_cold int ff_thread_reset(AVCodecContext *avctx)
+{
+    FrameThreadContext *fctx = avctx->internal->thread_ctx;
+    const FFCodec *codec = ffcodec(avctx->codec);
+
+    if (!fctx)
+        return codec->reset(avctx);
+
+    /* The threads have been parked by ff_thread_flush(). */
+    for (int i = 0; i < avctx->thread_count; i++) {
+        AVCodecContext *dst = fctx->threads[i].avctx;
+        int err;
+
+        /* The thread contexts share these with the user's context,
+         * which may have reallocated them. */
+        dst->extradata          = avctx->extradata;
+        dst->extradata_size     = avctx->extradata_size;
+        dst->coded_side_data    = avctx->coded_side_data;
+        dst->nb_coded_side_data = avctx->nb_coded_side_data;
+
+        dst->codec_tag             = avctx->codec_tag;
+        dst->width                 = avctx->width;
+        dst->height                = avctx->height;
+        dst->coded_width           = avctx->coded_width;
+        dst->coded_height          = avctx->coded_height;
+        dst->pix_fmt               = avctx->pix_fmt;
+        dst->has_b_frames          = avctx->has_b_frames;
+        dst->bits_per_coded_sample = avctx->bits_per_coded_sample;
+        dst->bits_per_raw_sample   = avctx->bits_per_raw_sample;
+        dst->sample_aspect_ratio   = avctx->sample_aspect_ratio;
+        dst->field_order           = avctx->field_order;
+        dst->framerate             = avctx->framerate;
+        dst->profile               = avctx->profile;
+        dst->level                 = avctx->level;
+
+        dst->color_primaries        = avctx->color_primaries;
+        dst->color_trc              = avctx->color_trc;
+        dst->colorspace             = avctx->colorspace;
+        dst->color_range            = avctx->color_range;
+        dst->chroma_sample_location = avctx->chroma_sample_location;
+
+        dst->frame_num = 0;
+
+        err = codec->reset(dst);
+        if (err < 0)
+            return err;
+    }
+
+    return 0;
+}
+
 int ff_thread_can_start_frame(AVCodecContext *avctx)
 {
     if ((avctx->active_thread_type & FF_THREAD_FRAME) &&
@@ -325,6 +325,27 @@ static av_cold int preinit(AVFilterContext *ctx)
 
 static int do_scale(FFFrameSync *fs);
 
+typedef struct ThreadData {
+    void (*func)(void *priv, int jobnr);
+    void *priv;
+} ThreadData;
+
+static int scale_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    td->func(td->priv, jobnr);
+    return 0;
+}
+
+static void scale_execute(SwsContext *sws, void (*func)(void *priv, int jobnr),
+                          void *priv, int nb_jobs)
+{
+    AVFilterContext *ctx = sws->opaque;
+    ThreadData td = { .func = func, .priv = priv };
+
+    ff_filter_execute(ctx, scale_slice, &td, NULL, nb_jobs);
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     ScaleContext *scale = ctx->priv;
@@ -421,9 +442,15 @@ static av_cold int init(AVFilterContext *ctx)
     scale->sws->dst_h_chr_pos = scale->out_h_chr_pos;
     scale->sws->dst_v_chr_pos = scale->out_v_chr_pos;
 
-    // use generic thread-count if the user did not set it explicitly
-    if (!scale->sws->threads)
+    // use generic thread-count if the user did not set it explicitly, and
+    // run the scaler slices on the filtergraph's threads in that case
+    if (!scale->sws->threads) {
         scale->sws->threads = ff_filter_get_nb_threads(ctx);
+        if (ctx->thread_type & AVFILTER_THREAD_SLICE) {
+            scale->sws->execute = scale_execute;
+            scale->sws->opaque  = ctx;
+        }
+    }
 
     if (!IS_SCALE2REF(ctx) && scale->uses_ref) {
         AVFilterPad pad = {
@@ -1191,7 +1218,7 @@ const FFFilter ff_vf_scale = {
     .p.name          = "scale",
     .p.description   = NULL_IF_CONFIG_SMALL("Scale the input video size and/or convert the image format."),
     .p.priv_class    = &scale_class,
-    .p.flags         = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .p.flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
     .preinit         = preinit,
     .init            = init,
     .uninit          = uninit,
@@ -1260,6 +1287,7 @@ const FFFilter ff_vf_scale2ref = {
     .p.name          = "scale2ref",
     .p.description   = NULL_IF_CONFIG_SMALL("Scale the input video size and/or convert the image format to the given reference."),
     .p.priv_class    = &scale2ref_class,
+    .p.flags         = AVFILTER_FLAG_SLICE_THREADS,
     .preinit         = preinit,
     .init            = init,
     .uninit          = uninit,
@@ -1,5 +1,5 @@
 /*
- * Input async protocol.
+ * Async protocol.
  * Copyright (c) 2015 Zhang Rui <bbcallen@gmail.com>
  *
  * This file is part of FFmpeg.
@@ -32,8 +32,10 @@
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/log.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "url.h"
 #include <stdint.h>
 
@@ -44,6 +46,13 @@
 #define BUFFER_CAPACITY         (4 * 1024 * 1024)
 #define READ_BACK_CAPACITY      (4 * 1024 * 1024)
 #define SHORT_SEEK_THRESHOLD    (256 * 1024)
+#define WRITE_CHUNK_SIZE        (64 * 1024)
+
+enum AsyncFsyncPolicy {
+    FSYNC_NONE,
+    FSYNC_CLOSE,
+    FSYNC_INTERVAL,
+};
 
 typedef struct RingBuffer
 {
@@ -78,6 +87,20 @@ typedef struct AsyncContext {
 
     int             abort_request;
     AVIOInterruptCB interrupt_callback;
+
+    /* write-behind */
+    int             write;
+    int             write_active;
+    int             write_chunk_size;
+    uint8_t        *write_buf;
+    int             write_buffer_size;
+    int             fsync_policy;
+    int64_t         fsync_interval;
+    int64_t         last_fsync;
+
+    int64_t         queue_max;
+    int64_t         nb_stalls;
+    int64_t         stall_time;
 } AsyncContext;
 
 static int ring_init(RingBuffer *ring, unsigned int capacity, int read_back_capacity)
@@ -247,6 +270,84 @@ static void *async_buffer_task(void *arg)
     return NULL;
 }
 
+static int async_fsync(URLContext *h)
+{
+#if HAVE_FSYNC
+    AsyncContext *c = h->priv_data;
+    int fd = ffurl_get_file_handle(c->inner);
+
+    /* Pipes and sockets have nothing to synchronize. */
+    if (fd >= 0 && fsync(fd) < 0 && errno != EINVAL && errno != ENOTSUP) {
+        int ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "fsync failed: %s\n", av_err2str(ret));
+        return ret;
+    }
+#endif
+    return 0;
+}
+
+/* Each queued chunk is stored as its size followed by its data, so that
+ * packet boundaries are kept for packet based protocols. */
+static void *async_write_task(void *arg)
+{
+    URLContext   *h    = arg;
+    AsyncContext *c    = h->priv_data;
+    AVFifo       *fifo = c->ring.fifo;
+
+    ff_thread_setname("async-write");
+
+    pthread_mutex_lock(&c->mutex);
+    while (!async_check_interrupt(h)) {
+        uint32_t size;
+        int ret = 0;
+
+        if (!av_fifo_can_read(fifo)) {
+            pthread_cond_signal(&c->cond_wakeup_main);
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            continue;
+        }
+
+        av_fifo_read(fifo, &size, sizeof(size));
+        av_fifo_read(fifo, c->write_buf, size);
+        c->write_active = 1;
+        pthread_cond_signal(&c->cond_wakeup_main);
+        pthread_mutex_unlock(&c->mutex);
+
+        /* After a failure the remaining data is dropped. */
+        if (!c->io_error) {
+            ret = ffurl_write(c->inner, c->write_buf, size);
+            if (ret >= 0 && c->fsync_policy == FSYNC_INTERVAL &&
+                av_gettime_relative() - c->last_fsync >= c->fsync_interval) {
+                ret = async_fsync(h);
+                c->last_fsync = av_gettime_relative();
+            }
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        c->write_active = 0;
+        if (ret < 0 && !c->io_error)
+            c->io_error = ret;
+    }
+    pthread_cond_signal(&c->cond_wakeup_main);
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+/* Wait until everything queued has been written, must hold the mutex. */
+static int async_write_drain(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+
+    while (!c->io_error && (av_fifo_can_read(c->ring.fifo) || c->write_active)) {
+        if (async_check_interrupt(h))
+            return AVERROR_EXIT;
+        pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+    }
+    return c->io_error;
+}
+
 static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     AsyncContext *c = h->priv_data;
@@ -255,9 +356,17 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "async:", &arg);
 
-    ret = ring_init(&c->ring, BUFFER_CAPACITY, READ_BACK_CAPACITY);
-    if (ret < 0)
-        goto fifo_fail;
+    if ((flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE) {
+        av_log(h, AV_LOG_ERROR, "Simultaneous reading and writing is not supported\n");
+        return AVERROR(ENOSYS);
+    }
+    c->write = !!(flags & AVIO_FLAG_WRITE);
+
+    if (!c->write) {
+        ret = ring_init(&c->ring, BUFFER_CAPACITY, READ_BACK_CAPACITY);
+        if (ret < 0)
+            goto fifo_fail;
+    }
 
     /* wrap interrupt callback */
     c->interrupt_callback = h->interrupt_callback;
@@ -270,6 +379,22 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
     c->logical_size = ffurl_size(c->inner);
     h->is_streamed  = c->inner->is_streamed;
 
+    if (c->write) {
+        c->write_chunk_size = c->inner->max_packet_size ? c->inner->max_packet_size
+                                                        : WRITE_CHUNK_SIZE;
+        h->max_packet_size  = c->inner->max_packet_size;
+        c->write_buf        = av_malloc(c->write_chunk_size);
+        if (!c->write_buf) {
+            ret = AVERROR(ENOMEM);
+            goto mutex_fail;
+        }
+        ret = ring_init(&c->ring, FFMAX(c->write_buffer_size,
+                                        c->write_chunk_size + sizeof(uint32_t)), 0);
+        if (ret < 0)
+            goto mutex_fail;
+        c->last_fsync = av_gettime_relative();
+    }
+
     ret = pthread_mutex_init(&c->mutex, NULL);
     if (ret != 0) {
         ret = AVERROR(ret);
@@ -291,7 +416,8 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
         goto cond_wakeup_background_fail;
     }
 
-    ret = pthread_create(&c->async_buffer_thread, NULL, async_buffer_task, h);
+    ret = pthread_create(&c->async_buffer_thread, NULL,
+                         c->write ? async_write_task : async_buffer_task, h);
     if (ret) {
         ret = AVERROR(ret);
         av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(ret));
@@ -310,6 +436,7 @@ mutex_fail:
     ffurl_closep(&c->inner);
 url_fail:
     ring_destroy(&c->ring);
+    av_freep(&c->write_buf);
 fifo_fail:
     return ret;
 }
@@ -317,9 +444,11 @@ fifo_fail:
 static int async_close(URLContext *h)
 {
     AsyncContext *c = h->priv_data;
-    int      ret;
+    int      ret, write_ret = 0;
 
     pthread_mutex_lock(&c->mutex);
+    if (c->write)
+        write_ret = async_write_drain(h);
     c->abort_request = 1;
     pthread_cond_signal(&c->cond_wakeup_background);
     pthread_mutex_unlock(&c->mutex);
@@ -328,13 +457,22 @@ static int async_close(URLContext *h)
     if (ret != 0)
         av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
 
+    if (c->write) {
+        if (write_ret >= 0 && c->fsync_policy != FSYNC_NONE)
+            write_ret = async_fsync(h);
+        av_log(h, AV_LOG_VERBOSE, "Write-behind queue: %"PRId64" of %d bytes used at most, "
+               "%"PRId64" stalls, %.3f s blocked\n", c->queue_max, c->write_buffer_size,
+               c->nb_stalls, c->stall_time / 1000000.0);
+    }
+
     pthread_cond_destroy(&c->cond_wakeup_background);
     pthread_cond_destroy(&c->cond_wakeup_main);
     pthread_mutex_destroy(&c->mutex);
     ffurl_closep(&c->inner);
     ring_destroy(&c->ring);
+    av_freep(&c->write_buf);
 
-    return 0;
+    return write_ret;
 }
 
 static int async_read_internal(URLContext *h, void *dest, int size)
@@ -389,6 +527,72 @@ static int async_read(URLContext *h, unsigned char *buf, int size)
     return async_read_internal(h, buf, size);
 }
 
+static int async_write(URLContext *h, const unsigned char *buf, int size)
+{
+    AsyncContext *c       = h->priv_data;
+    AVFifo       *fifo    = c->ring.fifo;
+    int64_t   stall_start = 0;
+    int           written = 0;
+    int           ret     = 0;
+
+    pthread_mutex_lock(&c->mutex);
+
+    while (written < size) {
+        uint32_t len = FFMIN(size - written, c->write_chunk_size);
+
+        if (c->io_error) {
+            ret = c->io_error;
+            break;
+        }
+        if (async_check_interrupt(h)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (av_fifo_can_write(fifo) < sizeof(len) + len) {
+            if (!stall_start) {
+                if (!c->nb_stalls)
+                    av_log(h, AV_LOG_WARNING, "Write-behind queue full, output is "
+                           "slower than the input; consider a larger write_buffer_size\n");
+                stall_start = av_gettime_relative();
+                c->nb_stalls++;
+            }
+            pthread_cond_signal(&c->cond_wakeup_background);
+            pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+            continue;
+        }
+
+        av_fifo_write(fifo, &len, sizeof(len));
+        av_fifo_write(fifo, buf + written, len);
+        written        += len;
+        c->logical_pos += len;
+        c->queue_max    = FFMAX(c->queue_max, av_fifo_can_read(fifo));
+        pthread_cond_signal(&c->cond_wakeup_background);
+    }
+
+    if (stall_start)
+        c->stall_time += av_gettime_relative() - stall_start;
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret < 0 ? ret : size;
+}
+
+static int64_t async_write_seek(URLContext *h, int64_t pos, int whence)
+{
+    AsyncContext *c = h->priv_data;
+    int64_t     ret;
+
+    pthread_mutex_lock(&c->mutex);
+    ret = async_write_drain(h);
+    if (ret >= 0) {
+        ret = ffurl_seek(c->inner, pos, whence);
+        if (ret >= 0 && whence != AVSEEK_SIZE)
+            c->logical_pos = ret;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
 static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 {
     AsyncContext *c    = h->priv_data;
@@ -398,6 +602,9 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
     int fifo_size;
     int fifo_size_of_read_back;
 
+    if (c->write)
+        return async_write_seek(h, pos, whence);
+
     if (whence == AVSEEK_SIZE) {
         av_log(h, AV_LOG_TRACE, "async_seek: AVSEEK_SIZE: %"PRId64"\n", (int64_t)c->logical_size);
         return c->logical_size;
@@ -474,12 +681,25 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 
 #define OFFSET(x) offsetof(AsyncContext, x)
 #define D AV_OPT_FLAG_DECODING_PARAM
+#define E AV_OPT_FLAG_ENCODING_PARAM
+#define X AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY
 
 static const AVOption options[] = {
+    { "write_buffer_size", "size of the write-behind queue in bytes", OFFSET(write_buffer_size), AV_OPT_TYPE_INT, { .i64 = BUFFER_CAPACITY }, 0, INT_MAX / 2, E },
+    { "fsync", "when to synchronize the written data with the storage", OFFSET(fsync_policy), AV_OPT_TYPE_INT, { .i64 = FSYNC_NONE }, FSYNC_NONE, FSYNC_INTERVAL, E, .unit = "fsync" },
+        { "none",     "never",                                  0, AV_OPT_TYPE_CONST, { .i64 = FSYNC_NONE },     0, 0, E, .unit = "fsync" },
+        { "close",    "when closing",                           0, AV_OPT_TYPE_CONST, { .i64 = FSYNC_CLOSE },    0, 0, E, .unit = "fsync" },
+        { "interval", "every fsync_interval and when closing",  0, AV_OPT_TYPE_CONST, { .i64 = FSYNC_INTERVAL }, 0, 0, E, .unit = "fsync" },
+    { "fsync_interval", "interval between synchronizations", OFFSET(fsync_interval), AV_OPT_TYPE_DURATION, { .i64 = 1000000 }, 0, INT64_MAX, E },
+    { "queue_max",  "largest amount of queued data in bytes",          OFFSET(queue_max),  AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, X },
+    { "stalls",     "number of writes blocked by a full queue",        OFFSET(nb_stalls),  AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, X },
+    { "stall_time", "total time writes were blocked in microseconds", OFFSET(stall_time), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, X },
     {NULL},
 };
 
 #undef D
+#undef E
+#undef X
 #undef OFFSET
 
 static const AVClass async_context_class = {
@@ -493,6 +713,7 @@ const URLProtocol ff_async_protocol = {
     .name                = "async",
     .url_open2           = async_open,
     .url_read            = async_read,
+    .url_write           = async_write,
     .url_seek            = async_seek,
     .url_close           = async_close,
     .priv_data_size      = sizeof(AsyncContext),
@@ -39,6 +39,7 @@
 #include "avformat_internal.h"
 #include "avio.h"
 #include "demux.h"
+#include "indexcache.h"
 #include "mux.h"
 #include "internal.h"
 
@@ -180,6 +181,7 @@ void avformat_free_context(AVFormatContext *s)
     av_freep(&s->chapters);
     av_dict_free(&s->metadata);
     av_dict_free(&si->id3v2_meta);
+    ff_index_cache_free(&si->index_cache);
     av_packet_free(&si->pkt);
     av_packet_free(&si->parse_pkt);
     avpriv_packet_list_free(&si->packet_buffer);
@@ -1884,6 +1884,17 @@ typedef struct AVFormatContext {
      * @see skip_estimate_duration_from_pts
      */
     int64_t duration_probesize;
+
+    /**
+     * Directory holding the cache of stream parameters and index entries
+     * of local input files. If set, avformat_find_stream_info() restores
+     * the stream parameters and index from a valid cache entry instead of
+     * probing the streams, and avformat_close_input() creates or updates
+     * the entry of the input.
+     *
+     * Demuxing only, set by the caller before avformat_open_input().
+     */
+    char *index_cache;
 } AVFormatContext;
 
 /**
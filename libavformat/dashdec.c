@@ -20,16 +20,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <libxml/parser.h>
+#include <stdatomic.h>
 #include <time.h>
 #include "libavutil/bprint.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 #include "internal.h"
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "segprefetch.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -118,6 +121,11 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    /* Upcoming fragments being prefetched, and the prefetched fragment
+     * currently being read, if any. */
+    FFSegPrefetchQueue prefetch;
+    FFSegPrefetchJob *cur_prefetch;
 };
 
 typedef struct DASHContext {
@@ -160,6 +168,29 @@ typedef struct DASHContext {
     int is_init_section_common_audio;
     int is_init_section_common_subtitle;
 
+    int prefetch_segments;
+    int64_t prefetch_buffer_size;
+    int background_refresh;
+
+    /* Live manifest refresh thread. It downloads the MPD periodically or
+     * when kicked, the demuxing thread only parses the latest copy. */
+#if HAVE_THREADS
+    pthread_t refresh_thread;
+    pthread_mutex_t refresh_lock;
+    pthread_cond_t refresh_cond;
+#endif
+    int refresh_thread_started;
+    atomic_int refresh_abort;
+    AVIOInterruptCB refresh_interrupt;
+    AVDictionary *refresh_opts;
+    int refresh_kick;
+    unsigned refresh_attempts;
+    int refresh_error;
+    unsigned mpd_seq;
+    unsigned mpd_seq_parsed;
+    char *mpd_data;
+    int mpd_size;
+    char *mpd_location;
 } DASHContext;
 
 static int ishttp(char *url)
@@ -348,8 +379,15 @@ static void free_timelines_list(struct representation *pls)
     pls->n_timelines = 0;
 }
 
+static void prefetch_free_all(struct representation *pls)
+{
+    ff_segprefetch_queue_free(&pls->prefetch);
+    ff_segprefetch_free(&pls->cur_prefetch);
+}
+
 static void free_representation(struct representation *pls)
 {
+    prefetch_free_all(pls);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -401,14 +439,11 @@ static void free_subtitle_list(DASHContext *c)
     c->n_subtitles = 0;
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http)
+static int check_url(AVFormatContext *s, const char *url, const char **proto_name_out)
 {
     DASHContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
     int proto_name_len;
-    int ret;
 
     if (av_strstart(url, "crypto", NULL)) {
         if (url[6] == '+' || url[6] == ':')
@@ -443,6 +478,22 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    *proto_name_out = proto_name;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    const char *proto_name = NULL;
+    int ret;
+
+    ret = check_url(s, url, &proto_name);
+    if (ret < 0)
+        return ret;
+
     av_freep(pb);
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
@@ -1492,7 +1543,197 @@ static void move_segments(struct representation *rep_src, struct representation
 }
 
 
-static int refresh_manifest(AVFormatContext *s)
+#if HAVE_THREADS
+static int refresh_interrupt_cb(void *opaque)
+{
+    AVFormatContext *s = opaque;
+    DASHContext *c = s->priv_data;
+    return atomic_load(&c->refresh_abort) || ff_check_interrupt(c->interrupt_callback);
+}
+
+static void *refresh_worker(void *arg)
+{
+    AVFormatContext *s = arg;
+    DASHContext *c = s->priv_data;
+
+    pthread_mutex_lock(&c->refresh_lock);
+    while (!atomic_load(&c->refresh_abort)) {
+        AVIOContext *in = NULL;
+        AVDictionary *opts = NULL;
+        char *location = NULL;
+        AVBPrint buf;
+        int ret;
+
+        if (!c->refresh_kick) {
+            int64_t t = av_gettime() + 1000000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+            pthread_cond_timedwait(&c->refresh_cond, &c->refresh_lock, &tv);
+            if (atomic_load(&c->refresh_abort))
+                break;
+        }
+        c->refresh_kick = 0;
+        pthread_mutex_unlock(&c->refresh_lock);
+
+        av_bprint_init(&buf, 0, INT_MAX);
+        ret = av_dict_copy(&opts, c->refresh_opts, 0);
+        if (ret >= 0)
+            ret = ffio_open_whitelist(&in, s->url, AVIO_FLAG_READ, &c->refresh_interrupt,
+                                      &opts, s->protocol_whitelist, s->protocol_blacklist);
+        av_dict_free(&opts);
+        if (ret >= 0) {
+            if (av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&location) < 0)
+                location = NULL;
+            ret = avio_read_to_bprint(in, &buf, SIZE_MAX);
+            if (ret >= 0 && !avio_feof(in))
+                ret = AVERROR_INVALIDDATA;
+            if (ret >= 0 && !av_bprint_is_complete(&buf))
+                ret = AVERROR(ENOMEM);
+            avio_closep(&in);
+        }
+
+        pthread_mutex_lock(&c->refresh_lock);
+        if (ret >= 0) {
+            av_freep(&c->mpd_data);
+            av_freep(&c->mpd_location);
+            c->mpd_size = buf.len;
+            av_bprint_finalize(&buf, &c->mpd_data);
+            c->mpd_location = location;
+            c->mpd_seq++;
+        } else {
+            av_bprint_finalize(&buf, NULL);
+            av_free(location);
+            if (!atomic_load(&c->refresh_abort))
+                av_log(s, AV_LOG_WARNING, "Failed to refresh the manifest: %s\n",
+                       av_err2str(ret));
+        }
+        c->refresh_error = FFMIN(ret, 0);
+        c->refresh_attempts++;
+        pthread_cond_broadcast(&c->refresh_cond);
+    }
+    pthread_mutex_unlock(&c->refresh_lock);
+
+    return NULL;
+}
+
+static int start_refresh_thread(AVFormatContext *s)
+{
+    DASHContext *c = s->priv_data;
+    int ret;
+
+    ret = av_dict_copy(&c->refresh_opts, c->avio_opts, 0);
+    if (ret < 0)
+        return ret;
+
+    atomic_init(&c->refresh_abort, 0);
+    c->refresh_interrupt.callback = refresh_interrupt_cb;
+    c->refresh_interrupt.opaque   = s;
+
+    if ((ret = pthread_mutex_init(&c->refresh_lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&c->refresh_cond, NULL))) {
+        pthread_mutex_destroy(&c->refresh_lock);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_create(&c->refresh_thread, NULL, refresh_worker, s))) {
+        pthread_cond_destroy(&c->refresh_cond);
+        pthread_mutex_destroy(&c->refresh_lock);
+        return AVERROR(ret);
+    }
+    c->refresh_thread_started = 1;
+
+    return 0;
+}
+#endif
+
+static void stop_refresh_thread(DASHContext *c)
+{
+#if HAVE_THREADS
+    if (c->refresh_thread_started) {
+        pthread_mutex_lock(&c->refresh_lock);
+        atomic_store(&c->refresh_abort, 1);
+        pthread_cond_broadcast(&c->refresh_cond);
+        pthread_mutex_unlock(&c->refresh_lock);
+        pthread_join(c->refresh_thread, NULL);
+        pthread_cond_destroy(&c->refresh_cond);
+        pthread_mutex_destroy(&c->refresh_lock);
+        c->refresh_thread_started = 0;
+    }
+#endif
+    av_dict_free(&c->refresh_opts);
+    av_freep(&c->mpd_data);
+    av_freep(&c->mpd_location);
+}
+
+/*
+ * Hand over the manifest most recently downloaded by the refresh thread, if
+ * it has not been parsed yet, and ask for a new download. With wait set,
+ * block until the next download attempt has finished. Returns 1 if a new
+ * manifest was handed over, 0 if there is none, or a negative error code.
+ */
+static int take_refreshed_manifest(AVFormatContext *s, int wait,
+                                   char **data, int *size, char **location)
+{
+    int ret = 0;
+#if HAVE_THREADS
+    DASHContext *c = s->priv_data;
+    unsigned attempts;
+
+    pthread_mutex_lock(&c->refresh_lock);
+    if (c->mpd_seq == c->mpd_seq_parsed) {
+        attempts = c->refresh_attempts;
+        c->refresh_kick = 1;
+        pthread_cond_broadcast(&c->refresh_cond);
+        while (wait && c->refresh_attempts == attempts) {
+            int64_t t = av_gettime() + 100000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+            pthread_cond_timedwait(&c->refresh_cond, &c->refresh_lock, &tv);
+            if (ff_check_interrupt(c->interrupt_callback)) {
+                ret = AVERROR_EXIT;
+                break;
+            }
+        }
+        if (!ret && c->mpd_seq == c->mpd_seq_parsed)
+            ret = c->refresh_error;
+    }
+    if (!ret && c->mpd_seq != c->mpd_seq_parsed) {
+        *data     = c->mpd_data;
+        *size     = c->mpd_size;
+        *location = c->mpd_location;
+        c->mpd_data     = NULL;
+        c->mpd_location = NULL;
+        c->mpd_seq_parsed = c->mpd_seq;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&c->refresh_lock);
+#endif
+    return ret;
+}
+
+static int parse_refreshed_manifest(AVFormatContext *s, int wait)
+{
+    DASHContext *c = s->priv_data;
+    FFIOContext pb;
+    char *data = NULL, *location = NULL;
+    int size, ret;
+
+    if (!c->refresh_thread_started)
+        return parse_manifest(s, s->url, NULL);
+
+    ret = take_refreshed_manifest(s, wait, &data, &size, &location);
+    if (ret <= 0)
+        return ret ? ret : AVERROR(EAGAIN);
+
+    ffio_init_read_context(&pb, (const uint8_t *)data, size);
+    ret = parse_manifest(s, location ? location : s->url, &pb.pub);
+    av_free(data);
+    av_free(location);
+
+    return ret;
+}
+
+static int refresh_manifest(AVFormatContext *s, int wait)
 {
     int ret = 0, i;
     DASHContext *c = s->priv_data;
@@ -1512,7 +1753,7 @@ static int refresh_manifest(AVFormatContext *s)
     c->audios = NULL;
     c->n_subtitles = 0;
     c->subtitles = NULL;
-    ret = parse_manifest(s, s->url, NULL);
+    ret = parse_refreshed_manifest(s, wait);
     if (ret)
         goto finish;
 
@@ -1591,31 +1832,70 @@ finish:
     return ret;
 }
 
+static struct fragment *copy_fragment(const struct fragment *seg_ptr)
+{
+    struct fragment *seg = av_mallocz(sizeof(struct fragment));
+    if (!seg) {
+        return NULL;
+    }
+    seg->url = av_strdup(seg_ptr->url);
+    if (!seg->url) {
+        av_free(seg);
+        return NULL;
+    }
+    seg->size = seg_ptr->size;
+    seg->url_offset = seg_ptr->url_offset;
+    return seg;
+}
+
+static struct fragment *get_template_fragment(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    struct fragment *seg;
+    char *tmpfilename;
+
+    if (!pls->url_template) {
+        av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
+        return NULL;
+    }
+    seg = av_mallocz(sizeof(struct fragment));
+    if (!seg) {
+        return NULL;
+    }
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename) {
+        av_free(seg);
+        return NULL;
+    }
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!seg->url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        seg->url = av_strdup(pls->url_template);
+        if (!seg->url) {
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+            av_free(tmpfilename);
+            av_free(seg);
+            return NULL;
+        }
+    }
+    av_free(tmpfilename);
+    seg->size = -1;
+
+    return seg;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
     int64_t max_seq_no = 0;
-    struct fragment *seg = NULL;
-    struct fragment *seg_ptr = NULL;
     DASHContext *c = pls->parent->priv_data;
 
     while (( !ff_check_interrupt(c->interrupt_callback)&& pls->n_fragments > 0)) {
         if (pls->cur_seq_no < pls->n_fragments) {
-            seg_ptr = pls->fragments[pls->cur_seq_no];
-            seg = av_mallocz(sizeof(struct fragment));
-            if (!seg) {
-                return NULL;
-            }
-            seg->url = av_strdup(seg_ptr->url);
-            if (!seg->url) {
-                av_free(seg);
-                return NULL;
-            }
-            seg->size = seg_ptr->size;
-            seg->url_offset = seg_ptr->url_offset;
-            return seg;
+            return copy_fragment(pls->fragments[pls->cur_seq_no]);
         } else if (c->is_live) {
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, 1);
         } else {
             break;
         }
@@ -1625,7 +1905,7 @@ static struct fragment *get_current_fragment(struct representation *pls)
         max_seq_no = calc_max_seg_no(pls, c);
 
         if (pls->timelines || pls->fragments) {
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, 0);
         }
         if (pls->cur_seq_no <= min_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "old fragment: cur[%"PRId64"] min[%"PRId64"] max[%"PRId64"]\n", (int64_t)pls->cur_seq_no, min_seq_no, max_seq_no);
@@ -1633,45 +1913,29 @@ static struct fragment *get_current_fragment(struct representation *pls)
         } else if (pls->cur_seq_no > max_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "new fragment: min[%"PRId64"] max[%"PRId64"]\n", min_seq_no, max_seq_no);
         }
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
-    } else if (pls->cur_seq_no <= pls->last_seq_no) {
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
+    } else if (pls->cur_seq_no > pls->last_seq_no) {
+        return NULL;
     }
-    if (seg) {
-        char *tmpfilename;
-        if (!pls->url_template) {
-            av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
-            av_free(seg);
-            return NULL;
-        }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
-            av_free(seg);
+
+    return get_template_fragment(pls, pls->cur_seq_no);
+}
+
+/* The fragment seq_no positions ahead of the current one, if it is already
+ * known to exist. */
+static struct fragment *get_upcoming_fragment(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+
+    if (pls->n_fragments > 0) {
+        if (seq_no >= pls->n_fragments)
             return NULL;
-        }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
-        seg->size = -1;
+        return copy_fragment(pls->fragments[seq_no]);
     }
+    if (!pls->url_template ||
+        seq_no > (c->is_live ? calc_max_seg_no(pls, c) : pls->last_seq_no))
+        return NULL;
 
-    return seg;
+    return get_template_fragment(pls, seq_no);
 }
 
 static int read_from_url(struct representation *pls, struct fragment *seg,
@@ -1768,9 +2032,110 @@ static int update_init_section(struct representation *pls)
     return 0;
 }
 
+static char *make_fragment_url(DASHContext *c, const struct fragment *seg)
+{
+    char *url = av_mallocz(c->max_url_size);
+    if (url)
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    return url;
+}
+
+/* Fragments are identified by their URL and byte range only, as their
+ * numbers can change when a live manifest is refreshed. Fragments that
+ * cannot be prefetched stay queued, so that they are fetched normally once
+ * reached. */
+static int prefetch_want(DASHContext *c, struct representation *pls,
+                         const struct fragment *seg, const char *url, int start)
+{
+    FFSegPrefetchJob *job;
+    const char *proto_name;
+
+    if (ff_segprefetch_want(&pls->prefetch, 0, url, seg->url_offset, seg->size) ||
+        !start)
+        return 0;
+
+    job = ff_segprefetch_add(&pls->prefetch, 0, url, seg->url_offset, seg->size);
+    if (!job)
+        return AVERROR(ENOMEM);
+    if (check_url(pls->parent, url, &proto_name) < 0)
+        return 0;
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "DASH prefetch for url '%s', offset %"PRId64"\n",
+           url, seg->url_offset);
+
+    return ff_segprefetch_start(job, pls->parent, c->avio_opts,
+                                c->prefetch_buffer_size / c->prefetch_segments, 0);
+}
+
+static int prefetch_window(DASHContext *c, struct representation *pls, int start)
+{
+    for (int i = 1; i <= c->prefetch_segments; i++) {
+        struct fragment *seg = get_upcoming_fragment(pls, pls->cur_seq_no + i);
+        char *url;
+        int ret;
+
+        if (!seg)
+            break;
+        url = make_fragment_url(c, seg);
+        if (!url) {
+            free_fragment(&seg);
+            return AVERROR(ENOMEM);
+        }
+
+        ret = prefetch_want(c, pls, seg, url, start);
+        av_free(url);
+        free_fragment(&seg);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Drop the jobs that fell out of the window following the current fragment
+ * and start downloading the fragments that entered it. */
+static int prefetch_schedule(DASHContext *c, struct representation *pls)
+{
+    ff_segprefetch_unwant_all(&pls->prefetch);
+    prefetch_window(c, pls, 0);
+    ff_segprefetch_drop_unwanted(&pls->prefetch);
+
+    return prefetch_window(c, pls, 1);
+}
+
+/* Returns NULL if seg was not prefetched or the download failed. */
+static FFSegPrefetchJob *prefetch_take(DASHContext *c, struct representation *pls,
+                                       const struct fragment *seg)
+{
+    FFSegPrefetchJob *job;
+    char *url = make_fragment_url(c, seg);
+
+    if (!url)
+        return NULL;
+    job = ff_segprefetch_take(&pls->prefetch, 0, url, seg->url_offset, seg->size);
+    av_free(url);
+
+    return job;
+}
+
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
+    if (v->cur_prefetch) {
+        int64_t size = v->cur_prefetch->data_len;
+        if (whence == AVSEEK_SIZE)
+            return size;
+        if (whence == SEEK_CUR)
+            offset += v->cur_seg_offset;
+        else if (whence == SEEK_END)
+            offset += size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (offset < 0 || offset > size)
+            return AVERROR(EINVAL);
+        v->cur_seg_offset = offset;
+        return offset;
+    }
     if (v->n_fragments && !v->init_sec_data_len) {
         return avio_seek(v->input, offset, whence);
     }
@@ -1785,7 +2150,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->cur_prefetch) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1798,15 +2163,27 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
-        if (ret < 0) {
-            if (ff_check_interrupt(c->interrupt_callback)) {
-                ret = AVERROR_EXIT;
-                goto end;
+        if (c->prefetch_segments &&
+            (v->cur_prefetch = prefetch_take(c, v, v->cur_seg))) {
+            v->cur_seg_offset = 0;
+            v->cur_seg_size = v->cur_seg->size;
+        } else {
+            ret = open_input(c, v, v->cur_seg);
+            if (ret < 0) {
+                if (ff_check_interrupt(c->interrupt_callback)) {
+                    ret = AVERROR_EXIT;
+                    goto end;
+                }
+                av_log(v->parent, AV_LOG_WARNING, "Failed to open fragment of playlist\n");
+                v->cur_seq_no++;
+                goto restart;
             }
-            av_log(v->parent, AV_LOG_WARNING, "Failed to open fragment of playlist\n");
-            v->cur_seq_no++;
-            goto restart;
+        }
+
+        if (c->prefetch_segments) {
+            ret = prefetch_schedule(c, v);
+            if (ret < 0)
+                goto end;
         }
     }
 
@@ -1827,7 +2204,10 @@ restart:
         ret = AVERROR_EOF;
         goto end;
     }
-    ret = read_from_url(v, v->cur_seg, buf, buf_size);
+    if (v->cur_prefetch)
+        ret = ff_segprefetch_read(v->cur_prefetch, &v->cur_seg_offset, buf, buf_size);
+    else
+        ret = read_from_url(v, v->cur_seg, buf, buf_size);
     if (ret > 0)
         goto end;
 
@@ -2046,6 +2426,19 @@ static int dash_read_header(AVFormatContext *s)
         av_dict_set(&c->avio_opts, "seekable", "0", 0);
     }
 
+#if HAVE_THREADS
+    if (c->is_live && c->background_refresh) {
+        ret = start_refresh_thread(s);
+        if (ret < 0)
+            return ret;
+    }
+#else
+    if (c->prefetch_segments || c->background_refresh) {
+        av_log(s, AV_LOG_WARNING, "Background downloads require threading support, disabling them\n");
+        c->prefetch_segments = 0;
+    }
+#endif
+
     if(c->n_videos)
         c->is_init_section_common_video = is_common_init_section_exist(c->videos, c->n_videos);
 
@@ -2157,6 +2550,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            prefetch_free_all(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2219,6 +2613,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            ff_segprefetch_free(&cur->cur_prefetch);
             ret = reopen_demux_for_component(s, cur);
         }
     }
@@ -2228,6 +2623,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
 static int dash_close(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
+    stop_refresh_thread(c);
     free_audio_list(c);
     free_video_list(c);
     free_subtitle_list(c);
@@ -2257,6 +2653,9 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    /* queued prefetches that are still ahead of the new position are kept,
+     * the others are dropped when the next fragment is opened */
+    ff_segprefetch_free(&pls->cur_prefetch);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2355,6 +2754,12 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    { "prefetch_segments", "Number of upcoming fragments to download in advance for each active representation",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS },
+    { "prefetch_buffer_size", "Maximum amount of memory used for the prefetched fragments of a representation",
+        OFFSET(prefetch_buffer_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT_MAX, FLAGS },
+    { "background_refresh", "Download live manifest updates in a background thread",
+        OFFSET(background_refresh), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
     {NULL}
 };
 
@@ -47,6 +47,7 @@
 #include "avio_internal.h"
 #include "demux.h"
 #include "id3v2.h"
+#include "indexcache.h"
 #include "internal.h"
 #include "url.h"
 
@@ -344,6 +345,8 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
 
     update_stream_avctx(s);
 
+    ff_index_cache_open(s);
+
     if (options) {
         av_dict_free(options);
         *options = tmp;
@@ -379,6 +382,8 @@ void avformat_close_input(AVFormatContext **ps)
         (s->flags & AVFMT_FLAG_CUSTOM_IO))
         pb = NULL;
 
+    ff_index_cache_close(s);
+
     if (s->iformat)
         if (ffifmt(s->iformat)->read_close)
             ffifmt(s->iformat)->read_close(s);
@@ -2592,6 +2597,11 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
     flush_codecs = probesize > 0;
 
+    if (ff_index_cache_restore(ic) > 0) {
+        ret = update_stream_avctx(ic);
+        goto find_stream_info_err;
+    }
+
     av_opt_set_int(ic, "skip_clear", 1, AV_OPT_SEARCH_CHILDREN);
 
     max_stream_analyze_duration = max_analyze_duration;
@@ -3126,6 +3136,9 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         sti->avctx_inited = 0;
     }
 
+    if (ret >= 0)
+        ff_index_cache_update_params(ic);
+
 find_stream_info_err:
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
@@ -39,6 +39,9 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include "os_support.h"
 #include "url.h"
 
@@ -97,6 +100,16 @@ typedef struct FileContext {
     int pkt_size;
     int follow;
     int seekable;
+    int use_mmap;
+    int64_t readahead;
+#if HAVE_MMAP
+    uint8_t *map;
+    int64_t map_size;
+    int64_t map_pos;
+    int64_t advised;        ///< end of the range last announced with WILLNEED
+    int64_t page_size;
+    int sequential;
+#endif
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -108,6 +121,8 @@ static const AVOption file_options[] = {
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
     { "pkt_size", "Maximum packet size", offsetof(FileContext, pkt_size), AV_OPT_TYPE_INT, { .i64 = 262144 }, 1, INT_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Map regular files into memory when reading", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap_readahead", "Amount of data to request ahead of the read position in mmap mode", offsetof(FileContext, readahead), AV_OPT_TYPE_INT64, { .i64 = 8 << 20 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -138,11 +153,89 @@ static const AVClass fd_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if HAVE_MMAP
+/* Ask the kernel to bring in the window ahead of the read position. A new
+ * request is only issued once half of the previous one has been consumed. */
+static void file_map_advise(FileContext *c)
+{
+#if HAVE_POSIX_MADVISE
+    int64_t start, end;
+
+    if (!c->readahead || c->advised - c->map_pos > c->readahead / 2)
+        return;
+
+    start = FFMAX(c->map_pos, c->advised) & ~(c->page_size - 1);
+    end   = c->map_pos + FFMIN(c->readahead, c->map_size - c->map_pos);
+    if (end > start)
+        posix_madvise(c->map + start, end - start, POSIX_MADV_WILLNEED);
+    c->advised = end;
+#endif
+}
+
+static void file_map_seek(FileContext *c, int64_t pos)
+{
+    if (pos >= c->map_pos && pos <= c->advised) {
+        c->map_pos = pos;
+        return;
+    }
+
+#if HAVE_POSIX_MADVISE
+    /* The demuxer jumps around (e.g. non-interleaved mov), so stop the kernel
+     * from dropping pages behind the read position. */
+    if (c->sequential && pos < c->map_pos) {
+        posix_madvise(c->map, c->map_size, POSIX_MADV_NORMAL);
+        c->sequential = 0;
+    }
+#endif
+    c->map_pos = c->advised = pos;
+}
+
+static void file_map(URLContext *h, const struct stat *st)
+{
+    FileContext *c = h->priv_data;
+    void *map;
+
+    if (!S_ISREG(st->st_mode) || st->st_size <= 0 ||
+        (uint64_t)st->st_size > SIZE_MAX)
+        return;
+
+    map = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED) {
+        av_log(h, AV_LOG_VERBOSE, "Could not map file, falling back to read(): %s\n",
+               av_err2str(AVERROR(errno)));
+        return;
+    }
+
+    c->map       = map;
+    c->map_size  = st->st_size;
+    c->map_pos   = 0;
+    c->advised   = 0;
+    c->page_size = 4096;
+#if HAVE_SYSCONF && defined(_SC_PAGESIZE)
+    c->page_size = FFMAX(sysconf(_SC_PAGESIZE), 1);
+#endif
+#if HAVE_POSIX_MADVISE
+    c->sequential = !posix_madvise(c->map, c->map_size, POSIX_MADV_SEQUENTIAL);
+#endif
+}
+#endif /* HAVE_MMAP */
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if HAVE_MMAP
+    if (c->map) {
+        if (c->map_pos >= c->map_size)
+            return AVERROR_EOF;
+        size = FFMIN(size, c->map_size - c->map_pos);
+        file_map_advise(c);
+        memcpy(buf, c->map + c->map_pos, size);
+        c->map_pos += size;
+        return size;
+    }
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -223,7 +316,13 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+#if HAVE_MMAP
+    if (c->map)
+        munmap(c->map, c->map_size);
+    c->map = NULL;
+#endif
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -233,6 +332,23 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     FileContext *c = h->priv_data;
     int64_t ret;
 
+#if HAVE_MMAP
+    if (c->map) {
+        if (whence == AVSEEK_SIZE)
+            return c->map_size;
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map_size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        file_map_seek(c, pos);
+        return pos;
+    }
+#endif
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
         ret = fstat(c->fd, &st);
@@ -310,7 +426,9 @@ static int file_open(URLContext *h, const char *filename, int flags)
         return AVERROR(errno);
     c->fd = fd;
 
-    h->is_streamed = !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+    if (fstat(fd, &st) < 0)
+        st.st_mode = 0;
+    h->is_streamed = S_ISFIFO(st.st_mode);
 
     /* Buffer writes more than the default 32k to improve throughput especially
      * with networked file systems */
@@ -320,6 +438,14 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow && !h->is_streamed) {
+#if HAVE_MMAP
+        file_map(h, &st);
+#else
+        av_log(h, AV_LOG_WARNING, "mmap is not supported on this platform\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -27,6 +27,7 @@
  * https://www.rfc-editor.org/rfc/rfc8216.txt
  */
 
+#include "config.h"
 #include "config_components.h"
 
 #include "libavformat/http.h"
@@ -44,6 +45,7 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "segprefetch.h"
 #include "url.h"
 
 #include "hls_sample_encryption.h"
@@ -87,6 +89,7 @@ struct segment {
 };
 
 struct rendition;
+struct playlist;
 
 enum PlaylistType {
     PLS_TYPE_UNSPECIFIED,
@@ -174,6 +177,11 @@ struct playlist {
     int n_init_sections;
     struct segment **init_sections;
     int is_subtitle; /* Indicates if it's a subtitle playlist */
+
+    /* Upcoming segments and initialization sections being prefetched, and
+     * the prefetched segment currently being read, if any. */
+    FFSegPrefetchQueue prefetch;
+    FFSegPrefetchJob *cur_prefetch;
 };
 
 /*
@@ -231,6 +239,8 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int64_t prefetch_buffer_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -264,6 +274,12 @@ static void free_init_section_list(struct playlist *pls)
     pls->n_init_sections = 0;
 }
 
+static void prefetch_free_all(struct playlist *pls)
+{
+    ff_segprefetch_queue_free(&pls->prefetch);
+    ff_segprefetch_free(&pls->cur_prefetch);
+}
+
 static void free_playlist_list(HLSContext *c)
 {
     int i;
@@ -283,6 +299,7 @@ static void free_playlist_list(HLSContext *c)
         pls->input_read_done = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_free_all(pls);
         if (pls->ctx) {
             pls->ctx->pb = NULL;
             avformat_close_input(&pls->ctx);
@@ -646,13 +663,10 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+static int check_url(AVFormatContext *s, const char *url, int *is_http_out)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
     int is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
@@ -694,6 +708,22 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    *is_http_out = is_http;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http = 0;
+
+    ret = check_url(s, url, &is_http);
+    if (ret < 0)
+        return ret;
+
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -1124,6 +1154,11 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
 {
     int ret;
 
+    /* the segment was downloaded in advance and there is no input */
+    if (pls->cur_prefetch)
+        return ff_segprefetch_read(pls->cur_prefetch, &pls->cur_seg_offset,
+                                   buf, buf_size);
+
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
@@ -1440,6 +1475,93 @@ cleanup:
     return ret;
 }
 
+/* Start downloading seg in the background. Segments that cannot be
+ * prefetched stay queued, so that they are fetched normally once reached. */
+static int prefetch_start(HLSContext *c, struct playlist *pls,
+                          struct segment *seg, int64_t seq_no)
+{
+    FFSegPrefetchJob *job;
+    int is_http = 0;
+
+    job = ff_segprefetch_add(&pls->prefetch, seq_no, seg->url,
+                             seg->url_offset, seg->size);
+    if (!job)
+        return AVERROR(ENOMEM);
+    if (check_url(pls->parent, seg->url, &is_http) < 0)
+        return 0;
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetch for url '%s', offset %"PRId64", playlist %d\n",
+           seg->url, seg->url_offset, pls->index);
+
+    /* See open_input() for why only non-HTTP URLs are seeked. */
+    return ff_segprefetch_start(job, pls->parent, c->avio_opts,
+                                c->prefetch_buffer_size / c->prefetch_segments,
+                                !is_http);
+}
+
+static int prefetch_want(HLSContext *c, struct playlist *pls, struct segment *seg,
+                         int64_t seq_no, int start)
+{
+    if (ff_segprefetch_want(&pls->prefetch, seq_no, seg->url,
+                            seg->url_offset, seg->size))
+        return 0;
+
+    /* Encrypted segments are fetched on demand, as they need the key. */
+    if (!start || seg->key_type != KEY_NONE)
+        return 0;
+
+    return prefetch_start(c, pls, seg, seq_no);
+}
+
+static int prefetch_window(HLSContext *c, struct playlist *pls, int start)
+{
+    struct segment *prev_init = pls->cur_init_section;
+    int ret;
+
+    for (int i = 1; i <= c->prefetch_segments; i++) {
+        int64_t n = pls->cur_seq_no - pls->start_seq_no + i;
+        struct segment *seg;
+
+        if (n < 0)
+            continue;
+        if (n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+
+        if (seg->init_section && seg->init_section != prev_init) {
+            ret = prefetch_want(c, pls, seg->init_section, -1, start);
+            if (ret < 0)
+                return ret;
+        }
+        prev_init = seg->init_section;
+
+        ret = prefetch_want(c, pls, seg, pls->cur_seq_no + i, start);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Drop the jobs that fell out of the window following the current segment
+ * and start downloading the segments that entered it. */
+static int prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    ff_segprefetch_unwant_all(&pls->prefetch);
+    prefetch_window(c, pls, 0);
+    ff_segprefetch_drop_unwanted(&pls->prefetch);
+
+    return prefetch_window(c, pls, 1);
+}
+
+/* Returns NULL if seg was not prefetched or the download failed. */
+static FFSegPrefetchJob *prefetch_take(struct playlist *pls, struct segment *seg,
+                                       int64_t seq_no)
+{
+    return ff_segprefetch_take(&pls->prefetch, seq_no, seg->url,
+                               seg->url_offset, seg->size);
+}
+
 static int update_init_section(struct playlist *pls, struct segment *seg)
 {
     static const int max_init_section_size = 1024*1024;
@@ -1456,6 +1578,22 @@ static int update_init_section(struct playlist *pls, struct segment *seg)
     if (!seg->init_section)
         return 0;
 
+    if (c->prefetch_segments) {
+        FFSegPrefetchJob *job = prefetch_take(pls, seg->init_section, -1);
+        if (job) {
+            sec_size = FFMIN(job->data_len, max_init_section_size);
+            av_fast_malloc(&pls->init_sec_buf, &pls->init_sec_buf_size, sec_size);
+            if (!pls->init_sec_buf) {
+                ff_segprefetch_free(&job);
+                return AVERROR(ENOMEM);
+            }
+            memcpy(pls->init_sec_buf, job->data, sec_size);
+            ff_segprefetch_free(&job);
+            ret = sec_size;
+            goto done;
+        }
+    }
+
     ret = open_input(c, pls, seg->init_section, &pls->input);
     if (ret < 0) {
         av_log(pls->parent, AV_LOG_WARNING,
@@ -1483,6 +1621,7 @@ static int update_init_section(struct playlist *pls, struct segment *seg)
                         pls->init_sec_buf_size);
     ff_format_io_close(pls->parent, &pls->input);
 
+done:
     if (ret < 0)
         return ret;
 
@@ -1651,13 +1790,20 @@ restart:
 
     seg = current_segment(v);
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->cur_prefetch) || (c->http_persistent && v->input_read_done)) {
         /* load/update Media Initialization Section, if any */
         ret = update_init_section(v, seg);
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments &&
+            (v->cur_prefetch = prefetch_take(v, seg, v->cur_seq_no))) {
+            /* an idle persistent connection is of no use any more */
+            ff_format_io_close(v->parent, &v->input);
+            v->input_read_done = 0;
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1684,9 +1830,15 @@ restart:
         }
         segment_retries = 0;
         just_opened = 1;
+
+        if (c->prefetch_segments) {
+            ret = prefetch_schedule(c, v);
+            if (ret < 0)
+                return ret;
+        }
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1696,7 +1848,7 @@ restart:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (!c->prefetch_segments && c->http_multiple == 1 && !v->input_next_requested &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1729,7 +1881,9 @@ restart:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch) {
+        ff_segprefetch_free(&v->cur_prefetch);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -2133,6 +2287,13 @@ static int hls_read_header(AVFormatContext *s)
     c->first_timestamp = AV_NOPTS_VALUE;
     c->cur_timestamp = AV_NOPTS_VALUE;
 
+#if !HAVE_THREADS
+    if (c->prefetch_segments) {
+        av_log(s, AV_LOG_WARNING, "Segment prefetching requires threading support, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+#endif
+
     if ((ret = ffio_copy_url_options(s->pb, &c->avio_opts)) < 0)
         return ret;
 
@@ -2284,6 +2445,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            ff_segprefetch_free(&pls->cur_prefetch);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2453,6 +2615,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            prefetch_free_all(pls);
             if (pls->is_subtitle)
                 avformat_close_input(&pls->ctx);
             pls->needed = 0;
@@ -2714,6 +2877,9 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        /* queued prefetches that are still ahead of the new position are
+         * kept, the others are dropped when the next segment is opened */
+        ff_segprefetch_free(&pls->cur_prefetch);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2824,6 +2990,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of upcoming segments to download in advance for each active playlist",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_buffer_size", "Maximum amount of memory used for the prefetched segments of a playlist",
+        OFFSET(prefetch_buffer_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT_MAX, FLAGS},
     {NULL}
 };
 
@@ -0,0 +1,688 @@
+/*
+ * On-disk cache of stream parameters and index entries
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * On-disk cache of stream parameters and index entries.
+ *
+ * A cache entry is keyed by the URL of a local file. It is only used if the
+ * size and modification time of the file, the demuxer and the streams created
+ * by read_header() all match the stored key. It then replaces the probing done
+ * by avformat_find_stream_info() and provides the index entries collected
+ * while the file was last read, for demuxers which do not build their own
+ * index in read_header(). Inputs to which streams are added after
+ * read_header(), e.g. MPEG-PS, are not cached.
+ *
+ * Layout, all values little-endian:
+ *   magic, version, key size, key, parameters size, parameters,
+ *   per stream: number of index entries, index entries
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/dict.h"
+#include "libavutil/mem.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
+#include "libavcodec/bytestream.h"
+
+#include "avformat.h"
+#include "avformat_internal.h"
+#include "avio.h"
+#include "indexcache.h"
+#include "internal.h"
+#include "os_support.h"
+#include "url.h"
+
+#define CACHE_MAGIC      MKTAG('F', 'F', 'I', 'X')
+#define CACHE_VERSION    1
+#define CACHE_MAX_SIZE   (256 << 20)
+#define CACHE_ENTRY_SIZE 28
+
+typedef struct CachedStream {
+    AVCodecParameters *par;
+    int64_t start_time;
+    int64_t duration;
+    int64_t nb_frames;
+    int64_t first_dts;
+    int disposition;
+    AVRational sample_aspect_ratio;
+    AVRational avg_frame_rate;
+    AVRational r_frame_rate;
+    int codec_info_nb_frames;
+    int nb_entries;
+} CachedStream;
+
+struct FFIndexCache {
+    char *path;                 ///< cache file name
+    uint8_t *key;               ///< serialized identity of the input
+    int key_size;
+    uint8_t *params;            ///< serialized stream parameters
+    int params_size;
+    int nb_streams;             ///< number of streams described by params
+    uint8_t *data;              ///< contents of a valid cache file
+    const uint8_t *index;       ///< index section within data
+    int index_size;
+    uint8_t *own_index;         ///< streams indexed by read_header()
+    int nb_own_index;
+    int *nb_cached_entries;     ///< index entries restored per stream
+    int dirty;                  ///< the cache file must be (re)written
+};
+
+static void write_string(AVIOContext *pb, const char *str)
+{
+    int len = str ? strlen(str) : 0;
+    avio_wl32(pb, len);
+    avio_write(pb, str, len);
+}
+
+static void write_rational(AVIOContext *pb, AVRational q)
+{
+    avio_wl32(pb, q.num);
+    avio_wl32(pb, q.den);
+}
+
+static AVRational get_rational(GetByteContext *g)
+{
+    AVRational q;
+    q.num = bytestream2_get_le32(g);
+    q.den = bytestream2_get_le32(g);
+    return q;
+}
+
+static int close_dyn_buf(AVIOContext *pb, uint8_t **buf, int *size)
+{
+    *size = avio_close_dyn_buf(pb, buf);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+static int build_key(AVFormatContext *s, FFIndexCache *c, const char *path)
+{
+    struct stat st;
+    AVIOContext *pb;
+    int ret;
+
+    if (stat(path, &st) < 0)
+        return AVERROR(errno);
+
+    if ((ret = avio_open_dyn_buf(&pb)) < 0)
+        return ret;
+    avio_wl64(pb, st.st_size);
+    avio_wl64(pb, st.st_mtime);
+    write_string(pb, s->url);
+    write_string(pb, s->iformat->name);
+    avio_wl64(pb, s->skip_initial_bytes);
+    avio_wl32(pb, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        avio_wl32(pb, st->id);
+        avio_wl32(pb, st->codecpar->codec_type);
+        avio_wl32(pb, st->codecpar->codec_id);
+        write_rational(pb, st->time_base);
+    }
+    return close_dyn_buf(pb, &c->key, &c->key_size);
+}
+
+static int build_path(AVFormatContext *s, FFIndexCache *c)
+{
+    struct AVSHA *sha = av_sha_alloc();
+    uint8_t digest[20];
+    char hex[2 * sizeof(digest) + 1];
+
+    if (!sha)
+        return AVERROR(ENOMEM);
+    av_sha_init(sha, 160);
+    av_sha_update(sha, s->url, strlen(s->url));
+    av_sha_final(sha, digest);
+    av_free(sha);
+    ff_data_to_hex(hex, digest, sizeof(digest), 1);
+    hex[2 * sizeof(digest)] = 0;
+
+    c->path = av_asprintf("%s/%s.ffidx", s->index_cache, hex);
+    return c->path ? 0 : AVERROR(ENOMEM);
+}
+
+static int load(AVFormatContext *s, FFIndexCache *c)
+{
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    GetByteContext g;
+    int64_t size;
+    unsigned key_size, params_size;
+    int ret;
+
+    av_dict_set(&opts, "protocol_whitelist", "file", 0);
+    ret = avio_open2(&pb, c->path, AVIO_FLAG_READ, &s->interrupt_callback, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    size = avio_size(pb);
+    if (size <= 0 || size > CACHE_MAX_SIZE) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    if (!(c->data = av_malloc(size))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avio_read(pb, c->data, size)) != size) {
+        ret = ret < 0 ? ret : AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    bytestream2_init(&g, c->data, size);
+    if (bytestream2_get_le32(&g) != CACHE_MAGIC ||
+        bytestream2_get_le32(&g) != CACHE_VERSION) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    key_size = bytestream2_get_le32(&g);
+    if (key_size != (unsigned)c->key_size || bytestream2_get_bytes_left(&g) < key_size ||
+        memcmp(g.buffer, c->key, key_size)) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+    bytestream2_skip(&g, key_size);
+
+    params_size = bytestream2_get_le32(&g);
+    if (!params_size || bytestream2_get_bytes_left(&g) < params_size) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    if (!(c->params = av_memdup(g.buffer, params_size))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    c->params_size = params_size;
+    bytestream2_skip(&g, params_size);
+
+    c->index      = g.buffer;
+    c->index_size = bytestream2_get_bytes_left(&g);
+    ret = 0;
+end:
+    avio_closep(&pb);
+    if (ret < 0) {
+        av_freep(&c->data);
+        av_freep(&c->params);
+        c->params_size = 0;
+    }
+    return ret;
+}
+
+void ff_index_cache_open(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    const char *proto, *path = s->url;
+    FFIndexCache *c;
+    int ret;
+
+    if (!s->index_cache || !*s->index_cache || !s->pb ||
+        (s->flags & AVFMT_FLAG_CUSTOM_IO) || (s->iformat->flags & AVFMT_NOFILE))
+        return;
+    proto = avio_find_protocol_name(s->url);
+    if (!proto || strcmp(proto, "file"))
+        return;
+    /* The entry is looked up with the streams created by read_header(),
+     * so it could never match if more are only found while reading. */
+    if (s->ctx_flags & AVFMTCTX_NOHEADER) {
+        av_log(s, AV_LOG_VERBOSE, "Not using the index cache, the streams are "
+               "not known from the header\n");
+        return;
+    }
+    av_strstart(path, "file:", &path);
+
+    if (!(c = av_mallocz(sizeof(*c))))
+        return;
+    si->index_cache = c;
+
+    if ((ret = build_key(s, c, path)) < 0 ||
+        (ret = build_path(s, c)) < 0)
+        goto fail;
+
+    c->own_index = av_calloc(s->nb_streams, sizeof(*c->own_index));
+    if (s->nb_streams && !c->own_index) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    c->nb_own_index = s->nb_streams;
+    for (unsigned i = 0; i < s->nb_streams; i++)
+        c->own_index[i] = ffstream(s->streams[i])->nb_index_entries > 0;
+
+    ret = load(s, c);
+    if (ret == AVERROR(ENOENT) || ret == AVERROR(EAGAIN))
+        av_log(s, AV_LOG_DEBUG, "No valid index cache in %s\n", c->path);
+    else if (ret < 0)
+        av_log(s, AV_LOG_WARNING, "Ignoring index cache %s: %s\n",
+               c->path, av_err2str(ret));
+    return;
+fail:
+    av_log(s, AV_LOG_WARNING, "Disabling the index cache: %s\n", av_err2str(ret));
+    ff_index_cache_free(&si->index_cache);
+}
+
+static void write_params(AVIOContext *pb, const AVStream *st)
+{
+    const FFStream *const sti = cffstream(st);
+    const AVCodecParameters *par = st->codecpar;
+    const AVChannelLayout *ch_layout = &par->ch_layout;
+
+    avio_wl64(pb, st->start_time);
+    avio_wl64(pb, st->duration);
+    avio_wl64(pb, st->nb_frames);
+    avio_wl64(pb, sti->first_dts);
+    avio_wl32(pb, st->disposition);
+    write_rational(pb, st->sample_aspect_ratio);
+    write_rational(pb, st->avg_frame_rate);
+    write_rational(pb, st->r_frame_rate);
+    avio_wl32(pb, sti->codec_info_nb_frames);
+
+    avio_wl32(pb, par->codec_type);
+    avio_wl32(pb, par->codec_id);
+    avio_wl32(pb, par->codec_tag);
+    avio_wl32(pb, par->format);
+    avio_wl64(pb, par->bit_rate);
+    avio_wl32(pb, par->bits_per_coded_sample);
+    avio_wl32(pb, par->bits_per_raw_sample);
+    avio_wl32(pb, par->profile);
+    avio_wl32(pb, par->level);
+    avio_wl32(pb, par->width);
+    avio_wl32(pb, par->height);
+    write_rational(pb, par->sample_aspect_ratio);
+    write_rational(pb, par->framerate);
+    avio_wl32(pb, par->field_order);
+    avio_wl32(pb, par->color_range);
+    avio_wl32(pb, par->color_primaries);
+    avio_wl32(pb, par->color_trc);
+    avio_wl32(pb, par->color_space);
+    avio_wl32(pb, par->chroma_location);
+    avio_wl32(pb, par->video_delay);
+    avio_wl32(pb, ch_layout->order);
+    avio_wl32(pb, ch_layout->nb_channels);
+    if (ch_layout->order == AV_CHANNEL_ORDER_CUSTOM) {
+        for (int i = 0; i < ch_layout->nb_channels; i++)
+            avio_wl32(pb, ch_layout->u.map[i].id);
+    } else
+        avio_wl64(pb, ch_layout->u.mask);
+    avio_wl32(pb, par->sample_rate);
+    avio_wl32(pb, par->block_align);
+    avio_wl32(pb, par->frame_size);
+    avio_wl32(pb, par->initial_padding);
+    avio_wl32(pb, par->trailing_padding);
+    avio_wl32(pb, par->seek_preroll);
+    avio_wl32(pb, par->alpha_mode);
+    avio_wl32(pb, par->extradata_size);
+    avio_write(pb, par->extradata, par->extradata_size);
+    avio_wl32(pb, par->nb_coded_side_data);
+    for (int i = 0; i < par->nb_coded_side_data; i++) {
+        const AVPacketSideData *sd = &par->coded_side_data[i];
+        avio_wl32(pb, sd->type);
+        avio_wl32(pb, sd->size);
+        avio_write(pb, sd->data, sd->size);
+    }
+}
+
+static int read_params(GetByteContext *g, CachedStream *st)
+{
+    AVCodecParameters *par = st->par;
+    AVChannelLayout *ch_layout = &par->ch_layout;
+    unsigned size, nb;
+    int ret;
+
+    st->start_time           = bytestream2_get_le64(g);
+    st->duration             = bytestream2_get_le64(g);
+    st->nb_frames            = bytestream2_get_le64(g);
+    st->first_dts            = bytestream2_get_le64(g);
+    st->disposition          = bytestream2_get_le32(g);
+    st->sample_aspect_ratio  = get_rational(g);
+    st->avg_frame_rate       = get_rational(g);
+    st->r_frame_rate         = get_rational(g);
+    st->codec_info_nb_frames = bytestream2_get_le32(g);
+
+    par->codec_type            = bytestream2_get_le32(g);
+    par->codec_id              = bytestream2_get_le32(g);
+    par->codec_tag             = bytestream2_get_le32(g);
+    par->format                = bytestream2_get_le32(g);
+    par->bit_rate              = bytestream2_get_le64(g);
+    par->bits_per_coded_sample = bytestream2_get_le32(g);
+    par->bits_per_raw_sample   = bytestream2_get_le32(g);
+    par->profile               = bytestream2_get_le32(g);
+    par->level                 = bytestream2_get_le32(g);
+    par->width                 = bytestream2_get_le32(g);
+    par->height                = bytestream2_get_le32(g);
+    par->sample_aspect_ratio   = get_rational(g);
+    par->framerate             = get_rational(g);
+    par->field_order           = bytestream2_get_le32(g);
+    par->color_range           = bytestream2_get_le32(g);
+    par->color_primaries       = bytestream2_get_le32(g);
+    par->color_trc             = bytestream2_get_le32(g);
+    par->color_space           = bytestream2_get_le32(g);
+    par->chroma_location       = bytestream2_get_le32(g);
+    par->video_delay           = bytestream2_get_le32(g);
+
+    if (par->codec_type < AVMEDIA_TYPE_UNKNOWN || par->codec_type >= AVMEDIA_TYPE_NB)
+        return AVERROR_INVALIDDATA;
+
+    av_channel_layout_uninit(ch_layout);
+    ch_layout->order       = bytestream2_get_le32(g);
+    ch_layout->nb_channels = bytestream2_get_le32(g);
+    if (ch_layout->order == AV_CHANNEL_ORDER_CUSTOM) {
+        nb = ch_layout->nb_channels;
+        if (nb > bytestream2_get_bytes_left(g) / 4)
+            return AVERROR_INVALIDDATA;
+        if ((ret = av_channel_layout_custom_init(ch_layout, nb)) < 0)
+            return ret;
+        for (unsigned i = 0; i < nb; i++)
+            ch_layout->u.map[i].id = bytestream2_get_le32(g);
+    } else
+        ch_layout->u.mask = bytestream2_get_le64(g);
+    if (ch_layout->nb_channels && !av_channel_layout_check(ch_layout))
+        return AVERROR_INVALIDDATA;
+
+    par->sample_rate      = bytestream2_get_le32(g);
+    par->block_align      = bytestream2_get_le32(g);
+    par->frame_size       = bytestream2_get_le32(g);
+    par->initial_padding  = bytestream2_get_le32(g);
+    par->trailing_padding = bytestream2_get_le32(g);
+    par->seek_preroll     = bytestream2_get_le32(g);
+    par->alpha_mode       = bytestream2_get_le32(g);
+
+    size = bytestream2_get_le32(g);
+    if (size) {
+        if (size > bytestream2_get_bytes_left(g))
+            return AVERROR_INVALIDDATA;
+        if ((ret = ff_alloc_extradata(par, size)) < 0)
+            return ret;
+        bytestream2_get_bufferu(g, par->extradata, size);
+    }
+
+    nb = bytestream2_get_le32(g);
+    for (unsigned i = 0; i < nb; i++) {
+        enum AVPacketSideDataType type = bytestream2_get_le32(g);
+        AVPacketSideData *sd;
+
+        size = bytestream2_get_le32(g);
+        if (size > bytestream2_get_bytes_left(g))
+            return AVERROR_INVALIDDATA;
+        sd = av_packet_side_data_new(&par->coded_side_data, &par->nb_coded_side_data,
+                                     type, size, 0);
+        if (!sd)
+            return AVERROR(ENOMEM);
+        bytestream2_get_bufferu(g, sd->data, size);
+    }
+    return 0;
+}
+
+void ff_index_cache_update_params(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    FFIndexCache *c = si->index_cache;
+    AVIOContext *pb;
+    int *nb_cached_entries;
+
+    if (!c)
+        return;
+    if (s->nb_streams != c->nb_own_index) {
+        av_log(s, AV_LOG_VERBOSE, "Not using the index cache, streams were "
+               "added after the header\n");
+        ff_index_cache_free(&si->index_cache);
+        return;
+    }
+
+    nb_cached_entries = av_calloc(s->nb_streams, sizeof(*nb_cached_entries));
+    if (s->nb_streams && !nb_cached_entries)
+        return;
+    if (avio_open_dyn_buf(&pb) < 0) {
+        av_free(nb_cached_entries);
+        return;
+    }
+
+    avio_wl64(pb, s->start_time);
+    avio_wl64(pb, s->duration);
+    avio_wl64(pb, s->bit_rate);
+    avio_wl32(pb, s->duration_estimation_method);
+    avio_wl32(pb, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++)
+        write_params(pb, s->streams[i]);
+    avio_wl32(pb, CACHE_MAGIC);
+
+    av_freep(&c->params);
+    av_freep(&c->nb_cached_entries);
+    if (close_dyn_buf(pb, &c->params, &c->params_size) < 0) {
+        av_free(nb_cached_entries);
+        return;
+    }
+    c->nb_cached_entries = nb_cached_entries;
+    c->nb_streams        = s->nb_streams;
+    c->dirty             = 1;
+}
+
+int ff_index_cache_restore(AVFormatContext *s)
+{
+    FFIndexCache *c = ffformatcontext(s)->index_cache;
+    CachedStream *cs = NULL;
+    GetByteContext g, gi;
+    int64_t start_time, duration, bit_rate;
+    int method, ret = AVERROR_INVALIDDATA;
+    unsigned nb_streams = 0;
+
+    if (!c || !c->data)
+        return 0;
+
+    bytestream2_init(&g, c->params, c->params_size);
+    start_time = bytestream2_get_le64(&g);
+    duration   = bytestream2_get_le64(&g);
+    bit_rate   = bytestream2_get_le64(&g);
+    method     = bytestream2_get_le32(&g);
+    if (bytestream2_get_le32(&g) != s->nb_streams)
+        goto end;
+    nb_streams = s->nb_streams;
+
+    av_freep(&c->nb_cached_entries);
+    cs                   = av_calloc(nb_streams, sizeof(*cs));
+    c->nb_cached_entries = av_calloc(nb_streams, sizeof(*c->nb_cached_entries));
+    if (nb_streams && (!cs || !c->nb_cached_entries)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* Parse everything before touching the streams, so that a damaged
+     * cache file leaves them as read_header() created them. */
+    for (unsigned i = 0; i < nb_streams; i++) {
+        if (!(cs[i].par = avcodec_parameters_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = read_params(&g, &cs[i])) < 0)
+            goto end;
+    }
+    if (bytestream2_get_le32(&g) != CACHE_MAGIC) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    bytestream2_init(&gi, c->index, c->index_size);
+    for (unsigned i = 0; i < nb_streams; i++) {
+        cs[i].nb_entries = bytestream2_get_le32(&gi);
+        if (cs[i].nb_entries < 0 ||
+            cs[i].nb_entries > bytestream2_get_bytes_left(&gi) / CACHE_ENTRY_SIZE) {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        bytestream2_skip(&gi, cs[i].nb_entries * CACHE_ENTRY_SIZE);
+    }
+
+    bytestream2_init(&gi, c->index, c->index_size);
+    for (unsigned i = 0; i < nb_streams; i++) {
+        AVStream *const st  = s->streams[i];
+        FFStream *const sti = ffstream(st);
+
+        if ((ret = avcodec_parameters_copy(st->codecpar, cs[i].par)) < 0)
+            goto end;
+        st->start_time           = cs[i].start_time;
+        st->duration             = cs[i].duration;
+        st->nb_frames            = cs[i].nb_frames;
+        st->disposition          = cs[i].disposition;
+        st->sample_aspect_ratio  = cs[i].sample_aspect_ratio;
+        st->avg_frame_rate       = cs[i].avg_frame_rate;
+        st->r_frame_rate         = cs[i].r_frame_rate;
+        sti->codec_info_nb_frames = cs[i].codec_info_nb_frames;
+        /* The first packets now reach the caller without being buffered
+         * until their timestamps are known, so start from the same dts
+         * avformat_find_stream_info() assigned to them. */
+        if (cs[i].first_dts != AV_NOPTS_VALUE && !is_relative(cs[i].first_dts))
+            sti->first_dts = sti->cur_dts = cs[i].first_dts;
+        sti->need_context_update  = 1;
+        if (sti->request_probe > 0 && st->codecpar->codec_id != AV_CODEC_ID_NONE)
+            sti->request_probe = -1;
+
+        bytestream2_skip(&gi, 4);
+        if (cs[i].nb_entries && !sti->nb_index_entries) {
+            AVIndexEntry *entries = av_malloc_array(cs[i].nb_entries, sizeof(*entries));
+            if (!entries) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            for (int j = 0; j < cs[i].nb_entries; j++) {
+                entries[j].pos          = bytestream2_get_le64u(&gi);
+                entries[j].timestamp    = bytestream2_get_le64u(&gi);
+                entries[j].flags        = bytestream2_get_le32u(&gi) & 3;
+                entries[j].size         = bytestream2_get_le32u(&gi);
+                entries[j].min_distance = bytestream2_get_le32u(&gi);
+            }
+            av_free(sti->index_entries);
+            sti->index_entries                = entries;
+            sti->nb_index_entries             = cs[i].nb_entries;
+            sti->index_entries_allocated_size = cs[i].nb_entries * sizeof(*entries);
+        } else
+            bytestream2_skip(&gi, cs[i].nb_entries * CACHE_ENTRY_SIZE);
+        c->nb_cached_entries[i] = sti->nb_index_entries;
+    }
+    s->start_time                 = start_time;
+    s->duration                   = duration;
+    s->bit_rate                   = bit_rate;
+    s->duration_estimation_method = method;
+    c->nb_streams                 = nb_streams;
+    ret = 1;
+
+    av_log(s, AV_LOG_VERBOSE, "Restored stream parameters from index cache %s\n", c->path);
+end:
+    for (unsigned i = 0; cs && i < nb_streams; i++)
+        avcodec_parameters_free(&cs[i].par);
+    av_free(cs);
+    av_freep(&c->data);
+    if (ret < 0) {
+        av_log(s, AV_LOG_WARNING, "Ignoring index cache %s: %s\n",
+               c->path, av_err2str(ret));
+        return 0;
+    }
+    return ret;
+}
+
+static int store(AVFormatContext *s, FFIndexCache *c)
+{
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    char *tmp;
+    int ret;
+
+    tmp = av_asprintf("%s.%08"PRIx32".tmp", c->path, av_get_random_seed());
+    if (!tmp)
+        return AVERROR(ENOMEM);
+
+    av_dict_set(&opts, "protocol_whitelist", "file", 0);
+    ret = avio_open2(&pb, tmp, AVIO_FLAG_WRITE, &s->interrupt_callback, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    avio_wl32(pb, CACHE_MAGIC);
+    avio_wl32(pb, CACHE_VERSION);
+    avio_wl32(pb, c->key_size);
+    avio_write(pb, c->key, c->key_size);
+    avio_wl32(pb, c->params_size);
+    avio_write(pb, c->params, c->params_size);
+    for (int i = 0; i < c->nb_streams; i++) {
+        const FFStream *const sti = ffstream(s->streams[i]);
+        int nb = i < c->nb_own_index && c->own_index[i] ? 0 : sti->nb_index_entries;
+
+        avio_wl32(pb, nb);
+        for (int j = 0; j < nb; j++) {
+            const AVIndexEntry *e = &sti->index_entries[j];
+            avio_wl64(pb, e->pos);
+            avio_wl64(pb, e->timestamp);
+            avio_wl32(pb, e->flags & 3);
+            avio_wl32(pb, e->size);
+            avio_wl32(pb, e->min_distance);
+        }
+    }
+    avio_flush(pb);
+    ret = pb->error;
+    avio_closep(&pb);
+    if (ret >= 0)
+        ret = ff_rename(tmp, c->path, s);
+    if (ret < 0)
+        ffurl_delete(tmp);
+end:
+    av_free(tmp);
+    return ret;
+}
+
+void ff_index_cache_close(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    FFIndexCache *c = si->index_cache;
+    int ret;
+
+    if (!c)
+        return;
+
+    if (c->params && !c->dirty) {
+        for (int i = 0; i < c->nb_streams; i++) {
+            if ((i >= c->nb_own_index || !c->own_index[i]) &&
+                ffstream(s->streams[i])->nb_index_entries > c->nb_cached_entries[i])
+                c->dirty = 1;
+        }
+    }
+    if (c->params && c->dirty && (ret = store(s, c)) < 0)
+        av_log(s, AV_LOG_WARNING, "Could not write index cache %s: %s\n",
+               c->path, av_err2str(ret));
+
+    ff_index_cache_free(&si->index_cache);
+}
+
+void ff_index_cache_free(FFIndexCache **pc)
+{
+    FFIndexCache *c = *pc;
+
+    if (!c)
+        return;
+    av_freep(&c->path);
+    av_freep(&c->key);
+    av_freep(&c->params);
+    av_freep(&c->data);
+    av_freep(&c->own_index);
+    av_freep(&c->nb_cached_entries);
+    av_freep(pc);
+}
@@ -0,0 +1,57 @@
+/*
+ * On-disk cache of stream parameters and index entries
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_INDEXCACHE_H
+#define AVFORMAT_INDEXCACHE_H
+
+#include "avformat.h"
+
+typedef struct FFIndexCache FFIndexCache;
+
+/**
+ * Look up the cache entry of the input opened in s, if AVFormatContext.index_cache
+ * is set. Must be called after read_header() created the streams.
+ * Failures only disable the cache and are not reported to the caller.
+ */
+void ff_index_cache_open(AVFormatContext *s);
+
+/**
+ * Restore the stream parameters and index entries of a valid cache entry.
+ *
+ * @return 1 if the streams were restored and probing them can be skipped,
+ *         0 otherwise
+ */
+int ff_index_cache_restore(AVFormatContext *s);
+
+/**
+ * Remember the stream parameters found by avformat_find_stream_info(),
+ * to be stored when the input is closed. The cache is disabled if streams
+ * were added since read_header().
+ */
+void ff_index_cache_update_params(AVFormatContext *s);
+
+/**
+ * Store the cache entry if it is new or the index grew, then free it.
+ */
+void ff_index_cache_close(AVFormatContext *s);
+
+void ff_index_cache_free(FFIndexCache **pc);
+
+#endif /* AVFORMAT_INDEXCACHE_H */
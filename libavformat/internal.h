@@ -118,6 +118,11 @@ typedef struct FFFormatContext {
     AVDictionary *id3v2_meta;
 
     int missing_streams;
+
+    /**
+     * On-disk cache of the stream parameters and index, demuxing only.
+     */
+    struct FFIndexCache *index_cache;
 } FFFormatContext;
 
 static av_always_inline FFFormatContext *ffformatcontext(AVFormatContext *s)
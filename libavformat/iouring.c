@@ -0,0 +1,799 @@
+/*
+ * io_uring based read-ahead / write-behind protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * io_uring based asynchronous I/O on the file descriptor of another protocol
+ *
+ * The nested protocol (file, pipe, tcp, unix, udp...) is only used to open
+ * and close the descriptor. Reads are issued ahead of the caller into a ring
+ * of buffers, writes are queued and completed behind the caller, all
+ * from the calling thread.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+#include "url.h"
+
+#define POLL_USER_DATA    UINT64_MAX
+#define TIMEOUT_USER_DATA (UINT64_MAX - 1)
+#define CANCEL_USER_DATA  (UINT64_MAX - 2)
+#define WAIT_TIMEOUT_NS 100000000
+
+enum IOURingBufferState {
+    BUF_FREE,       ///< unused, or being filled by the writer
+    BUF_FILLED,     ///< full write buffer waiting for a submission slot
+    BUF_PENDING,    ///< request submitted to the kernel
+    BUF_READY,      ///< read completed, data available to the caller
+};
+
+typedef struct IOURingBuffer {
+    uint8_t *data;
+    int64_t pos;    ///< file offset of data[0], unused for streams
+    int size;       ///< bytes requested (read) or filled (write)
+    int done;       ///< bytes written so far
+    int result;     ///< bytes read, or an AVERROR code
+    int consumed;   ///< bytes of a completed read returned to the caller
+    enum IOURingBufferState state;
+} IOURingBuffer;
+
+typedef struct IOURingContext {
+    const AVClass *class;
+    URLContext *inner;
+
+    int nb_buffers;
+    int buffer_size;
+
+    int fd;
+    int write;
+    int seekable;
+    int packetized;
+    int fixed;
+    int poll_first;
+    int max_inflight;
+
+    int ring_fd;
+    unsigned features;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_array;
+    unsigned sq_mask, sq_entries;
+    unsigned *cq_head, *cq_tail;
+    struct io_uring_cqe *cqes;
+    unsigned cq_mask;
+    unsigned sqe_tail;
+    unsigned to_submit;
+    struct __kernel_timespec timeout_ts;
+    int timeout_armed;  ///< a wait timeout request is owned by the kernel
+
+    uint8_t *pool;
+    IOURingBuffer *bufs;
+    int head;       ///< oldest buffer in stream order
+    int nb_queued;  ///< buffers in use starting at head
+    int inflight;   ///< requests owned by the kernel
+
+    int64_t pos;        ///< position of the caller
+    int64_t next_pos;   ///< offset of the next read-ahead request
+    int eof;
+    int error;
+    int closing;        ///< requests are being cancelled, do not resubmit
+} IOURingContext;
+
+static int ring_setup(URLContext *h, unsigned entries)
+{
+    IOURingContext *c = h->priv_data;
+    struct io_uring_params p = { 0 };
+    uint8_t *sq, *cq;
+
+    c->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (c->ring_fd < 0) {
+        int ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "io_uring_setup failed: %s\n", av_err2str(ret));
+        return ret;
+    }
+    c->features = p.features;
+
+    c->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    c->cq_map_size = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        c->sq_map_size = c->cq_map_size = FFMAX(c->sq_map_size, c->cq_map_size);
+
+    c->sq_map = mmap(NULL, c->sq_map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_SQ_RING);
+    if (c->sq_map == MAP_FAILED) {
+        c->sq_map = NULL;
+        return AVERROR(errno);
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        c->cq_map = c->sq_map;
+    } else {
+        c->cq_map = mmap(NULL, c->cq_map_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_CQ_RING);
+        if (c->cq_map == MAP_FAILED) {
+            c->cq_map = NULL;
+            return AVERROR(errno);
+        }
+    }
+    c->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    c->sqes = mmap(NULL, c->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_SQES);
+    if (c->sqes == MAP_FAILED) {
+        c->sqes = NULL;
+        return AVERROR(errno);
+    }
+
+    sq = c->sq_map;
+    cq = c->cq_map;
+    c->sq_head    = (unsigned *)(sq + p.sq_off.head);
+    c->sq_tail    = (unsigned *)(sq + p.sq_off.tail);
+    c->sq_array   = (unsigned *)(sq + p.sq_off.array);
+    c->sq_mask    = *(unsigned *)(sq + p.sq_off.ring_mask);
+    c->sq_entries = p.sq_entries;
+    c->cq_head    = (unsigned *)(cq + p.cq_off.head);
+    c->cq_tail    = (unsigned *)(cq + p.cq_off.tail);
+    c->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    c->cq_mask    = *(unsigned *)(cq + p.cq_off.ring_mask);
+    c->sqe_tail   = *c->sq_tail;
+
+    return 0;
+}
+
+static void ring_free(IOURingContext *c)
+{
+    if (c->sqes)
+        munmap(c->sqes, c->sqes_size);
+    if (c->cq_map && c->cq_map != c->sq_map)
+        munmap(c->cq_map, c->cq_map_size);
+    if (c->sq_map)
+        munmap(c->sq_map, c->sq_map_size);
+    if (c->ring_fd >= 0)
+        close(c->ring_fd);
+    c->sqes   = NULL;
+    c->sq_map = c->cq_map = NULL;
+    c->ring_fd = -1;
+}
+
+static struct io_uring_sqe *get_sqe(IOURingContext *c);
+
+/**
+ * Submit the queued requests and optionally wait for one completion,
+ * at most WAIT_TIMEOUT_NS so that the interrupt callback is polled.
+ */
+static int ring_enter(IOURingContext *c, int wait)
+{
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    void *arg = NULL;
+    size_t arg_size = 0;
+    int ret;
+#ifdef IORING_FEAT_EXT_ARG
+    struct __kernel_timespec ts = { .tv_nsec = WAIT_TIMEOUT_NS };
+    struct io_uring_getevents_arg ext = { .ts = (uintptr_t)&ts };
+
+    if (wait && (c->features & IORING_FEAT_EXT_ARG)) {
+        flags   |= IORING_ENTER_EXT_ARG;
+        arg      = &ext;
+        arg_size = sizeof(ext);
+    }
+#endif
+
+    if (!c->to_submit && !wait)
+        return 0;
+
+    /* Without a wait timeout (before Linux 5.11), a timeout request
+     * completes instead of the awaited one if that takes too long. */
+    if (wait && !arg && !c->timeout_armed) {
+        struct io_uring_sqe *sqe = get_sqe(c);
+
+        c->timeout_ts.tv_sec  = 0;
+        c->timeout_ts.tv_nsec = WAIT_TIMEOUT_NS;
+        sqe->opcode    = IORING_OP_TIMEOUT;
+        sqe->addr      = (uintptr_t)&c->timeout_ts;
+        sqe->len       = 1;
+        sqe->user_data = TIMEOUT_USER_DATA;
+        c->timeout_armed = 1;
+    }
+
+    atomic_store_explicit((atomic_uint *)c->sq_tail, c->sqe_tail, memory_order_release);
+    ret = syscall(__NR_io_uring_enter, c->ring_fd, c->to_submit, wait, flags, arg, arg_size);
+    if (ret < 0) {
+        ret = errno;
+        if (ret == ETIME || ret == EINTR || ret == EAGAIN || ret == EBUSY)
+            return 0;
+        return AVERROR(ret);
+    }
+    c->to_submit -= FFMIN(ret, c->to_submit);
+    return 0;
+}
+
+static struct io_uring_sqe *get_sqe(IOURingContext *c)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    /* Only happens with more retries queued than the ring can hold. */
+    while (c->sqe_tail - atomic_load_explicit((atomic_uint *)c->sq_head,
+                                              memory_order_acquire) >= c->sq_entries)
+        ring_enter(c, 0);
+
+    idx = c->sqe_tail & c->sq_mask;
+    sqe = &c->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    c->sq_array[idx] = idx;
+    c->sqe_tail++;
+    c->to_submit++;
+    return sqe;
+}
+
+static void queue_request(IOURingContext *c, int idx)
+{
+    IOURingBuffer *b = &c->bufs[idx];
+    struct io_uring_sqe *sqe;
+
+    if (c->poll_first) {
+        /* Nonblocking descriptors fail with EAGAIN instead of being
+         * polled by the kernel, so wait for readiness in the same chain. */
+        uint32_t events = c->write ? POLLOUT : POLLIN;
+
+        sqe = get_sqe(c);
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->fd            = c->fd;
+        sqe->flags         = IOSQE_IO_LINK;
+#if HAVE_BIGENDIAN
+        events = events << 16 | events >> 16;
+#endif
+        sqe->poll32_events = events;
+        sqe->user_data     = POLL_USER_DATA;
+    }
+
+    sqe = get_sqe(c);
+    if (c->write)
+        sqe->opcode = c->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    else
+        sqe->opcode = c->fixed ? IORING_OP_READ_FIXED  : IORING_OP_READ;
+    sqe->fd        = c->fd;
+    sqe->off       = c->seekable ? b->pos + b->done : (uint64_t)-1;
+    sqe->addr      = (uintptr_t)(b->data + b->done);
+    sqe->len       = b->size - b->done;
+    sqe->buf_index = idx;
+    sqe->user_data = idx;
+
+    b->state = BUF_PENDING;
+}
+
+static void release_written(IOURingContext *c)
+{
+    while (c->nb_queued && c->bufs[c->head].state == BUF_FREE) {
+        c->head = (c->head + 1) % c->nb_buffers;
+        c->nb_queued--;
+    }
+}
+
+static void handle_completion(URLContext *h, uint64_t user_data, int res)
+{
+    IOURingContext *c = h->priv_data;
+    IOURingBuffer *b;
+
+    if (user_data == TIMEOUT_USER_DATA)
+        c->timeout_armed = 0;
+    if (user_data >= CANCEL_USER_DATA)
+        return;
+    av_assert0(user_data < c->nb_buffers);
+    b = &c->bufs[user_data];
+
+    if (c->closing) {
+        c->inflight--;
+        return;
+    }
+
+    if (res == -EAGAIN || res == -EINTR) {
+        c->poll_first = 1;
+        queue_request(c, user_data);
+        return;
+    }
+
+    if (!c->write) {
+        b->result = res < 0 ? AVERROR(-res) : res;
+        b->state  = BUF_READY;
+        if (res <= 0)
+            c->eof = 1;
+        c->inflight--;
+        return;
+    }
+
+    if (res > 0 && b->done + res < b->size) {
+        b->done += res;
+        queue_request(c, user_data);
+        return;
+    }
+    if (res <= 0 && !c->error) {
+        c->error = res < 0 ? AVERROR(-res) : AVERROR(EIO);
+        av_log(h, AV_LOG_ERROR, "Write failed: %s\n", av_err2str(c->error));
+    }
+    b->state = BUF_FREE;
+    b->size  = 0;
+    c->inflight--;
+    release_written(c);
+}
+
+static int reap_completions(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+    unsigned head = *c->cq_head;
+    unsigned tail = atomic_load_explicit((atomic_uint *)c->cq_tail, memory_order_acquire);
+    int n = 0;
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &c->cqes[head & c->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        atomic_store_explicit((atomic_uint *)c->cq_head, head, memory_order_release);
+        handle_completion(h, user_data, res);
+        n += user_data != TIMEOUT_USER_DATA;
+        tail = atomic_load_explicit((atomic_uint *)c->cq_tail, memory_order_acquire);
+    }
+    return n;
+}
+
+static int wait_completion(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+    int64_t wait_start = 0;
+    int ret;
+
+    av_assert0(c->inflight > 0);
+    for (;;) {
+        if (reap_completions(h))
+            return 0;
+        if (ff_check_interrupt(&h->interrupt_callback))
+            return AVERROR_EXIT;
+        if (h->rw_timeout) {
+            if (!wait_start)
+                wait_start = av_gettime_relative();
+            else if (av_gettime_relative() - wait_start > h->rw_timeout)
+                return AVERROR(ETIMEDOUT);
+        }
+        if ((ret = ring_enter(c, 1)) < 0)
+            return ret;
+    }
+}
+
+static void submit_reads(IOURingContext *c)
+{
+    while (!c->eof && c->nb_queued < c->nb_buffers &&
+           c->inflight < c->max_inflight) {
+        int idx = (c->head + c->nb_queued) % c->nb_buffers;
+        IOURingBuffer *b = &c->bufs[idx];
+
+        b->pos      = c->next_pos;
+        b->size     = c->buffer_size;
+        b->done     = 0;
+        b->result   = 0;
+        b->consumed = 0;
+        queue_request(c, idx);
+        c->next_pos += c->buffer_size;
+        c->nb_queued++;
+        c->inflight++;
+    }
+}
+
+static void submit_writes(IOURingContext *c)
+{
+    for (int i = 0; i < c->nb_queued && c->inflight < c->max_inflight; i++) {
+        int idx = (c->head + i) % c->nb_buffers;
+
+        if (c->bufs[idx].state == BUF_FILLED) {
+            queue_request(c, idx);
+            c->inflight++;
+        }
+    }
+}
+
+/**
+ * Wait for all requests, drop any read-ahead data and restart at pos.
+ */
+static int reset_reads(URLContext *h, int64_t pos)
+{
+    IOURingContext *c = h->priv_data;
+    int ret;
+
+    while (c->inflight)
+        if ((ret = wait_completion(h)) < 0)
+            return ret;
+    for (int i = 0; i < c->nb_buffers; i++)
+        c->bufs[i].state = BUF_FREE;
+    c->head      = 0;
+    c->nb_queued = 0;
+    c->eof       = 0;
+    c->pos       = pos;
+    c->next_pos  = pos;
+    return 0;
+}
+
+static int queue_write(URLContext *h, int wait_for_slot)
+{
+    IOURingContext *c = h->priv_data;
+    IOURingBuffer *b = &c->bufs[(c->head + c->nb_queued) % c->nb_buffers];
+    int ret;
+
+    b->done  = 0;
+    b->state = BUF_FILLED;
+    c->nb_queued++;
+    submit_writes(c);
+    if ((ret = ring_enter(c, 0)) < 0)
+        return ret;
+
+    while (wait_for_slot && c->nb_queued == c->nb_buffers) {
+        if ((ret = wait_completion(h)) < 0)
+            return ret;
+        submit_writes(c);
+    }
+    return 0;
+}
+
+static int flush_writes(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+    int ret;
+
+    if (c->nb_queued < c->nb_buffers &&
+        c->bufs[(c->head + c->nb_queued) % c->nb_buffers].size > 0)
+        if ((ret = queue_write(h, 0)) < 0)
+            return ret;
+
+    while (c->nb_queued) {
+        submit_writes(c);
+        if ((ret = ring_enter(c, 0)) < 0 ||
+            (ret = wait_completion(h)) < 0)
+            return ret;
+    }
+    return c->error;
+}
+
+static int iouring_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
+{
+    IOURingContext *c = h->priv_data;
+    struct iovec *iov = NULL;
+    int ret;
+
+    c->ring_fd = -1;
+    av_strstart(arg, "iouring:", &arg);
+
+    if ((flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE) {
+        av_log(h, AV_LOG_ERROR, "Simultaneous reading and writing is not supported\n");
+        return AVERROR(ENOSYS);
+    }
+
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        return ret;
+
+    c->fd = ffurl_get_file_handle(c->inner);
+    if (c->fd < 0) {
+        av_log(h, AV_LOG_ERROR, "Protocol '%s' does not expose a file descriptor\n",
+               c->inner->prot->name);
+        ret = AVERROR(ENOSYS);
+        goto fail;
+    }
+
+    c->write        = !!(flags & AVIO_FLAG_WRITE);
+    c->seekable     = !c->inner->is_streamed;
+    c->packetized   = c->inner->max_packet_size > 0;
+    /* Requests on a stream complete in submission order only one at a time. */
+    c->max_inflight = c->seekable ? c->nb_buffers : 1;
+    if (c->packetized) {
+        c->buffer_size     = FFMAX(c->buffer_size, c->inner->max_packet_size);
+        h->max_packet_size = c->inner->max_packet_size;
+    }
+    h->is_streamed = c->inner->is_streamed;
+
+    if ((ret = ring_setup(h, 2 * c->nb_buffers)) < 0)
+        goto fail;
+
+    c->bufs = av_calloc(c->nb_buffers, sizeof(*c->bufs));
+    c->pool = av_malloc((size_t)c->nb_buffers * c->buffer_size);
+    iov     = av_calloc(c->nb_buffers, sizeof(*iov));
+    if (!c->bufs || !c->pool || !iov) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < c->nb_buffers; i++) {
+        c->bufs[i].data = c->pool + (size_t)i * c->buffer_size;
+        iov[i].iov_base = c->bufs[i].data;
+        iov[i].iov_len  = c->buffer_size;
+    }
+
+    c->fixed = syscall(__NR_io_uring_register, c->ring_fd, IORING_REGISTER_BUFFERS,
+                       iov, c->nb_buffers) >= 0;
+    if (!c->fixed)
+        av_log(h, AV_LOG_VERBOSE, "Could not register buffers: %s\n",
+               av_err2str(AVERROR(errno)));
+    av_freep(&iov);
+
+    if (!c->write) {
+        submit_reads(c);
+        if ((ret = ring_enter(c, 0)) < 0)
+            goto fail;
+    }
+    return 0;
+
+fail:
+    av_freep(&iov);
+    ring_free(c);
+    av_freep(&c->bufs);
+    av_freep(&c->pool);
+    ffurl_closep(&c->inner);
+    return ret;
+}
+
+static int iouring_read(URLContext *h, unsigned char *buf, int size)
+{
+    IOURingContext *c = h->priv_data;
+    IOURingBuffer *b;
+    int len, ret;
+
+    reap_completions(h);
+    submit_reads(c);
+    if ((ret = ring_enter(c, 0)) < 0)
+        return ret;
+    if (!c->nb_queued)
+        return AVERROR_EOF;
+
+    b = &c->bufs[c->head];
+    while (b->state == BUF_PENDING) {
+        if (h->flags & AVIO_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+        if ((ret = wait_completion(h)) < 0)
+            return ret;
+    }
+    if (b->result < 0)
+        return b->result;
+    if (!b->result)
+        return AVERROR_EOF;
+
+    len = FFMIN(size, b->result - b->consumed);
+    memcpy(buf, b->data + b->consumed, len);
+    b->consumed += len;
+    c->pos      += len;
+
+    if (b->consumed == b->result) {
+        int short_read = c->seekable && b->result < b->size;
+
+        b->state  = BUF_FREE;
+        c->head   = (c->head + 1) % c->nb_buffers;
+        c->nb_queued--;
+        /* The following requests were issued assuming a full read. */
+        if (short_read && (ret = reset_reads(h, c->pos)) < 0)
+            return ret;
+        submit_reads(c);
+        if ((ret = ring_enter(c, 0)) < 0)
+            return ret;
+    }
+    return len;
+}
+
+static int iouring_write(URLContext *h, const unsigned char *buf, int size)
+{
+    IOURingContext *c = h->priv_data;
+    int written = 0, ret;
+
+    reap_completions(h);
+    if (c->error)
+        return c->error;
+    if (c->packetized && size > c->buffer_size)
+        return AVERROR(EINVAL);
+
+    while (written < size) {
+        IOURingBuffer *b = &c->bufs[(c->head + c->nb_queued) % c->nb_buffers];
+        int len = FFMIN(size - written, c->buffer_size - b->size);
+
+        if (!b->size)
+            b->pos = c->pos;
+        memcpy(b->data + b->size, buf + written, len);
+        b->size += len;
+        written += len;
+        c->pos  += len;
+
+        if (b->size == c->buffer_size || c->packetized)
+            if ((ret = queue_write(h, 1)) < 0)
+                return ret;
+    }
+    return size;
+}
+
+static int64_t iouring_seek(URLContext *h, int64_t pos, int whence)
+{
+    IOURingContext *c = h->priv_data;
+    int ret;
+
+    if (c->write && (ret = flush_writes(h)) < 0)
+        return ret;
+
+    if (whence == AVSEEK_SIZE)
+        return ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+    if (!c->seekable)
+        return AVERROR(ESPIPE);
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += c->pos;
+        break;
+    case SEEK_END: {
+        int64_t size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+        if (size < 0)
+            return size;
+        pos += size;
+        break;
+    }
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    if (c->write) {
+        c->pos = pos;
+        return pos;
+    }
+
+    /* Seeking inside the data read ahead keeps the requests in flight. */
+    for (int i = 0; i < c->nb_queued; i++) {
+        IOURingBuffer *b = &c->bufs[(c->head + i) % c->nb_buffers];
+
+        if (b->state != BUF_READY || b->result <= 0)
+            break;
+        if (pos >= b->pos && pos < b->pos + b->result) {
+            while (i--) {
+                c->bufs[c->head].state = BUF_FREE;
+                c->head = (c->head + 1) % c->nb_buffers;
+                c->nb_queued--;
+            }
+            b->consumed = pos - b->pos;
+            c->pos      = pos;
+            return pos;
+        }
+    }
+
+    if ((ret = reset_reads(h, pos)) < 0)
+        return ret;
+    submit_reads(c);
+    if ((ret = ring_enter(c, 0)) < 0)
+        return ret;
+    return pos;
+}
+
+static int iouring_get_file_handle(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+    return c->fd;
+}
+
+/**
+ * Cancel the requests still owned by the kernel and wait until they are
+ * all completed, so that the buffers can be freed.
+ */
+static void cancel_requests(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+
+    c->closing = 1;
+    reap_completions(h);
+    for (int i = 0; i < c->nb_buffers && c->inflight; i++) {
+        struct io_uring_sqe *sqe;
+
+        if (c->bufs[i].state != BUF_PENDING)
+            continue;
+        /* A request linked to a poll is only started once the poll
+         * completes, cancelling the poll cancels the whole chain. */
+        if (c->poll_first) {
+            sqe = get_sqe(c);
+            sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+            sqe->addr      = POLL_USER_DATA;
+            sqe->user_data = CANCEL_USER_DATA;
+        }
+        sqe = get_sqe(c);
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = i;
+        sqe->user_data = CANCEL_USER_DATA;
+    }
+    while (c->inflight) {
+        if (ring_enter(c, 1) < 0) {
+            /* The kernel may still write to the buffers. */
+            av_log(h, AV_LOG_ERROR, "Could not cancel %d requests\n", c->inflight);
+            c->pool = NULL;
+            break;
+        }
+        reap_completions(h);
+    }
+}
+
+static int iouring_close(URLContext *h)
+{
+    IOURingContext *c = h->priv_data;
+    int ret = 0;
+
+    if (c->write)
+        ret = flush_writes(h);
+    if (c->inflight)
+        cancel_requests(h);
+    ring_free(c);
+    av_freep(&c->bufs);
+    av_freep(&c->pool);
+    ffurl_closep(&c->inner);
+    return ret;
+}
+
+#define OFFSET(x) offsetof(IOURingContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+#define E AV_OPT_FLAG_ENCODING_PARAM
+
+static const AVOption options[] = {
+    { "buffers",     "number of requests kept in flight", OFFSET(nb_buffers),  AV_OPT_TYPE_INT, { .i64 = 4 },         2, 256,         D|E },
+    { "buffer_size", "size of each request in bytes",     OFFSET(buffer_size), AV_OPT_TYPE_INT, { .i64 = 256 * 1024 }, 4096, 64 << 20, D|E },
+    { NULL }
+};
+
+#undef D
+#undef E
+#undef OFFSET
+
+static const AVClass iouring_context_class = {
+    .class_name = "iouring",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const URLProtocol ff_iouring_protocol = {
+    .name                = "iouring",
+    .url_open2           = iouring_open,
+    .url_read            = iouring_read,
+    .url_write           = iouring_write,
+    .url_seek            = iouring_seek,
+    .url_close           = iouring_close,
+    .url_get_file_handle = iouring_get_file_handle,
+    .priv_data_size      = sizeof(IOURingContext),
+    .priv_data_class     = &iouring_context_class,
+};
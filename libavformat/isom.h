@@ -284,6 +284,8 @@ typedef struct MOVStreamContext {
 
     struct IAMFDemuxContext *iamf;
     int iamf_stream_offset;
+
+    struct MOVLazyIndex *lazy_index; ///< state of the on-demand index expansion
 } MOVStreamContext;
 
 typedef struct HEIFItemRef {
@@ -385,6 +387,7 @@ typedef struct MOVContext {
     int nb_heif_grid;
     int64_t idat_offset;
     int interleaved_read;
+    int lazy_index;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
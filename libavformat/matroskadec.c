@@ -90,6 +90,9 @@
 #define UNKNOWN_EQUIV         50 * 1024 /* An unknown element is considered equivalent
                                          * to this many bytes of unknown data for the
                                          * SKIP_THRESHOLD check. */
+#define MATROSKA_BLOCK_HEADROOM       8 /* Bytes reserved in front of the data of a Block, so
+                                         * that a header can be prepended to the first frame
+                                         * without copying it (ProRes, header stripping). */
 
 typedef enum {
     EBML_NONE,
@@ -1080,20 +1083,21 @@ static int ebml_read_ascii(AVIOContext *pb, int size,
 }
 
 /*
- * Read the next element as binary data.
+ * Read the next element as binary data, leaving headroom bytes
+ * unused in front of it.
  * 0 is success, < 0 or NEEDS_CHECKING is failure.
  */
-static int ebml_read_binary(AVIOContext *pb, int length,
+static int ebml_read_binary(AVIOContext *pb, int length, int headroom,
                             int64_t pos, EbmlBin *bin)
 {
     int ret;
 
-    ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
+    ret = av_buffer_realloc(&bin->buf, headroom + length + AV_INPUT_BUFFER_PADDING_SIZE);
     if (ret < 0)
         return ret;
-    memset(bin->buf->data + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    memset(bin->buf->data + headroom + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
-    bin->data = bin->buf->data;
+    bin->data = bin->buf->data + headroom;
     bin->size = length;
     bin->pos  = pos;
     if ((ret = avio_read(pb, bin->data, length)) != length) {
@@ -1485,7 +1489,9 @@ static int ebml_parse(MatroskaDemuxContext *matroska,
         res = ebml_read_ascii(pb, length, syntax->def.s, data);
         break;
     case EBML_BIN:
-        res = ebml_read_binary(pb, length, pos_alt, data);
+        res = ebml_read_binary(pb, length,
+                               id == MATROSKA_ID_BLOCK || id == MATROSKA_ID_SIMPLEBLOCK ?
+                               MATROSKA_BLOCK_HEADROOM : 0, pos_alt, data);
         break;
     case EBML_LEVEL1:
     case EBML_NEST:
@@ -1672,6 +1678,16 @@ static MatroskaTrack *matroska_find_track_by_num(MatroskaDemuxContext *matroska,
     return NULL;
 }
 
+/*
+ * Check whether size bytes in front of data can be overwritten,
+ * i.e. they belong to buf and buf is not referenced by any packet yet.
+ */
+static int block_has_headroom(AVBufferRef *buf, const uint8_t *data, int size)
+{
+    return buf && av_buffer_is_writable(buf) &&
+           data >= buf->data && data - buf->data >= size;
+}
+
 static int matroska_decode_buffer(uint8_t **buf, int *buf_size,
                                   MatroskaTrack *track)
 {
@@ -3755,25 +3771,34 @@ fail:
     return ret;
 }
 
-static int matroska_parse_prores(MatroskaTrack *track,
+/*
+ * Returns 1 if the frame header was written in front of the frame in buf,
+ * 0 if the frame was copied to a new buffer.
+ */
+static int matroska_parse_prores(MatroskaTrack *track, AVBufferRef *buf,
                                  uint8_t **data, int *size)
 {
     uint8_t *dst;
     int dstlen = *size + 8;
+    int in_place = block_has_headroom(buf, *data, 8);
 
-    dst = av_malloc(dstlen + AV_INPUT_BUFFER_PADDING_SIZE);
-    if (!dst)
-        return AVERROR(ENOMEM);
+    if (in_place) {
+        dst = *data - 8;
+    } else {
+        dst = av_malloc(dstlen + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!dst)
+            return AVERROR(ENOMEM);
+        memcpy(dst + 8, *data, dstlen - 8);
+        memset(dst + dstlen, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    }
 
     AV_WB32(dst, dstlen);
     AV_WB32(dst + 4, MKBETAG('i', 'c', 'p', 'f'));
-    memcpy(dst + 8, *data, dstlen - 8);
-    memset(dst + dstlen, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
     *data = dst;
     *size = dstlen;
 
-    return 0;
+    return in_place;
 }
 
 static int matroska_parse_webvtt(MatroskaDemuxContext *matroska,
@@ -4004,15 +4029,18 @@ static int matroska_parse_frame(MatroskaDemuxContext *matroska,
 
     if (st->codecpar->codec_id == AV_CODEC_ID_PRORES &&
         AV_RB32(pkt_data + 4)  != MKBETAG('i', 'c', 'p', 'f')) {
-        res = matroska_parse_prores(track, &pkt_data, &pkt_size);
+        res = matroska_parse_prores(track, buf, &pkt_data, &pkt_size);
         if (res < 0) {
             av_log(matroska->ctx, AV_LOG_ERROR,
                    "Error parsing a prores block.\n");
             goto fail;
         }
-        if (!buf)
-            av_freep(&data);
-        buf = NULL;
+        if (!res) {
+            if (!buf)
+                av_freep(&data);
+            buf = NULL;
+        }
+        res = 0;
     }
 
     if (!pkt_size && !nb_blockmore)
@@ -4106,6 +4134,7 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
                                 int64_t cluster_pos, int64_t discard_padding)
 {
     uint64_t timecode = AV_NOPTS_VALUE;
+    MatroskaTrackEncoding *encodings;
     MatroskaTrack *track;
     FFIOContext pb;
     int res = 0;
@@ -4135,6 +4164,7 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
                "Ignoring Block with this TrackNumber.\n", num);
         return 0;
     }
+    encodings = track->encodings.elem;
 
     if (st->discard >= AVDISCARD_ALL)
         return res;
@@ -4177,6 +4207,10 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
         }
     }
 
+    if (st->discard >= AVDISCARD_NONKEY && !is_keyframe &&
+        track->type == MATROSKA_TRACK_TYPE_VIDEO)
+        return res;
+
     res = matroska_parse_laces(matroska, &data, size, (flags & 0x06) >> 1,
                                &pb.pub, lace_size, &laces);
     if (res < 0) {
@@ -4205,7 +4239,15 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
         uint8_t *out_data = data;
         int      out_size = lace_size[n];
 
-        if (track->needs_decoding) {
+        if (track->needs_decoding && track->encodings.nb_elem == 1 &&
+            encodings[0].compression.algo == MATROSKA_TRACK_ENCODING_COMP_HEADERSTRIP &&
+            block_has_headroom(buf, data, encodings[0].compression.settings.size)) {
+            /* Restore the stripped header in front of the frame. */
+            out_data -= encodings[0].compression.settings.size;
+            out_size += encodings[0].compression.settings.size;
+            memcpy(out_data, encodings[0].compression.settings.data,
+                   encodings[0].compression.settings.size);
+        } else if (track->needs_decoding) {
             res = matroska_decode_buffer(&out_data, &out_size, track);
             if (res < 0)
                 return res;
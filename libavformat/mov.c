@@ -4096,6 +4096,486 @@ static int add_tts_entry(MOVTimeToSample **tts_data, unsigned int *tts_count, un
 }
 
 #define MAX_REORDER_DELAY 16
+/*
+ * On-demand expansion of the sample tables (lazy_index option).
+ *
+ * The index entries (and the 1:1 time to sample array) are allocated for
+ * the whole track but only filled block by block as they are needed by
+ * reading or seeking, so untouched parts never take any physical memory.
+ * The state at the start of a block is derived from the compact sample
+ * tables, which are kept around for that purpose.
+ * nb_index_entries only covers the blocks filled without a gap from the
+ * start, so generic code never sees unfilled entries; the demuxer itself
+ * goes by mov_nb_samples().
+ */
+#define MOV_LAZY_BLOCK_BITS 10
+#define MOV_LAZY_BLOCK_SIZE (1 << MOV_LAZY_BLOCK_BITS)
+/* stts/ctts entries between two search checkpoints */
+#define MOV_LAZY_RUN_STEP   64
+
+typedef struct MOVLazyIndex {
+    unsigned nb_entries;
+    uint8_t *filled;        ///< one flag per block of index entries
+    int64_t start_dts;      ///< dts of the first sample
+    int64_t *stsc_sample;   ///< first sample of each stsc entry
+    int64_t *stts_sample;   ///< first sample of every MOV_LAZY_RUN_STEP-th stts entry
+    int64_t *stts_dts;      ///< and its dts relative to start_dts
+    int64_t *ctts_sample;   ///< first sample of every MOV_LAZY_RUN_STEP-th ctts entry
+    int key_off;
+} MOVLazyIndex;
+
+static void mov_lazy_index_free(MOVStreamContext *sc)
+{
+    MOVLazyIndex *li = sc->lazy_index;
+
+    if (!li)
+        return;
+    av_freep(&li->filled);
+    av_freep(&li->stsc_sample);
+    av_freep(&li->stts_sample);
+    av_freep(&li->stts_dts);
+    av_freep(&li->ctts_sample);
+    av_freep(&sc->lazy_index);
+}
+
+static unsigned mov_nb_samples(const AVStream *st)
+{
+    const MOVStreamContext *sc = st->priv_data;
+
+    return sc->lazy_index ? sc->lazy_index->nb_entries : cffstream(st)->nb_index_entries;
+}
+
+/* Index of the last element of the sorted array arr not greater than val. */
+static unsigned mov_lazy_bsearch(const int64_t *arr, unsigned nb, int64_t val)
+{
+    unsigned lo = 0, hi = nb;
+
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) >> 1;
+        if (arr[mid] <= val)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Index of the first keyframe (stss) entry at or after the given sample. */
+static unsigned mov_lazy_next_stss(const MOVStreamContext *sc, int key_off,
+                                   unsigned sample)
+{
+    unsigned lo = 0, hi = sc->keyframe_count;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) >> 1;
+        if (sc->keyframes[mid] < (int64_t)sample + key_off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void mov_lazy_fill_block(MOVContext *mov, AVStream *st, unsigned block)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVLazyIndex *li = sc->lazy_index;
+    unsigned first = block << MOV_LAZY_BLOCK_BITS;
+    unsigned end = FFMIN(first + MOV_LAZY_BLOCK_SIZE, li->nb_entries);
+    unsigned stsc_index, stts_index, stts_sample, ctts_index = 0, ctts_sample = 0;
+    unsigned stss_index = 0, chunk, chunk_sample, distance, c;
+    int64_t offset, dts, rel;
+
+    /* chunk and position in the chunk */
+    stsc_index   = mov_lazy_bsearch(li->stsc_sample, sc->stsc_count, first);
+    rel          = first - li->stsc_sample[stsc_index];
+    chunk        = sc->stsc_data[stsc_index].first - 1 + rel / sc->stsc_data[stsc_index].count;
+    chunk_sample = rel % sc->stsc_data[stsc_index].count;
+    offset       = sc->chunk_offsets[chunk];
+    for (unsigned i = first - chunk_sample; i < first; i++)
+        offset += sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[i];
+
+    /* time to sample */
+    c = mov_lazy_bsearch(li->stts_sample, (sc->stts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP, first);
+    stts_index = c * MOV_LAZY_RUN_STEP;
+    dts = li->stts_dts[c];
+    rel = li->stts_sample[c];
+    while (rel + sc->stts_data[stts_index].count <= first) {
+        rel += sc->stts_data[stts_index].count;
+        dts += (int64_t)sc->stts_data[stts_index].count * sc->stts_data[stts_index].duration;
+        stts_index++;
+    }
+    stts_sample = first - rel;
+    dts += (int64_t)stts_sample * sc->stts_data[stts_index].duration + li->start_dts;
+
+    if (sc->ctts_data) {
+        c = mov_lazy_bsearch(li->ctts_sample, (sc->ctts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP, first);
+        ctts_index = c * MOV_LAZY_RUN_STEP;
+        rel = li->ctts_sample[c];
+        while (ctts_index < sc->ctts_count && rel + sc->ctts_data[ctts_index].count <= first)
+            rel += sc->ctts_data[ctts_index++].count;
+        ctts_sample = first - rel;
+    }
+
+    /* samples since the last keyframe */
+    distance = first;
+    if (sc->keyframe_absent) {
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            distance = 0;
+    } else if (!sc->keyframe_count) {
+        distance = 0;
+    } else {
+        stss_index = mov_lazy_next_stss(sc, li->key_off, first);
+        if (stss_index < sc->keyframe_count &&
+            sc->keyframes[stss_index] == (int64_t)first + li->key_off)
+            distance = 0;
+        else if (stss_index)
+            distance = first - (sc->keyframes[stss_index - 1] - li->key_off);
+        stss_index = FFMIN(stss_index, sc->keyframe_count - 1);
+    }
+
+    for (unsigned i = first; i < end; i++) {
+        AVIndexEntry *e = &sti->index_entries[i];
+        MOVTimeToSample *tts = &sc->tts_data[i];
+        unsigned sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[i];
+        int keyframe = 0;
+
+        if (!sc->keyframe_absent && (!sc->keyframe_count || i + li->key_off == sc->keyframes[stss_index])) {
+            keyframe = 1;
+            if (stss_index + 1 < sc->keyframe_count)
+                stss_index++;
+        }
+        if (sc->keyframe_absent &&
+            (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || i == 0))
+            keyframe = 1;
+        if (keyframe)
+            distance = 0;
+
+        e->pos          = offset;
+        e->timestamp    = dts;
+        e->size         = sample_size;
+        e->min_distance = distance;
+        e->flags        = keyframe ? AVINDEX_KEYFRAME : 0;
+        av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                "size %u, distance %u, keyframe %d\n", st->index, i,
+                offset, dts, sample_size, distance, keyframe);
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && i < 100)
+            ff_rfps_add_frame(mov->fc, st, dts);
+
+        tts->count    = 1;
+        tts->duration = sc->stts_data[stts_index].duration;
+        tts->offset   = ctts_index < sc->ctts_count ? sc->ctts_data[ctts_index].offset : 0;
+
+        offset += sample_size;
+        dts    += sc->stts_data[stts_index].duration;
+        distance++;
+
+        /* skip empty entries like the merge into tts_data does */
+        stts_sample++;
+        while (stts_sample >= sc->stts_data[stts_index].count &&
+               stts_index + 1 < sc->stts_count) {
+            stts_sample = 0;
+            stts_index++;
+        }
+        ctts_sample++;
+        while (ctts_index < sc->ctts_count &&
+               ctts_sample >= sc->ctts_data[ctts_index].count) {
+            ctts_sample = 0;
+            ctts_index++;
+        }
+        if (++chunk_sample == sc->stsc_data[stsc_index].count) {
+            chunk_sample = 0;
+            do {
+                chunk++;
+                while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+                       chunk + 1 == sc->stsc_data[stsc_index + 1].first)
+                    stsc_index++;
+            } while (!sc->stsc_data[stsc_index].count && chunk < sc->chunk_count);
+            if (chunk < sc->chunk_count)
+                offset = sc->chunk_offsets[chunk];
+        }
+    }
+
+    li->filled[block] = 1;
+    while (sti->nb_index_entries < li->nb_entries &&
+           li->filled[sti->nb_index_entries >> MOV_LAZY_BLOCK_BITS])
+        sti->nb_index_entries = FFMIN(sti->nb_index_entries + MOV_LAZY_BLOCK_SIZE,
+                                      li->nb_entries);
+}
+
+static void mov_lazy_index_fill(MOVContext *mov, AVStream *st,
+                                unsigned first, unsigned last)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVLazyIndex *li = sc->lazy_index;
+
+    if (!li)
+        return;
+    last = FFMIN(last, li->nb_entries - 1);
+    for (unsigned b = first >> MOV_LAZY_BLOCK_BITS; b <= last >> MOV_LAZY_BLOCK_BITS; b++)
+        if (!li->filled[b])
+            mov_lazy_fill_block(mov, st, b);
+}
+
+/* Expand the rest of the index, turning the track into a regular one. */
+static void mov_lazy_index_complete(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!sc->lazy_index)
+        return;
+    mov_lazy_index_fill(mov, st, 0, UINT_MAX);
+    mov_lazy_index_free(sc);
+
+    av_freep(&sc->ctts_data);
+    sc->ctts_allocated_size = 0;
+    av_freep(&sc->stts_data);
+    sc->stts_allocated_size = 0;
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+}
+
+/* Index of the last sample with a dts not after the given one. */
+static unsigned mov_lazy_dts_to_sample(const MOVStreamContext *sc, int64_t dts)
+{
+    const MOVLazyIndex *li = sc->lazy_index;
+    unsigned c, i;
+    int64_t sample;
+
+    dts -= li->start_dts;
+    if (dts < 0)
+        return 0;
+
+    c = mov_lazy_bsearch(li->stts_dts, (sc->stts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP, dts);
+    sample = li->stts_sample[c];
+    dts   -= li->stts_dts[c];
+    for (i = c * MOV_LAZY_RUN_STEP; i < sc->stts_count && sample < li->nb_entries; i++) {
+        const MOVStts *e = &sc->stts_data[i];
+        if (e->duration && dts < (int64_t)e->count * e->duration) {
+            sample += dts / e->duration;
+            break;
+        }
+        sample += e->count;
+        dts    -= (int64_t)e->count * e->duration;
+    }
+    return FFMIN(sample, li->nb_entries - 1);
+}
+
+static int mov_lazy_search_timestamp(MOVContext *mov, AVStream *st,
+                                     int64_t timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVLazyIndex *li = sc->lazy_index;
+    unsigned sample = mov_lazy_dts_to_sample(sc, timestamp);
+    unsigned first = sample, last = sample + 1, k;
+    int ret;
+
+    /* include the keyframes the search may walk to */
+    if (!(flags & AVSEEK_FLAG_ANY) && !sc->keyframe_absent && sc->keyframe_count) {
+        k = mov_lazy_next_stss(sc, li->key_off, sample);
+        if (k < sc->keyframe_count && sc->keyframes[k] == (int64_t)sample + li->key_off)
+            first = sample;
+        else
+            first = k ? sc->keyframes[k - 1] - li->key_off : 0;
+        if (!(flags & AVSEEK_FLAG_BACKWARD)) {
+            k = mov_lazy_next_stss(sc, li->key_off, sample + 1);
+            last = k < sc->keyframe_count ? sc->keyframes[k] - li->key_off : UINT_MAX;
+        }
+    } else if (!(flags & AVSEEK_FLAG_ANY) && sc->keyframe_absent &&
+               st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
+        first = 0;
+        last  = UINT_MAX;
+    }
+    mov_lazy_index_fill(mov, st, first, last);
+
+    first &= ~(MOV_LAZY_BLOCK_SIZE - 1);
+    last   = FFMIN(((uint64_t)FFMIN(last, li->nb_entries - 1) | (MOV_LAZY_BLOCK_SIZE - 1)) + 1,
+                   li->nb_entries);
+    ret = ff_index_search_timestamp(ffstream(st)->index_entries + first,
+                                    last - first, timestamp, flags);
+    return ret < 0 ? ret : ret + first;
+}
+
+static int mov_index_search_timestamp(MOVContext *mov, AVStream *st,
+                                      int64_t timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sc->lazy_index)
+        return mov_lazy_search_timestamp(mov, st, timestamp, flags);
+    return av_index_search_timestamp(st, timestamp, flags);
+}
+
+/*
+ * Set up on-demand expansion for a track, if its sample tables are simple
+ * enough to derive the index at any position from them.
+ * Returns 1 if the track uses it, 0 if the index must be built as usual.
+ */
+static int mov_lazy_index_init(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVLazyIndex *li;
+    uint64_t total = 0;
+    unsigned nb_blocks, nb_ck;
+
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (!sc->sample_count || sti->nb_index_entries || sc->tts_count ||
+        sc->sample_count >= INT_MAX / sizeof(*sti->index_entries))
+        return 0;
+    if (sc->iamf || sc->stps_count || (sc->rap_group_count && sc->rap_group))
+        return 0;
+    if (!mov->ignore_editlist && mov->advanced_editlist &&
+        sc->elst_data && sc->elst_count > 0)
+        return 0;
+    /* old uncompressed audio chunk demuxing */
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+        sc->stts_count == 1 && sc->stts_data && sc->stts_data[0].duration == 1)
+        return 0;
+
+    if (!sc->stts_data || !sc->stts_count || !sc->chunk_count || !sc->chunk_offsets ||
+        !sc->stsc_count || sc->stsc_data[0].first != 1 ||
+        (sc->stsz_sample_size <= 0 && !sc->sample_sizes))
+        return 0;
+    for (unsigned i = 0; i < sc->stts_count; i++)
+        total += sc->stts_data[i].count;
+    if (total < sc->sample_count)
+        return 0;
+    for (unsigned i = 1; i < sc->keyframe_count; i++)
+        if (sc->keyframes[i] <= sc->keyframes[i - 1])
+            return 0;
+
+    /* sizes that the regular expansion would reject or fix up on the way */
+    if (sc->stsz_sample_size > 0) {
+        if (sc->stsz_sample_size > 0x3FFFFFFF || sc->stsz_sample_size < sc->sample_size)
+            return 0;
+    } else {
+        for (unsigned i = 0; i < sc->sample_count; i++)
+            if (sc->sample_sizes[i] > 0x3FFFFFFF)
+                return 0;
+    }
+
+    li = av_mallocz(sizeof(*li));
+    if (!li)
+        return AVERROR(ENOMEM);
+    sc->lazy_index = li;
+
+    li->start_dts = start_dts;
+    li->key_off   = sc->keyframe_count && sc->keyframes[0] > 0;
+
+    li->stsc_sample = av_malloc_array(sc->stsc_count, sizeof(*li->stsc_sample));
+    if (!li->stsc_sample)
+        goto fail;
+    total = 0;
+    for (unsigned i = 0; i < sc->stsc_count; i++) {
+        int64_t next_offset;
+
+        if ((mov_stsc_index_valid(i, sc->stsc_count) &&
+             sc->stsc_data[i + 1].first <= sc->stsc_data[i].first) ||
+            (sc->pseudo_stream_id != -1 && sc->stsc_data[i].id - 1 != sc->pseudo_stream_id) ||
+            sc->stsc_data[i].first > sc->chunk_count || sc->stsc_data[i].count < 0)
+            goto ineligible;
+        li->stsc_sample[i] = total;
+        total += mov_get_stsc_samples(sc, i);
+
+        if (sc->stsz_sample_size > 0 && sc->sample_size > 0 &&
+            sc->sample_size < sc->stsz_sample_size) {
+            unsigned end = mov_stsc_index_valid(i, sc->stsc_count) ?
+                           sc->stsc_data[i + 1].first - 1 : sc->chunk_count;
+            for (unsigned j = sc->stsc_data[i].first - 1; j < end; j++) {
+                next_offset = j + 1 < sc->chunk_count ? sc->chunk_offsets[j + 1] : INT64_MAX;
+                if (next_offset > sc->chunk_offsets[j] &&
+                    sc->stsc_data[i].count * (int64_t)sc->stsz_sample_size > next_offset - sc->chunk_offsets[j])
+                    goto ineligible;
+            }
+        }
+    }
+    if (total != sc->sample_count)
+        goto ineligible;
+    li->nb_entries = sc->sample_count;
+
+    nb_ck = (sc->stts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP;
+    li->stts_sample = av_malloc_array(nb_ck, sizeof(*li->stts_sample));
+    li->stts_dts    = av_malloc_array(nb_ck, sizeof(*li->stts_dts));
+    if (!li->stts_sample || !li->stts_dts)
+        goto fail;
+    {
+        int64_t sample = 0, dts = 0;
+        for (unsigned i = 0; i < sc->stts_count; i++) {
+            if (!(i % MOV_LAZY_RUN_STEP)) {
+                li->stts_sample[i / MOV_LAZY_RUN_STEP] = sample;
+                li->stts_dts[i / MOV_LAZY_RUN_STEP]    = dts;
+            }
+            sample += sc->stts_data[i].count;
+            dts    += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+        }
+    }
+
+    if (sc->ctts_data) {
+        int64_t sample = 0;
+
+        nb_ck = (sc->ctts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP;
+        li->ctts_sample = av_malloc_array(FFMAX(nb_ck, 1), sizeof(*li->ctts_sample));
+        if (!li->ctts_sample)
+            goto fail;
+        li->ctts_sample[0] = 0;
+        for (unsigned i = 0; i < sc->ctts_count; i++) {
+            if (!(i % MOV_LAZY_RUN_STEP))
+                li->ctts_sample[i / MOV_LAZY_RUN_STEP] = sample;
+            sample += sc->ctts_data[i].count;
+        }
+    } else {
+        sc->ctts_count = 0;
+    }
+
+    nb_blocks  = (li->nb_entries + MOV_LAZY_BLOCK_SIZE - 1) >> MOV_LAZY_BLOCK_BITS;
+    li->filled = av_mallocz(nb_blocks);
+    if (!li->filled)
+        goto fail;
+
+    /* Not zeroed on purpose: pages are only touched when a block is filled. */
+    sti->index_entries = av_malloc_array(li->nb_entries, sizeof(*sti->index_entries));
+    if (!sti->index_entries)
+        goto fail;
+    sti->index_entries_allocated_size = li->nb_entries * sizeof(*sti->index_entries);
+    sc->tts_data = av_malloc_array(li->nb_entries, sizeof(*sc->tts_data));
+    if (!sc->tts_data)
+        goto fail;
+    sc->tts_allocated_size = li->nb_entries * sizeof(*sc->tts_data);
+    sc->tts_count          = li->nb_entries;
+
+    mov_lazy_fill_block(mov, st, 0);
+
+    if (st->duration > 0) {
+        uint64_t stream_size = 0;
+        if (sc->stsz_sample_size > 0)
+            stream_size = (uint64_t)sc->stsz_sample_size * sc->sample_count;
+        else
+            for (unsigned i = 0; i < sc->sample_count; i++)
+                stream_size += sc->sample_sizes[i];
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+    }
+
+    return 1;
+fail:
+    av_log(mov->fc, AV_LOG_ERROR, "Cannot allocate the index of stream %d\n", st->index);
+    av_freep(&sti->index_entries);
+    sti->index_entries_allocated_size = 0;
+    sti->nb_index_entries = 0;
+    av_freep(&sc->tts_data);
+    sc->tts_allocated_size = 0;
+    sc->tts_count = 0;
+    mov_lazy_index_free(sc);
+    return AVERROR(ENOMEM);
+ineligible:
+    mov_lazy_index_free(sc);
+    return 0;
+}
+
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
@@ -4715,8 +5195,12 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             sc->start_pad = start_time;
     }
 
+    if (mov->lazy_index &&
+        (ret = mov_lazy_index_init(mov, st, current_dts - sc->dts_shift))) {
+        if (ret < 0)
+            return;
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
-    if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+    } else if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data && sc->stts_data[0].duration == 1)) {
         unsigned int current_sample = 0;
         unsigned int stts_sample = 0;
@@ -5134,6 +5618,28 @@ static int sanity_checks(void *log_obj, MOVStreamContext *sc, int index)
     return 0;
 }
 
+/* Check whether the first nb_samples samples have the same duration. */
+static int mov_tts_constant(const MOVStreamContext *sc, unsigned nb_samples)
+{
+    nb_samples = FFMIN(nb_samples, sc->tts_count);
+    if (sc->lazy_index) {
+        /* Most of tts_data is not filled yet; go by the stts runs, which
+         * start at the sample given by the counts of the preceding runs. */
+        uint64_t first = 0;
+        for (unsigned i = 0; i < sc->stts_count && first < nb_samples; i++) {
+            if (sc->stts_data[i].count &&
+                sc->stts_data[i].duration != sc->tts_data[0].duration)
+                return 0;
+            first += sc->stts_data[i].count;
+        }
+        return 1;
+    }
+    for (unsigned i = 1; i < nb_samples; i++)
+        if (sc->tts_data[i].duration != sc->tts_data[0].duration)
+            return 0;
+    return 1;
+}
+
 static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     AVStream *st;
@@ -5234,11 +5740,8 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         }
 
 #if FF_API_R_FRAME_RATE
-        for (unsigned int i = 1; sc->stts_count && i + 1 < sc->tts_count; i++) {
-            if (sc->tts_data[i].duration == sc->tts_data[0].duration)
-                continue;
+        if (stts_constant && !mov_tts_constant(sc, sc->tts_count - 1))
             stts_constant = 0;
-        }
         if (stts_constant)
             av_reduce(&st->r_frame_rate.num, &st->r_frame_rate.den,
                       sc->time_scale, sc->tts_data[0].duration, INT_MAX);
@@ -5265,19 +5768,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     // If the duration of the mp3 packets is not constant, then they could need a parser
     if (st->codecpar->codec_id == AV_CODEC_ID_MP3
         && sc->time_scale == st->codecpar->sample_rate) {
-        int stts_constant = 1;
-        for (int i = 1; sc->stts_count && i < sc->tts_count; i++) {
-            if (sc->tts_data[i].duration == sc->tts_data[0].duration)
-                continue;
-            stts_constant = 0;
-        }
+        int stts_constant = !sc->stts_count || mov_tts_constant(sc, sc->tts_count);
         if (!stts_constant)
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
+    /* Do not need those anymore, unless the index is expanded on demand. */
+    if (!sc->lazy_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+    }
     av_freep(&sc->stps_data);
     av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
@@ -5785,6 +6285,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
+    mov_lazy_index_complete(c, st);
 
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
@@ -9905,6 +10406,7 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
         return;
     }
 
+    mov_lazy_index_free(sc);
     av_freep(&sc->tts_data);
     for (int i = 0; i < sc->drefs_count; i++) {
         av_freep(&sc->drefs[i].path);
@@ -10943,6 +11445,10 @@ static int mov_read_header(AVFormatContext *s)
 
     fix_stream_ids(s);
 
+    /* fragments add index entries on their own */
+    if (mov->frag_index.nb_items || mov->trex_data)
+        for (i = 0; i < s->nb_streams; i++)
+            mov_lazy_index_complete(mov, s->streams[i]);
     ff_configure_buffers_for_index(s, AV_TIME_BASE);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
@@ -10963,8 +11469,10 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
         AVStream *avst = s->streams[i];
         FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < mov_nb_samples(avst)) {
+            AVIndexEntry *current_sample;
+            mov_lazy_index_fill(mov, avst, msc->current_sample, msc->current_sample);
+            current_sample = &avsti->index_entries[msc->current_sample];
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -11134,7 +11642,9 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
         pkt->pts = av_sat_add64(pkt->dts, av_sat_add64(sc->dts_shift, sc->tts_data[sc->tts_index].offset));
     } else {
         if (pkt->duration == 0) {
-            int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
+            int64_t next_dts;
+            mov_lazy_index_fill(s->priv_data, st, sc->current_sample, sc->current_sample);
+            next_dts = (sc->current_sample < mov_nb_samples(st)) ?
                 ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
             if (next_dts >= pkt->dts)
                 pkt->duration = next_dts - pkt->dts;
@@ -11218,6 +11728,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 
             // Discard current index entries
             avsti = ffstream(avst);
+            mov_lazy_index_free(msc);
             if (avsti->index_entries_allocated_size > 0) {
                 av_freep(&avsti->index_entries);
                 avsti->index_entries_allocated_size = 0;
@@ -11427,7 +11938,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_index_search_timestamp(s->priv_data, st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
         if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
             sample = 0;
@@ -11438,7 +11949,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
             break;
 
         next_ts = timestamp - FFMAX(sc->min_sample_duration, 1);
-        requested_sample = av_index_search_timestamp(st, next_ts, flags);
+        requested_sample = mov_index_search_timestamp(s->priv_data, st, next_ts, flags);
 
         // If we've reached a different sample trying to find a good pts to
         // seek to, give up searching because we'll end up seeking back to
@@ -11452,7 +11963,11 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     mov_current_sample_set(sc, sample);
     av_log(s, AV_LOG_TRACE, "stream %d, found sample %d\n", st->index, sc->current_sample);
     /* adjust time to sample index */
-    if (sc->tts_data) {
+    if (sc->lazy_index) {
+        /* one entry per sample, not necessarily filled before this one */
+        sc->tts_index  = sc->current_sample;
+        sc->tts_sample = 0;
+    } else if (sc->tts_data) {
         time_sample = 0;
         for (i = 0; i < sc->tts_count; i++) {
             int next = time_sample + sc->tts_data[i].count;
@@ -11607,6 +12122,7 @@ static const AVOption mov_options[] = {
         {.i64 = 0}, 0, 1, FLAGS },
     { "max_stts_delta", "treat offsets above this value as invalid", OFFSET(max_stts_delta), AV_OPT_TYPE_INT, {.i64 = UINT_MAX-48000*10 }, 0, UINT_MAX, .flags = AV_OPT_FLAG_DECODING_PARAM },
     { "interleaved_read", "Interleave packets from multiple tracks at demuxer level", OFFSET(interleaved_read), AV_OPT_TYPE_BOOL, {.i64 = 1 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "lazy_index", "Expand the sample tables into the index on demand", OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
 
     { NULL },
 };
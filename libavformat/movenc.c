@@ -105,6 +105,7 @@ static const AVOption options[] = {
       { "negative_cts_offsets", "Use negative CTS offsets (reducing the need for edit lists)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_NEGATIVE_CTS_OFFSETS}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "prefer_icc", "If writing colr atom prioritise usage of ICC profile if it exists in stream packet side data", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_PREFER_ICC}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
+      { "reserve_moov", "Reserve space for the moov atom at the beginning of the file based on the stream durations, implies faststart", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RESERVE_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "rtphint", "Add RTP hint tracks", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RTP_HINT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "separate_moof", "Write separate moof/mdat atoms for each track", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SEPARATE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "skip_sidx", "Skip writing of sidx atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SKIP_SIDX}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
@@ -7856,6 +7857,56 @@ static int mov_init_iamf_track(AVFormatContext *s)
 }
 #endif
 
+/*
+ * Estimate an upper bound of the final moov atom size from the stream
+ * durations, assuming one chunk per sample and no run-length compression
+ * of the sample tables. Returns 0 if any stream duration is unknown.
+ */
+static int64_t estimate_moov_size(AVFormatContext *s)
+{
+    int64_t size = 4096;
+
+    for (int i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        AVRational rate;
+        int64_t samples;
+        int entry_size;
+
+        if (st->duration <= 0 || st->duration == AV_NOPTS_VALUE)
+            return 0;
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            /* stts, ctts, stsz, stss, stsc and co64 entries */
+            entry_size = 44;
+            rate = st->avg_frame_rate;
+            if (rate.num <= 0 || rate.den <= 0)
+                rate = par->framerate;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            entry_size = 32;
+            rate = av_make_q(par->sample_rate,
+                             par->frame_size > 0 ? par->frame_size : 1024);
+            break;
+        default:
+            entry_size = 32;
+            rate = av_make_q(2, 1);
+            break;
+        }
+        if (rate.num <= 0 || rate.den <= 0)
+            return 0;
+
+        samples = av_rescale_q_rnd(st->duration, st->time_base, av_inv_q(rate),
+                                   AV_ROUND_UP);
+        size += 1024 + FFMIN(samples, INT_MAX / 64) * entry_size;
+        if (size > INT_MAX / 2)
+            return INT_MAX / 2;
+    }
+
+    return size;
+}
+
 static int mov_init(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -7894,6 +7945,9 @@ static int mov_init(AVFormatContext *s)
                       FF_MOV_FLAG_FRAG_EVERY_FRAME))
         mov->flags |= FF_MOV_FLAG_FRAGMENT;
 
+    if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV)
+        mov->flags |= FF_MOV_FLAG_FASTSTART;
+
     if (mov->flags & FF_MOV_FLAG_HYBRID_FRAGMENTED &&
         mov->flags & FF_MOV_FLAG_FASTSTART) {
         av_log(s, AV_LOG_ERROR, "Setting both hybrid_fragmented and faststart is not supported.\n");
@@ -7925,7 +7979,13 @@ static int mov_init(AVFormatContext *s)
     }
 
     if (mov->flags & FF_MOV_FLAG_FASTSTART) {
-        mov->reserved_moov_size = -1;
+        /* A moov reservation turns the second pass into a fallback that
+         * only runs if the reserved space turns out to be too small. */
+        if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV)
+            mov->reserved_moov_size = FFMAX(mov->reserved_moov_size,
+                                            estimate_moov_size(s));
+        if (mov->reserved_moov_size <= 0 || mov->flags & FF_MOV_FLAG_FRAGMENT)
+            mov->reserved_moov_size = -1;
     }
 
     if (mov->use_editlist < 0) {
@@ -8453,7 +8513,7 @@ static int mov_write_header(AVFormatContext *s)
             update_size(pb, mov->mdat_pos);
         }
     } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->reserved_moov_size < 0)
             mov->reserved_header_pos = avio_tell(pb);
         mov_write_mdat_tag(pb, mov);
     }
@@ -8602,6 +8662,49 @@ static int shift_data(AVFormatContext *s)
     return ff_format_shift_data(s, mov->reserved_header_pos, moov_size);
 }
 
+/*
+ * Make sure the space reserved in front of the mdat holds the moov atom and
+ * a trailing free atom. If it does not, only the media data is moved, by as
+ * much as is missing, instead of the whole second pass of faststart.
+ */
+static int grow_moov_reservation(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t moov_size, shift = 0;
+    int ret;
+
+    while (1) {
+        int64_t delta;
+
+        moov_size = get_moov_size(s);
+        if (moov_size < 0)
+            return moov_size;
+        delta = moov_size + 8 - (mov->reserved_moov_size + shift);
+        if (delta <= 0)
+            break;
+        /* avoid moving the data in tiny blocks */
+        if (!shift)
+            delta = FFMAX(delta, 1 << 16);
+        for (int i = 0; i < mov->nb_tracks; i++)
+            mov->tracks[i].data_offset += delta;
+        shift += delta;
+    }
+    if (!shift)
+        return 0;
+    if (shift > INT_MAX - mov->reserved_moov_size)
+        return AVERROR(EINVAL);
+
+    av_log(s, AV_LOG_WARNING, "Reserved moov space is too small, "
+           "moving the media data by %"PRId64" bytes\n", shift);
+    ret = ff_format_shift_data(s, mov->reserved_header_pos + mov->reserved_moov_size,
+                               shift);
+    if (ret < 0)
+        return ret;
+    mov->reserved_moov_size += shift;
+
+    return 0;
+}
+
 static void mov_write_mdat_size(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -8686,9 +8789,17 @@ static int mov_write_trailer(AVFormatContext *s)
         if (!(mov->flags & FF_MOV_FLAG_HYBRID_FRAGMENTED))
             mov_write_mdat_size(s);
 
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size > 0) {
+            avio_seek(pb, moov_pos, SEEK_SET);
+            res = grow_moov_reservation(s);
+            if (res < 0)
+                return res;
+            moov_pos = avio_tell(pb);
+        }
+
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->reserved_moov_size < 0) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
@@ -290,6 +290,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_CMAF                  (1 << 22)
 #define FF_MOV_FLAG_PREFER_ICC            (1 << 23)
 #define FF_MOV_FLAG_HYBRID_FRAGMENTED     (1 << 24)
+#define FF_MOV_FLAG_RESERVE_MOOV          (1 << 25)
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
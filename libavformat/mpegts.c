@@ -3001,13 +3001,57 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Skip the packets already in the I/O buffer which handle_packet() would
+ * ignore, i.e. packets of PIDs without a filter or of discarded programs,
+ * without reading them one by one.
+ * @return number of skipped packets
+ */
+static int skip_unwanted_packets(MpegTSContext *ts, int max_packets)
+{
+    AVIOContext *pb = ts->stream->pb;
+    const int size   = ts->raw_packet_size;
+    const int offset = size == TS_DVHS_PACKET_SIZE ? 4 : 0;
+    const uint8_t *p = pb->buf_ptr;
+    int nb, i;
+
+    if (pb->write_flag)
+        return 0;
+    nb = FFMIN((pb->buf_end - p) / size, max_packets);
+
+    for (i = 0; i < nb; i++, p += size) {
+        const uint8_t *packet = p + offset;
+        MpegTSFilter *tss;
+        int pid, is_start;
+
+        if (packet[0] != SYNC_BYTE)
+            break;
+        pid      = AV_RB16(packet + 1) & 0x1fff;
+        is_start = packet[1] & 0x40;
+        tss      = ts->pids[pid];
+        if (!tss) {
+            if (ts->auto_guess && is_start)
+                break;
+            continue;
+        }
+        if (is_start)
+            tss->discard = discard_pid(ts, pid);
+        if (!tss->discard)
+            break;
+    }
+
+    if (i)
+        avio_skip(pb, i * size);
+    return i;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
     uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
     const uint8_t *data;
     int64_t packet_num;
-    int ret = 0;
+    int ret = 0, skipped;
 
     if (avio_tell(s->pb) != ts->last_pos) {
         int i;
@@ -3042,6 +3086,12 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        skipped = skip_unwanted_packets(ts, nb_packets ? FFMIN(nb_packets - packet_num, INT_MAX) : INT_MAX);
+        if (skipped) {
+            packet_num += skipped - 1;
+            continue;
+        }
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -87,6 +87,9 @@ int ff_format_shift_data(AVFormatContext *s, int64_t read_start, int shift_size)
      * writing, so we re-open the same output, but for reading. It also avoids
      * a read/seek/write/seek back and forth. */
     avio_flush(s->pb);
+    /* Querying the size makes protocols writing in the background, such as
+     * async, complete the pending writes before the output is read back. */
+    avio_size(s->pb);
     ret = s->io_open(s, &read_pb, s->url, AVIO_FLAG_READ, NULL);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Unable to re-open %s output file for shifting data\n", s->url);
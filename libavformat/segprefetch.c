@@ -0,0 +1,304 @@
+/*
+ * Background download of upcoming media segments
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Background download of upcoming media segments, used by the HLS and DASH
+ * demuxers.
+ *
+ * Each job downloads one segment into memory on its own thread, which opens
+ * the URL with the options and protocol whitelists of the demuxer. The
+ * interrupt callback of the demuxer is thus called from these threads too,
+ * as with the async protocol.
+ */
+
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "avio_internal.h"
+#include "segprefetch.h"
+#include "url.h"
+
+#define CHUNK_SIZE 32768
+
+#if HAVE_THREADS
+static int prefetch_interrupt_cb(void *opaque)
+{
+    FFSegPrefetchJob *job = opaque;
+    return atomic_load(&job->abort) ||
+           ff_check_interrupt(&job->parent->interrupt_callback);
+}
+
+static void *prefetch_worker(void *arg)
+{
+    FFSegPrefetchJob *job = arg;
+    AVFormatContext *s = job->parent;
+    AVIOContext *pb = NULL;
+    int64_t size = job->size;
+    int ret;
+
+    ret = ffio_open_whitelist(&pb, job->url, AVIO_FLAG_READ, &job->interrupt_callback,
+                              &job->opts, s->protocol_whitelist, s->protocol_blacklist);
+    if (ret < 0)
+        goto end;
+
+    if (job->seek && job->url_offset) {
+        int64_t seekret = avio_seek(pb, job->url_offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            goto end;
+        }
+    }
+
+    if (size < 0)
+        size = avio_size(pb);
+    if (size > job->max_size) {
+        ret = AVERROR(ENOSPC);
+        goto end;
+    }
+
+    for (;;) {
+        int64_t want = size >= 0 ? size - job->data_len : CHUNK_SIZE;
+        uint8_t *data;
+
+        if (want <= 0)
+            break;
+        want = FFMIN(want, job->max_size - job->data_len);
+        if (!want) {
+            /* the buffer is full, which is fine only if nothing is left */
+            uint8_t c;
+            ret = avio_read(pb, &c, 1);
+            if (ret == AVERROR_EOF)
+                break;
+            if (ret >= 0)
+                ret = AVERROR(ENOSPC);
+            goto end;
+        }
+
+        data = av_fast_realloc(job->data, &job->data_alloc, job->data_len + want);
+        if (!data) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        job->data = data;
+
+        ret = avio_read(pb, job->data + job->data_len, want);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto end;
+        job->data_len += ret;
+    }
+    ret = 0;
+
+end:
+    avio_closep(&pb);
+    job->ret = ret;
+    return NULL;
+}
+#endif
+
+void ff_segprefetch_free(FFSegPrefetchJob **pjob)
+{
+    FFSegPrefetchJob *job = *pjob;
+
+    if (!job)
+        return;
+
+#if HAVE_THREADS
+    if (job->thread_started) {
+        atomic_store(&job->abort, 1);
+        pthread_join(job->thread, NULL);
+    }
+#endif
+    av_freep(&job->url);
+    av_dict_free(&job->opts);
+    av_freep(&job->data);
+    av_freep(pjob);
+}
+
+void ff_segprefetch_queue_free(FFSegPrefetchQueue *q)
+{
+    for (int i = 0; i < q->nb_jobs; i++)
+        ff_segprefetch_free(&q->jobs[i]);
+    av_freep(&q->jobs);
+    q->nb_jobs = 0;
+}
+
+static int job_matches(const FFSegPrefetchJob *job, int64_t seq_no, const char *url,
+                       int64_t url_offset, int64_t size)
+{
+    return job->seq_no == seq_no && job->url_offset == url_offset &&
+           job->size == size && !strcmp(job->url, url);
+}
+
+static int find_job(const FFSegPrefetchQueue *q, int64_t seq_no, const char *url,
+                    int64_t url_offset, int64_t size)
+{
+    for (int i = 0; i < q->nb_jobs; i++)
+        if (job_matches(q->jobs[i], seq_no, url, url_offset, size))
+            return i;
+    return -1;
+}
+
+static void remove_job(FFSegPrefetchQueue *q, int i)
+{
+    q->jobs[i] = q->jobs[--q->nb_jobs];
+}
+
+FFSegPrefetchJob *ff_segprefetch_add(FFSegPrefetchQueue *q, int64_t seq_no,
+                                     const char *url, int64_t url_offset,
+                                     int64_t size)
+{
+    FFSegPrefetchJob *job = av_mallocz(sizeof(*job));
+
+    if (!job)
+        return NULL;
+
+    job->seq_no     = seq_no;
+    job->url_offset = url_offset;
+    job->size       = size;
+    job->wanted     = 1;
+    job->ret        = AVERROR(EINVAL);
+    atomic_init(&job->abort, 0);
+
+    job->url = av_strdup(url);
+    if (!job->url ||
+        av_dynarray_add_nofree(&q->jobs, &q->nb_jobs, job) < 0) {
+        ff_segprefetch_free(&job);
+        return NULL;
+    }
+
+    return job;
+}
+
+int ff_segprefetch_start(FFSegPrefetchJob *job, AVFormatContext *s,
+                         const AVDictionary *opts, int64_t max_size, int seek)
+{
+    int ret;
+
+    job->parent   = s;
+    job->max_size = max_size;
+    job->seek     = seek;
+    job->started  = 1;
+
+    if (job->size > max_size) {
+        job->ret = AVERROR(ENOSPC);
+        return 0;
+    }
+
+    ret = av_dict_copy(&job->opts, opts, 0);
+    if (ret < 0)
+        return ret;
+    if (job->size >= 0) {
+        av_dict_set_int(&job->opts, "offset", job->url_offset, 0);
+        av_dict_set_int(&job->opts, "end_offset", job->url_offset + job->size, 0);
+    }
+
+#if HAVE_THREADS
+    job->interrupt_callback.callback = prefetch_interrupt_cb;
+    job->interrupt_callback.opaque   = job;
+    job->ret = 0;
+    ret = pthread_create(&job->thread, NULL, prefetch_worker, job);
+    if (ret) {
+        job->ret = AVERROR(ret);
+        return 0;
+    }
+    job->thread_started = 1;
+#else
+    job->ret = AVERROR(ENOSYS);
+#endif
+
+    return 0;
+}
+
+int ff_segprefetch_want(FFSegPrefetchQueue *q, int64_t seq_no, const char *url,
+                        int64_t url_offset, int64_t size)
+{
+    int i = find_job(q, seq_no, url, url_offset, size);
+
+    if (i < 0)
+        return 0;
+    q->jobs[i]->wanted = 1;
+    return 1;
+}
+
+void ff_segprefetch_unwant_all(FFSegPrefetchQueue *q)
+{
+    for (int i = 0; i < q->nb_jobs; i++)
+        q->jobs[i]->wanted = 0;
+}
+
+void ff_segprefetch_drop_unwanted(FFSegPrefetchQueue *q)
+{
+    for (int i = 0; i < q->nb_jobs;) {
+        if (!q->jobs[i]->wanted) {
+            ff_segprefetch_free(&q->jobs[i]);
+            remove_job(q, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+FFSegPrefetchJob *ff_segprefetch_take(FFSegPrefetchQueue *q, int64_t seq_no,
+                                      const char *url, int64_t url_offset,
+                                      int64_t size)
+{
+    FFSegPrefetchJob *job;
+    int i = find_job(q, seq_no, url, url_offset, size);
+
+    if (i < 0)
+        return NULL;
+    job = q->jobs[i];
+    remove_job(q, i);
+
+#if HAVE_THREADS
+    if (job->thread_started) {
+        pthread_join(job->thread, NULL);
+        job->thread_started = 0;
+    }
+#endif
+    if (job->ret < 0) {
+        if (job->started)
+            av_log(job->parent, AV_LOG_VERBOSE, "Prefetching '%s' failed (%s), fetching it again\n",
+                   job->url, av_err2str(job->ret));
+        ff_segprefetch_free(&job);
+    }
+
+    return job;
+}
+
+int ff_segprefetch_read(const FFSegPrefetchJob *job, int64_t *pos,
+                        uint8_t *buf, int buf_size)
+{
+    int64_t left = job->data_len - *pos;
+
+    if (left <= 0)
+        return AVERROR_EOF;
+
+    buf_size = FFMIN(buf_size, left);
+    memcpy(buf, job->data + *pos, buf_size);
+    *pos += buf_size;
+
+    return buf_size;
+}
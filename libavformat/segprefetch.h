@@ -0,0 +1,144 @@
+/*
+ * Background download of upcoming media segments
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGPREFETCH_H
+#define AVFORMAT_SEGPREFETCH_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/thread.h"
+#include "avformat.h"
+
+/**
+ * A segment that is downloaded into memory by a background thread ahead of
+ * the read position. A job is identified by seq_no, url, url_offset and size.
+ */
+typedef struct FFSegPrefetchJob {
+    int64_t seq_no;     ///< caller-defined, e.g. -1 for initialization sections
+    char *url;
+    int64_t url_offset;
+    int64_t size;       ///< size of the byte range, -1 for the rest of the file
+    int wanted;         ///< see ff_segprefetch_want()
+
+    /* Only valid once the job was returned by ff_segprefetch_take(). */
+    uint8_t *data;
+    int64_t data_len;
+
+    /* The fields below are private to segprefetch.c. */
+    AVFormatContext *parent;
+    AVDictionary *opts;
+    int64_t max_size;
+    int seek;
+    unsigned int data_alloc;
+    int started;
+    int ret;
+
+    atomic_int abort;
+    AVIOInterruptCB interrupt_callback;
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+    int thread_started;
+} FFSegPrefetchJob;
+
+/**
+ * The jobs of one playlist or representation. Zero-initialize before use.
+ */
+typedef struct FFSegPrefetchQueue {
+    FFSegPrefetchJob **jobs;
+    int nb_jobs;
+} FFSegPrefetchQueue;
+
+/**
+ * Add a job for a segment to the queue, marked as wanted. The download is
+ * started separately with ff_segprefetch_start(). A job that is never
+ * started keeps the segment from being queued again, and is fetched as usual
+ * once it is reached.
+ *
+ * @return the new job, or NULL on allocation failure
+ */
+FFSegPrefetchJob *ff_segprefetch_add(FFSegPrefetchQueue *q, int64_t seq_no,
+                                     const char *url, int64_t url_offset,
+                                     int64_t size);
+
+/**
+ * Start downloading the segment of a job on a background thread.
+ *
+ * Downloads that cannot be started are not errors, the segment is then
+ * fetched as usual once it is reached.
+ *
+ * @param s        demuxer context, whose protocol whitelists and interrupt
+ *                 callback are used by the download
+ * @param opts     options for opening the url; offset and end_offset are
+ *                 added if the size of the segment is known
+ * @param max_size the download fails if the segment is larger
+ * @param seek     seek to url_offset after opening the url, for protocols
+ *                 that do not support the offset option
+ * @return 0 on success, a negative AVERROR code on allocation failure
+ */
+int ff_segprefetch_start(FFSegPrefetchJob *job, AVFormatContext *s,
+                         const AVDictionary *opts, int64_t max_size, int seek);
+
+/**
+ * Mark the job for the given segment as wanted.
+ *
+ * To move the window of prefetched segments, clear the marks with
+ * ff_segprefetch_unwant_all(), mark the segments still ahead, drop the
+ * others with ff_segprefetch_drop_unwanted() and start the missing ones.
+ *
+ * @return 1 if the segment is in the queue, 0 otherwise
+ */
+int ff_segprefetch_want(FFSegPrefetchQueue *q, int64_t seq_no, const char *url,
+                        int64_t url_offset, int64_t size);
+
+void ff_segprefetch_unwant_all(FFSegPrefetchQueue *q);
+
+void ff_segprefetch_drop_unwanted(FFSegPrefetchQueue *q);
+
+/**
+ * Remove the job for the given segment from the queue and wait for its
+ * download to finish.
+ *
+ * @return the job, to be freed with ff_segprefetch_free(), or NULL if the
+ *         segment was not prefetched or its download failed
+ */
+FFSegPrefetchJob *ff_segprefetch_take(FFSegPrefetchQueue *q, int64_t seq_no,
+                                      const char *url, int64_t url_offset,
+                                      int64_t size);
+
+/**
+ * Copy the data of a job returned by ff_segprefetch_take(), starting at *pos,
+ * and advance *pos.
+ *
+ * @return number of bytes read or AVERROR_EOF
+ */
+int ff_segprefetch_read(const FFSegPrefetchJob *job, int64_t *pos,
+                        uint8_t *buf, int buf_size);
+
+/**
+ * Abort the download of a job if it is still running and free it.
+ */
+void ff_segprefetch_free(FFSegPrefetchJob **pjob);
+
+void ff_segprefetch_queue_free(FFSegPrefetchQueue *q);
+
+#endif /* AVFORMAT_SEGPREFETCH_H */
@@ -24,6 +24,11 @@
  * UDP protocol
  */
 
+#include "config.h"
+
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() with glibc */
+#endif
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
 
@@ -60,6 +65,16 @@
 #define IPPROTO_UDPLITE                                  136
 #endif
 
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT                                      103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO                                          104
+#endif
+#endif
+
 #if HAVE_W32THREADS
 #undef HAVE_PTHREAD_CANCEL
 #define HAVE_PTHREAD_CANCEL 1
@@ -78,6 +93,7 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_MAX_SEGMENTS 64
 
 typedef struct UDPQueuedPacketHeader {
     int pkt_size;
@@ -85,6 +101,16 @@ typedef struct UDPQueuedPacketHeader {
     socklen_t addr_len;
 } UDPQueuedPacketHeader;
 
+#if HAVE_RECVMMSG
+typedef struct UDPRecvSlot {
+    struct sockaddr_storage addr;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+} UDPRecvSlot;
+#endif
+
 typedef struct UDPContext {
     const AVClass *class;
     int udp_fd;
@@ -126,6 +152,20 @@ typedef struct UDPContext {
     IPSourceFilters filters;
     struct sockaddr_storage last_recv_addr;
     socklen_t last_recv_addr_len;
+
+    int batch;
+    int gro;
+    int gso;
+#if HAVE_RECVMMSG
+    struct mmsghdr *rx_msgs;
+    struct iovec *rx_iov;
+    UDPRecvSlot *rx_slots;
+    uint8_t *rx_buf;
+#endif
+#if HAVE_SENDMMSG
+    struct mmsghdr *tx_msgs;
+    struct iovec *tx_iov;
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -151,6 +191,9 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch",          "Number of datagrams received or sent per system call", OFFSET(batch),     AV_OPT_TYPE_INT,    { .i64 = 1 },      1, 1024,    D|E },
+    { "gro",            "Receive coalesced datagrams (Linux only)",        OFFSET(gro),            AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       D },
+    { "gso",            "Send each batch with segmentation offload (Linux only)", OFFSET(gso),     AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       E },
     { NULL }
 };
 
@@ -525,7 +568,150 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+/**
+ * Send buf as one datagram, or as datagrams of pkt_size bytes with
+ * batching enabled.
+ *
+ * @return number of bytes sent, or a negative error code
+ */
+static int udp_send(UDPContext *s, const uint8_t *buf, int size)
+{
+    struct sockaddr *dest = s->is_connected ? NULL : (struct sockaddr *)&s->dest_addr;
+    socklen_t dest_len    = s->is_connected ? 0 : s->dest_addr_len;
+    int ret;
+
+#if defined(__linux__) && defined(CMSG_SPACE)
+    if (s->gso && size > s->pkt_size) {
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            struct cmsghdr align;
+        } control = { 0 };
+        struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+        struct msghdr msg = {
+            .msg_name       = dest,
+            .msg_namelen    = dest_len,
+            .msg_iov        = &iov,
+            .msg_iovlen     = 1,
+            .msg_control    = control.buf,
+            .msg_controllen = sizeof(control.buf),
+        };
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        uint16_t gso_size  = s->pkt_size;
+
+        cm->cmsg_level = IPPROTO_UDP;
+        cm->cmsg_type  = UDP_SEGMENT;
+        cm->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+        memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+        ret = sendmsg(s->udp_fd, &msg, 0);
+        if (ret >= 0)
+            return ret;
+        ret = ff_neterrno();
+        if (ret != AVERROR(EIO) && ret != AVERROR(EINVAL) && ret != AVERROR(ENOPROTOOPT))
+            return ret;
+        /* no segmentation offload for this socket, send the datagrams separately */
+        s->gso = 0;
+    }
+#endif
+#if HAVE_SENDMMSG
+    if (s->tx_msgs && size > s->pkt_size) {
+        int nb = 0;
+
+        for (int off = 0; off < size && nb < s->batch; off += s->pkt_size, nb++) {
+            s->tx_iov[nb].iov_base = (void *)(buf + off);
+            s->tx_iov[nb].iov_len  = FFMIN(s->pkt_size, size - off);
+            s->tx_msgs[nb].msg_hdr = (struct msghdr) {
+                .msg_name    = dest,
+                .msg_namelen = dest_len,
+                .msg_iov     = &s->tx_iov[nb],
+                .msg_iovlen  = 1,
+            };
+        }
+        ret = sendmmsg(s->udp_fd, s->tx_msgs, nb, 0);
+        if (ret < 0)
+            return ff_neterrno();
+        return FFMIN(ret * s->pkt_size, size);
+    }
+#endif
+
+    if (dest)
+        ret = sendto (s->udp_fd, buf, size, 0, dest, dest_len);
+    else
+        ret = send(s->udp_fd, buf, size, 0);
+    return ret < 0 ? ff_neterrno() : ret;
+}
+
 #if HAVE_PTHREAD_CANCEL
+/* Must be called with the mutex held. */
+static int queue_rx_packet(URLContext *h, const uint8_t *data, int size,
+                           struct sockaddr_storage *addr, socklen_t addr_len)
+{
+    UDPContext *s = h->priv_data;
+    UDPQueuedPacketHeader pkt_header;
+
+    if (ff_ip_check_source_lists(addr, &s->filters))
+        return 0;
+
+    if (av_fifo_can_write(s->rx_fifo) < size + sizeof(pkt_header)) {
+        /* No Space left */
+        if (s->overrun_nonfatal) {
+            av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                    "Surviving due to overrun_nonfatal option\n");
+            return 0;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    pkt_header.pkt_size = size;
+    pkt_header.addr     = *addr;
+    pkt_header.addr_len = addr_len;
+    av_fifo_write(s->rx_fifo, &pkt_header, sizeof(pkt_header));
+    av_fifo_write(s->rx_fifo, data, size);
+    return 0;
+}
+
+#if HAVE_RECVMMSG
+/* Must be called with the mutex held. */
+static int queue_rx_batch(URLContext *h, int nb)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    for (int i = 0; i < nb; i++) {
+        const struct msghdr *msg = &s->rx_msgs[i].msg_hdr;
+        const uint8_t *data = s->rx_iov[i].iov_base;
+        int size = s->rx_msgs[i].msg_len;
+        int seg  = size;
+
+#ifdef __linux__
+        /* with GRO, the kernel may merge several datagrams of the same size */
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR((struct msghdr *)msg, cm)) {
+            if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+                int gso_size;
+                memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+                if (gso_size > 0)
+                    seg = gso_size;
+            }
+        }
+#endif
+        if (msg->msg_flags & MSG_TRUNC)
+            av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+
+        do {
+            int len = FFMIN(seg, size);
+            if ((ret = queue_rx_packet(h, data, len, msg->msg_name, msg->msg_namelen)) < 0)
+                return ret;
+            data += len;
+            size -= len;
+        } while (size > 0);
+    }
+    return 0;
+}
+#endif
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -542,43 +728,48 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
-        UDPQueuedPacketHeader pkt_header;
-        pkt_header.addr_len = sizeof(pkt_header.addr);
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        int ret;
 
         pthread_mutex_unlock(&s->mutex);
+#if HAVE_RECVMMSG
+        if (s->rx_msgs) {
+            for (int i = 0; i < s->batch; i++) {
+                s->rx_msgs[i].msg_hdr.msg_namelen    = sizeof(s->rx_slots[i].addr);
+                s->rx_msgs[i].msg_hdr.msg_controllen = sizeof(s->rx_slots[i].control);
+            }
+        }
+#endif
         /* Blocking operations are always cancellation points;
            see "General Information" / "Thread Cancellation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        pkt_header.pkt_size = recvfrom(s->udp_fd, s->tmp + sizeof(pkt_header), sizeof(s->tmp) - sizeof(pkt_header), 0, (struct sockaddr *)&pkt_header.addr, &pkt_header.addr_len);
+#if HAVE_RECVMMSG
+        if (s->rx_msgs)
+            ret = recvmmsg(s->udp_fd, s->rx_msgs, s->batch, MSG_WAITFORONE, NULL);
+        else
+#endif
+        ret = recvfrom(s->udp_fd, s->tmp, sizeof(s->tmp) - sizeof(UDPQueuedPacketHeader), 0, (struct sockaddr *)&addr, &addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
-        if (pkt_header.pkt_size < 0) {
+        if (ret < 0) {
             if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
                 s->circular_buffer_error = ff_neterrno();
                 goto end;
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&pkt_header.addr, &s->filters))
-            continue;
-        memcpy(s->tmp, &pkt_header, sizeof(pkt_header));
-
-        if (av_fifo_can_write(s->rx_fifo) < pkt_header.pkt_size + sizeof(pkt_header)) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
-                continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
-            }
+#if HAVE_RECVMMSG
+        if (s->rx_msgs)
+            ret = queue_rx_batch(h, ret);
+        else
+#endif
+        ret = queue_rx_packet(h, s->tmp, ret, &addr, addr_len);
+        if (ret < 0) {
+            s->circular_buffer_error = ret;
+            goto end;
         }
-        av_fifo_write(s->rx_fifo, s->tmp, pkt_header.pkt_size + sizeof(pkt_header));
         pthread_cond_signal(&s->cond);
     }
 
@@ -657,17 +848,11 @@ static void *circular_buffer_task_tx( void *_URLContext)
         while (len) {
             int ret;
             av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
+            ret = udp_send(s, p, len);
             if (ret >= 0) {
                 len -= ret;
                 p   += ret;
             } else {
-                ret = ff_neterrno();
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
                     pthread_mutex_lock(&s->mutex);
                     s->circular_buffer_error = ret;
@@ -688,6 +873,110 @@ end:
 
 #endif
 
+static void udp_free_batch(UDPContext *s)
+{
+#if HAVE_RECVMMSG
+    av_freep(&s->rx_msgs);
+    av_freep(&s->rx_iov);
+    av_freep(&s->rx_slots);
+    av_freep(&s->rx_buf);
+#endif
+#if HAVE_SENDMMSG
+    av_freep(&s->tx_msgs);
+    av_freep(&s->tx_iov);
+#endif
+}
+
+static int udp_init_batch(URLContext *h, int udp_fd, int is_output)
+{
+    UDPContext *s = h->priv_data;
+
+    if (is_output) {
+        if (s->batch == 1 && !s->gso)
+            return 0;
+        if (s->pkt_size <= 0) {
+            av_log(h, AV_LOG_WARNING, "Batching requires a positive pkt_size\n");
+            s->batch = 1;
+            s->gso   = 0;
+            return 0;
+        }
+#ifndef __linux__
+        if (s->gso) {
+            av_log(h, AV_LOG_WARNING, "'gso' option is not supported on this platform\n");
+            s->gso = 0;
+        }
+#endif
+        /* a batch is handed over as one write, so it must fit in a maximal datagram */
+        s->batch = FFMAX(FFMIN3(s->batch, UDP_MAX_SEGMENTS, UDP_MAX_PKT_SIZE / s->pkt_size), 1);
+        if (s->gso)
+            s->batch = FFMAX(FFMIN(s->batch, (UDP_MAX_PKT_SIZE - 29) / s->pkt_size), 1);
+#if HAVE_SENDMMSG
+        if (s->batch > 1) {
+            s->tx_msgs = av_calloc(s->batch, sizeof(*s->tx_msgs));
+            s->tx_iov  = av_calloc(s->batch, sizeof(*s->tx_iov));
+            if (!s->tx_msgs || !s->tx_iov)
+                return AVERROR(ENOMEM);
+        }
+#else
+        if (!s->gso) {
+            av_log(h, AV_LOG_WARNING, "'batch' option is not supported on this platform\n");
+            s->batch = 1;
+        }
+#endif
+        h->max_packet_size = s->pkt_size * s->batch;
+        return 0;
+    }
+
+    if (s->batch == 1 && !s->gro)
+        return 0;
+#if HAVE_RECVMMSG && HAVE_PTHREAD_CANCEL
+    if (!s->circular_buffer_size) {
+        av_log(h, AV_LOG_WARNING, "'batch' and 'gro' options require a non-zero fifo_size\n");
+        s->batch = 1;
+        s->gro   = 0;
+        return 0;
+    }
+#ifdef __linux__
+    if (s->gro) {
+        int one = 1;
+        if (setsockopt(udp_fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+            ff_log_net_error(h, AV_LOG_WARNING, "setsockopt(UDP_GRO)");
+            s->gro = 0;
+        }
+    }
+#else
+    if (s->gro) {
+        av_log(h, AV_LOG_WARNING, "'gro' option is not supported on this platform\n");
+        s->gro = 0;
+    }
+#endif
+
+    /* Each slot can hold a maximal (or coalesced) datagram; only the pages
+     * actually filled by the kernel are ever touched. */
+    s->rx_msgs  = av_calloc(s->batch, sizeof(*s->rx_msgs));
+    s->rx_iov   = av_calloc(s->batch, sizeof(*s->rx_iov));
+    s->rx_slots = av_calloc(s->batch, sizeof(*s->rx_slots));
+    s->rx_buf   = av_malloc_array(s->batch, UDP_MAX_PKT_SIZE);
+    if (!s->rx_msgs || !s->rx_iov || !s->rx_slots || !s->rx_buf)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < s->batch; i++) {
+        s->rx_iov[i].iov_base = s->rx_buf + (size_t)i * UDP_MAX_PKT_SIZE;
+        s->rx_iov[i].iov_len  = UDP_MAX_PKT_SIZE;
+        s->rx_msgs[i].msg_hdr = (struct msghdr) {
+            .msg_name    = &s->rx_slots[i].addr,
+            .msg_iov     = &s->rx_iov[i],
+            .msg_iovlen  = 1,
+            .msg_control = s->rx_slots[i].control.buf,
+        };
+    }
+#else
+    av_log(h, AV_LOG_WARNING, "'batch' and 'gro' options are not supported on this build\n");
+    s->batch = 1;
+    s->gro   = 0;
+#endif
+    return 0;
+}
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -895,6 +1184,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         }
     }
 
+    if ((ret = udp_init_batch(h, udp_fd, is_output)) < 0)
+        goto fail;
+
     s->udp_fd = udp_fd;
 
 #if HAVE_PTHREAD_CANCEL
@@ -952,6 +1244,7 @@ static int udp_open(URLContext *h, const char *uri, int flags)
  fail:
     if (udp_fd >= 0)
         closesocket(udp_fd);
+    udp_free_batch(s);
     av_fifo_freep2(&s->rx_fifo);
     av_fifo_freep2(&s->tx_fifo);
     ff_ip_reset_filters(&s->filters);
@@ -1075,14 +1368,7 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
             return ret;
     }
 
-    if (!s->is_connected) {
-        ret = sendto (s->udp_fd, buf, size, 0,
-                      (struct sockaddr *) &s->dest_addr,
-                      s->dest_addr_len);
-    } else
-        ret = send(s->udp_fd, buf, size, 0);
-
-    return ret < 0 ? ff_neterrno() : ret;
+    return udp_send(s, buf, size);
 }
 
 static int udp_close(URLContext *h)
@@ -1125,6 +1411,7 @@ static int udp_close(URLContext *h)
     }
 #endif
     closesocket(s->udp_fd);
+    udp_free_batch(s);
     av_fifo_freep2(&s->rx_fifo);
     av_fifo_freep2(&s->tx_fifo);
     ff_ip_reset_filters(&s->filters);
@@ -0,0 +1,68 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+
+#include "libavutil/threadbudget.h"
+
+#define CHECK(expr)                                             \
+    do {                                                        \
+        if (!(expr)) {                                          \
+            fprintf(stderr, "check failed: %s\n", #expr);       \
+            ret = 1;                                            \
+        }                                                       \
+    } while (0)
+
+int main(void)
+{
+    AVThreadBudget *budget;
+    int a, b, c, ret = 0;
+
+    budget = av_thread_budget_alloc(8);
+    if (!budget)
+        return 1;
+
+    CHECK(av_thread_budget_total(budget) == 8);
+    CHECK(av_thread_budget_available(budget) == 8);
+
+    a = av_thread_budget_acquire(budget, 5);
+    CHECK(a == 5);
+    b = av_thread_budget_acquire(budget, 5);
+    CHECK(b == 3);
+    CHECK(av_thread_budget_available(budget) == 0);
+
+    // an exhausted budget still grants a single thread
+    c = av_thread_budget_acquire(budget, 4);
+    CHECK(c == 1);
+    CHECK(av_thread_budget_available(budget) == 0);
+
+    av_thread_budget_release(budget, c);
+    av_thread_budget_release(budget, a);
+    CHECK(av_thread_budget_available(budget) == 5);
+
+    CHECK(av_thread_budget_acquire(budget, 0) == 1);
+    av_thread_budget_release(budget, 1);
+
+    av_thread_budget_release(budget, b);
+    CHECK(av_thread_budget_available(budget) == 8);
+
+    av_thread_budget_free(&budget);
+    CHECK(!budget);
+
+    return ret;
+}
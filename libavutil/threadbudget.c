@@ -0,0 +1,89 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+
+#include "attributes.h"
+#include "avassert.h"
+#include "common.h"
+#include "cpu.h"
+#include "mem.h"
+#include "threadbudget.h"
+
+struct AVThreadBudget {
+    int         total;
+    // number of threads currently granted, may exceed total
+    atomic_int  used;
+};
+
+AVThreadBudget *av_thread_budget_alloc(int nb_threads)
+{
+    AVThreadBudget *budget = av_mallocz(sizeof(*budget));
+    if (!budget)
+        return NULL;
+
+    budget->total = nb_threads > 0 ? nb_threads : av_cpu_count();
+    atomic_init(&budget->used, 0);
+
+    return budget;
+}
+
+void av_thread_budget_free(AVThreadBudget **pbudget)
+{
+    av_freep(pbudget);
+}
+
+int av_thread_budget_acquire(AVThreadBudget *budget, int nb_threads)
+{
+    int used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    int granted;
+
+    nb_threads = FFMAX(nb_threads, 1);
+
+    do {
+        granted = av_clip(budget->total - used, 1, nb_threads);
+    } while (!atomic_compare_exchange_weak_explicit(&budget->used, &used,
+                                                    used + granted,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+
+    return granted;
+}
+
+void av_thread_budget_release(AVThreadBudget *budget, int nb_threads)
+{
+    av_unused int used;
+
+    if (nb_threads <= 0)
+        return;
+
+    used = atomic_fetch_sub_explicit(&budget->used, nb_threads,
+                                     memory_order_relaxed);
+    av_assert1(used >= nb_threads);
+}
+
+int av_thread_budget_total(const AVThreadBudget *budget)
+{
+    return budget->total;
+}
+
+int av_thread_budget_available(const AVThreadBudget *budget)
+{
+    int used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    return FFMAX(budget->total - used, 0);
+}
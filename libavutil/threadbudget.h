@@ -0,0 +1,96 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADBUDGET_H
+#define AVUTIL_THREADBUDGET_H
+
+/**
+ * @file
+ * Process-wide thread budget.
+ *
+ * A thread budget is a counter of worker threads shared between several
+ * independent users of threading (codec contexts, filtergraphs, ...) within
+ * one process. Each user draws the number of threads it is going to create
+ * from the budget before creating them and returns it when they are gone, so
+ * that the total number of worker threads stays close to the budget size
+ * instead of every user independently sizing itself to the number of CPUs.
+ *
+ * All functions except av_thread_budget_alloc() and av_thread_budget_free()
+ * are thread-safe.
+ */
+
+/**
+ * @addtogroup lavu_misc
+ * @{
+ *
+ * @defgroup lavu_thread_budget Thread budget
+ * @{
+ */
+
+typedef struct AVThreadBudget AVThreadBudget;
+
+/**
+ * Allocate a thread budget.
+ *
+ * @param nb_threads total number of threads in the budget; 0 or a negative
+ *                   value means the number of logical CPUs
+ * @return newly allocated budget or NULL on failure
+ */
+AVThreadBudget *av_thread_budget_alloc(int nb_threads);
+
+/**
+ * Free a thread budget and set *budget to NULL.
+ */
+void av_thread_budget_free(AVThreadBudget **budget);
+
+/**
+ * Draw threads from the budget.
+ *
+ * At most nb_threads are granted, and never more than what is still available
+ * in the budget. One thread is always granted, even when the budget is
+ * exhausted, since every user needs at least its own thread to make progress;
+ * such grants are still accounted for and must be returned.
+ *
+ * @param nb_threads maximum number of threads wanted; values smaller than 1
+ *                   are treated as 1
+ * @return number of threads granted, always >= 1
+ */
+int av_thread_budget_acquire(AVThreadBudget *budget, int nb_threads);
+
+/**
+ * Return threads previously granted by av_thread_budget_acquire().
+ */
+void av_thread_budget_release(AVThreadBudget *budget, int nb_threads);
+
+/**
+ * @return total number of threads in the budget
+ */
+int av_thread_budget_total(const AVThreadBudget *budget);
+
+/**
+ * @return number of threads that can currently be granted without
+ *         exceeding the budget
+ */
+int av_thread_budget_available(const AVThreadBudget *budget);
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* AVUTIL_THREADBUDGET_H */
@@ -19,6 +19,7 @@
  */
 
 #include "libavutil/avassert.h"
+#include "libavutil/cpu.h"
 #include "libavutil/error.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/macros.h"
@@ -672,8 +673,7 @@ static int init_passes(SwsGraph *graph)
     return 0;
 }
 
-static void sws_graph_worker(void *priv, int jobnr, int threadnr, int nb_jobs,
-                             int nb_threads)
+static void sws_graph_job(void *priv, int jobnr)
 {
     SwsGraph *graph = priv;
     const SwsPass *pass = graph->exec.pass;
@@ -685,6 +685,12 @@ static void sws_graph_worker(void *priv, int jobnr, int threadnr, int nb_jobs,
     pass->run(output, input, slice_y, slice_h, pass);
 }
 
+static void sws_graph_worker(void *priv, int jobnr, int threadnr, int nb_jobs,
+                             int nb_threads)
+{
+    sws_graph_job(priv, jobnr);
+}
+
 int ff_sws_graph_create(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *src,
                         int field, SwsGraph **out_graph)
 {
@@ -702,14 +708,19 @@ int ff_sws_graph_create(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *
     graph->exec.input.fmt  = src->format;
     graph->exec.output.fmt = dst->format;
 
-    ret = avpriv_slicethread_create(&graph->slicethread, (void *) graph,
-                                    sws_graph_worker, NULL, ctx->threads);
-    if (ret == AVERROR(ENOSYS))
-        graph->num_threads = 1;
-    else if (ret < 0)
-        goto error;
-    else
-        graph->num_threads = ret;
+    if (ctx->execute) {
+        /* slices are run on the caller's threads */
+        graph->num_threads = ctx->threads > 0 ? ctx->threads : av_cpu_count();
+    } else {
+        ret = avpriv_slicethread_create(&graph->slicethread, (void *) graph,
+                                        sws_graph_worker, NULL, ctx->threads);
+        if (ret == AVERROR(ENOSYS))
+            graph->num_threads = 1;
+        else if (ret < 0)
+            goto error;
+        else
+            graph->num_threads = ret;
+    }
 
     ret = init_passes(graph);
     if (ret < 0)
@@ -758,6 +769,7 @@ static int opts_equal(const SwsContext *c1, const SwsContext *c2)
            c1->dst_h_chr_pos == c2->dst_h_chr_pos &&
            c1->dst_v_chr_pos == c2->dst_v_chr_pos &&
            c1->intent        == c2->intent        &&
+           c1->execute       == c2->execute       &&
            !memcmp(c1->scaler_params, c2->scaler_params, sizeof(c1->scaler_params));
 
 }
@@ -805,6 +817,9 @@ void ff_sws_graph_run(SwsGraph *graph, uint8_t *const out_data[4],
             pass->setup(pass->output.fmt != AV_PIX_FMT_NONE ? &pass->output : out,
                         pass->input ? &pass->input->output : in, pass);
         }
-        avpriv_slicethread_execute(graph->slicethread, pass->num_slices, 0);
+        if (graph->ctx->execute)
+            graph->ctx->execute(graph->ctx, sws_graph_job, graph, pass->num_slices);
+        else
+            avpriv_slicethread_execute(graph->slicethread, pass->num_slices, 0);
     }
 }
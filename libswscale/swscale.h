@@ -246,6 +246,20 @@ typedef struct SwsContext {
      */
     int intent;
 
+    /**
+     * Optional callback running the slices of each processing step on a
+     * thread pool owned by the caller, instead of the threads spawned by
+     * libswscale itself. It must call func(priv, jobnr) once for every jobnr
+     * in [0, nb_jobs), possibly concurrently, and only return once all of
+     * the calls have completed. `threads` should be set to the number of
+     * jobs the callback can run in parallel.
+     *
+     * Only used by sws_scale_frame() when the context was not initialized
+     * with sws_init_context().
+     */
+    void (*execute)(struct SwsContext *ctx, void (*func)(void *priv, int jobnr),
+                    void *priv, int nb_jobs);
+
     /* Remember to add new fields to graph.c:opts_equal() */
 } SwsContext;
 
@@ -0,0 +1,260 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * avcodec_reset_decoder() test.
+ *
+ * Decodes the given files one after the other, and then the first one again,
+ * with a single decoder that is reset between them. The frames must match
+ * those of a decoder opened for each file, both without threads and with
+ * frame threads.
+ */
+
+#include "libavutil/adler32.h"
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+typedef struct FrameInfo {
+    int width, height, format;
+    int64_t pts;
+    uint32_t crc;
+} FrameInfo;
+
+typedef struct FrameList {
+    FrameInfo *frames;
+    int nb_frames;
+} FrameList;
+
+static uint32_t frame_crc(const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    uint32_t crc = 0;
+
+    for (int p = 0; p < 4 && frame->data[p]; p++) {
+        int w = av_image_get_linesize(frame->format, frame->width, p);
+        int h = frame->height;
+
+        if (p == 1 || p == 2)
+            h = AV_CEIL_RSHIFT(h, desc->log2_chroma_h);
+        for (int y = 0; y < h; y++)
+            crc = av_adler32_update(crc, frame->data[p] + y * frame->linesize[p], w);
+    }
+
+    return crc;
+}
+
+static int receive_frames(AVCodecContext *ctx, AVFrame *frame, FrameList *list)
+{
+    int ret;
+
+    while ((ret = avcodec_receive_frame(ctx, frame)) >= 0) {
+        FrameInfo info = {
+            .width  = frame->width,
+            .height = frame->height,
+            .format = frame->format,
+            .pts    = frame->best_effort_timestamp,
+            .crc    = frame_crc(frame),
+        };
+
+        av_frame_unref(frame);
+        if (!av_dynarray2_add((void **)&list->frames, &list->nb_frames,
+                              sizeof(info), (const uint8_t *)&info))
+            return AVERROR(ENOMEM);
+    }
+
+    return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+/**
+ * Decode the video stream of url. If *pctx is NULL, a decoder is opened for
+ * it, otherwise the decoder in *pctx is reset to the parameters of the stream.
+ */
+static int decode_file(const char *url, AVCodecContext **pctx, int threads,
+                       FrameList *list)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecParameters *par;
+    AVPacket *pkt = NULL;
+    AVFrame *frame = NULL;
+    int stream_index, ret;
+
+    ret = avformat_open_input(&fmt_ctx, url, NULL, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open %s\n", url);
+        return ret;
+    }
+    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    if (ret < 0)
+        goto end;
+    ret = stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "No video stream in %s\n", url);
+        goto end;
+    }
+    par = fmt_ctx->streams[stream_index]->codecpar;
+
+    if (!*pctx) {
+        const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+        AVCodecContext *ctx;
+
+        if (!codec) {
+            ret = AVERROR_DECODER_NOT_FOUND;
+            goto end;
+        }
+        ctx = *pctx = avcodec_alloc_context3(codec);
+        if (!ctx) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = avcodec_parameters_to_context(ctx, par);
+        if (ret < 0)
+            goto end;
+        ctx->thread_count = threads;
+        ctx->thread_type  = FF_THREAD_FRAME;
+        ret = avcodec_open2(ctx, codec, NULL);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot open the decoder for %s\n", url);
+            goto end;
+        }
+    } else {
+        ret = avcodec_reset_decoder(*pctx, par);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot reset the decoder for %s\n", url);
+            goto end;
+        }
+    }
+
+    pkt   = av_packet_alloc();
+    frame = av_frame_alloc();
+    if (!pkt || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while ((ret = av_read_frame(fmt_ctx, pkt)) >= 0) {
+        if (pkt->stream_index == stream_index) {
+            ret = avcodec_send_packet(*pctx, pkt);
+            if (ret >= 0)
+                ret = receive_frames(*pctx, frame, list);
+        }
+        av_packet_unref(pkt);
+        if (ret < 0)
+            goto end;
+    }
+    if (ret != AVERROR_EOF)
+        goto end;
+
+    ret = avcodec_send_packet(*pctx, NULL);
+    if (ret >= 0)
+        ret = receive_frames(*pctx, frame, list);
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+end:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Decoding %s failed: %s\n", url, av_err2str(ret));
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+static int compare_frames(const char *url, const FrameList *ref, const FrameList *list)
+{
+    if (!ref->nb_frames) {
+        av_log(NULL, AV_LOG_ERROR, "No frames decoded from %s\n", url);
+        return 1;
+    }
+    if (list->nb_frames != ref->nb_frames) {
+        av_log(NULL, AV_LOG_ERROR, "%s: %d frames after reset, %d expected\n",
+               url, list->nb_frames, ref->nb_frames);
+        return 1;
+    }
+    for (int i = 0; i < ref->nb_frames; i++) {
+        const FrameInfo *a = &ref->frames[i], *b = &list->frames[i];
+
+        if (a->width != b->width || a->height != b->height || a->format != b->format ||
+            a->pts != b->pts || a->crc != b->crc) {
+            av_log(NULL, AV_LOG_ERROR, "%s: frame %d differs after reset: "
+                   "%dx%d %s pts %"PRId64" crc 0x%08"PRIx32", expected "
+                   "%dx%d %s pts %"PRId64" crc 0x%08"PRIx32"\n", url, i,
+                   b->width, b->height, av_get_pix_fmt_name(b->format), b->pts, b->crc,
+                   a->width, a->height, av_get_pix_fmt_name(a->format), a->pts, a->crc);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_test(char **urls, int nb_urls, int threads)
+{
+    AVCodecContext *ctx = NULL;
+    FrameList *refs;
+    int ret = 0;
+
+    refs = av_calloc(nb_urls, sizeof(*refs));
+    if (!refs)
+        return 1;
+
+    for (int i = 0; i < nb_urls && !ret; i++) {
+        AVCodecContext *ref_ctx = NULL;
+        ret = decode_file(urls[i], &ref_ctx, threads, &refs[i]);
+        avcodec_free_context(&ref_ctx);
+    }
+
+    /* go back to the first file to reset in both directions */
+    for (int i = 0; i <= nb_urls && !ret; i++) {
+        const char *url = urls[i % nb_urls];
+        FrameList list = { 0 };
+
+        ret = decode_file(url, &ctx, threads, &list);
+        if (!ret)
+            ret = compare_frames(url, &refs[i % nb_urls], &list);
+        if (!ret)
+            printf("%s: %d frames, %dx%d %s, threads %d\n", url, list.nb_frames,
+                   list.frames[0].width, list.frames[0].height,
+                   av_get_pix_fmt_name(list.frames[0].format), threads);
+        av_free(list.frames);
+    }
+
+    avcodec_free_context(&ctx);
+    for (int i = 0; i < nb_urls; i++)
+        av_free(refs[i].frames);
+    av_free(refs);
+    return !!ret;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        av_log(NULL, AV_LOG_ERROR, "Usage: %s <input file> <input file> ...\n", argv[0]);
+        return 1;
+    }
+
+    if (run_test(argv + 1, argc - 1, 1) ||
+        run_test(argv + 1, argc - 1, 2))
+        return 1;
+
+    return 0;
+}
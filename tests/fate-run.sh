@@ -663,6 +663,47 @@ concat(){
     fi
 }
 
+mov_reserve_moov(){
+    srcfile="${outdir}/${test}.src.mp4"
+    encfile="${outdir}/${test}.mp4"
+    crcfile="${outdir}/${test}.crc"
+    cleanfiles="$cleanfiles $srcfile $encfile $crcfile"
+
+    # remux a file with known stream durations, which size the reservation
+    ffmpeg -f lavfi -i testsrc2=s=64x64:r=25:d=4,format=yuv420p -f lavfi -i sine=d=4 \
+        -c:v mpeg4 -c:a mp2fixed -threads 1 -bitexact -f mp4 -y $(target_path $srcfile) || return
+    ffmpeg -i $(target_path $srcfile) -c copy -bitexact "$@" -f mp4 -y $(target_path $encfile) || return
+    # top level atoms and their sizes
+    run ffprobe${PROGSUF}${EXECSUF} -v trace $(target_path $encfile) 2>&1 |
+        sed -n "s/.*type:'\(....\)' parent:'root' sz: \([0-9]*\).*/\1 \2/p"
+    ffmpeg -i $(target_path $encfile) -c copy -f framecrc -y $(target_path $crcfile) || return
+    do_md5sum $crcfile | awk '{print $1}'
+}
+
+index_cache(){
+    cachedir="${outdir}/${test}.cache"
+    logfile="${outdir}/${test}.log"
+    cleanfiles="$cleanfiles $logfile"
+
+    for src in "$@"; do
+        file="${outdir}/${test}.$(basename $src)"
+        cleanfiles="$cleanfiles $file"
+        rm -rf "$cachedir"
+        mkdir -p "$cachedir" && cp "$src" "$file" || return
+        # new entry, valid entry, entry of a modified file, valid entry
+        for pass in 1 2 3 4; do
+            [ $pass = 3 ] && touch -t 200001010000 "$file"
+            echo "$(basename $src) pass $pass"
+            run ffprobe${PROGSUF}${EXECSUF} -bitexact -v verbose -index_cache $(target_path $cachedir) \
+                -show_entries format=duration:stream=codec_name,start_time,duration -of compact \
+                $(target_path $file) 2> "$logfile" || return
+            sed -n 's/^\[[^]]*\] \(.*index cache\).*/\1/p' "$logfile"
+            echo "cached files: $(ls "$cachedir" | wc -l | tr -d ' ')"
+        done
+    done
+    rm -rf "$cachedir"
+}
+
 venc_data(){
     file=$1
     stream=$2
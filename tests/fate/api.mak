@@ -23,6 +23,40 @@ fate-lavf-flv: CMP =
 fate-api-seek: CMD = run $(APITESTSDIR)/api-seek-test$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.flv 0 720
 fate-api-seek: CMP = null
 
+# Two MPEG-2 streams with different sizes and chroma formats, and B-frames
+# so that the decoder holds frames back.
+tests/data/api-reset-decoder-420.m2v: SIZE = 352x288
+tests/data/api-reset-decoder-420.m2v: PIX_FMT = yuv420p
+tests/data/api-reset-decoder-422.m2v: SIZE = 176x144
+tests/data/api-reset-decoder-422.m2v: PIX_FMT = yuv422p
+tests/data/api-reset-decoder-%.m2v: TAG = GEN
+tests/data/api-reset-decoder-%.m2v: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	    -f lavfi -i testsrc2=s=$(SIZE):r=25:d=1,format=$(PIX_FMT) \
+	    -c:v mpeg2video -g 12 -bf 2 -flags +bitexact -fflags +bitexact \
+	    -f mpeg2video -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_API_LIBAVFORMAT-$(call ALLYES, MPEGVIDEO_DEMUXER MPEG2VIDEO_DECODER \
+                                    LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER \
+                                    MPEG2VIDEO_ENCODER MPEG2VIDEO_MUXER) += fate-api-reset-decoder-mpeg2
+fate-api-reset-decoder-mpeg2: $(APITESTSDIR)/api-reset-decoder-test$(EXESUF) \
+                              tests/data/api-reset-decoder-420.m2v tests/data/api-reset-decoder-422.m2v
+fate-api-reset-decoder-mpeg2: CMD = run $(APITESTSDIR)/api-reset-decoder-test$(EXESUF) \
+    $(TARGET_PATH)/tests/data/api-reset-decoder-420.m2v $(TARGET_PATH)/tests/data/api-reset-decoder-422.m2v
+fate-api-reset-decoder-mpeg2: CMP = null
+
+FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, H264, H264) += fate-api-reset-decoder-h264
+fate-api-reset-decoder-h264: $(APITESTSDIR)/api-reset-decoder-test$(EXESUF)
+fate-api-reset-decoder-h264: CMD = run $(APITESTSDIR)/api-reset-decoder-test$(EXESUF) \
+    $(TARGET_SAMPLES)/h264-conformance/SVA_NL2_E.264 $(TARGET_SAMPLES)/h264-conformance/FRext/Hi422FR1_SONY_A.jsv
+fate-api-reset-decoder-h264: CMP = null
+
+FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, HEVC, HEVC) += fate-api-reset-decoder-hevc
+fate-api-reset-decoder-hevc: $(APITESTSDIR)/api-reset-decoder-test$(EXESUF)
+fate-api-reset-decoder-hevc: CMD = run $(APITESTSDIR)/api-reset-decoder-test$(EXESUF) \
+    $(TARGET_SAMPLES)/hevc-conformance/DBLK_A_SONY_3.bit $(TARGET_SAMPLES)/hevc-conformance/Main_422_10_A_RExt_Sony_1.bin
+fate-api-reset-decoder-hevc: CMP = null
+
 FATE_API-$(HAVE_THREADS) += fate-api-threadmessage
 fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
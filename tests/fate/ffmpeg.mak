@@ -280,3 +280,9 @@ FATE_SAMPLES_FFMPEG-$(call FRAMECRC, MOV, HEVC, HEVC_PARSER) += fate-ffmpeg-heif
 # binding the internal filtegraph with a caller defined filtergraph
 fate-ffmpeg-heif-merge-filtergraph: CMD = framecrc -i $(TARGET_SAMPLES)/heif-conformance/C007.heic -filter_complex "sws_flags=+accurate_rnd+bitexact\;[0:g:0]scale=w=1280:h=720[out]" -map "[out]"
 FATE_SAMPLES_FFMPEG-$(call FRAMECRC, MOV, HEVC, HEVC_PARSER SCALE_FILTER) += fate-ffmpeg-heif-merge-filtergraph
+
+# test scaling a rendition ladder as a chain with -scale_cascade
+fate-ffmpeg-scale-cascade: CMD = framecrc -scale_cascade -f lavfi -i testsrc2=s=320x240:d=1:r=5 \
+  -sws_flags +accurate_rnd+bitexact -map 0:v -map 0:v -map 0:v \
+  -s:v:0 160x120 -s:v:1 128x96 -s:v:2 96x72 -c:v rawvideo
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC2 SCALE, LAVFI_INDEV WRAPPED_AVFRAME_DECODER) += fate-ffmpeg-scale-cascade
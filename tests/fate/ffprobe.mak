@@ -24,4 +24,18 @@ FATE_FFPROBE-$(call FILTERDEMDECENCMUX, AEVALSRC TESTSRC ARESAMPLE, FFMETADATA,
                                         FFMPEG LAVFI_INDEV PCM_F64BE_DECODER PCM_F64LE_DECODER PCM_S16LE_ENCODER) \
                                         += $(FFPROBE_TEST_FILE_TESTS-yes)
 
+# index cache: entries are created, used and replaced when the file changes,
+# but not created for MPEG-PS, whose streams are only found while reading
+tests/data/index_cache.%: TAG = GEN
+tests/data/index_cache.%: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc2=s=64x64:d=1,format=yuv420p -f lavfi -i sine=d=1 \
+        -c:v mpeg2video -c:a mp2fixed -threads 1 -bitexact -fflags +bitexact \
+        -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_FFPROBE-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER SINE_FILTER MPEG2VIDEO_ENCODER MP2FIXED_ENCODER \
+                            MATROSKA_MUXER MATROSKA_DEMUXER MPEG1SYSTEM_MUXER MPEGPS_DEMUXER FILE_PROTOCOL) += fate-ffprobe-index-cache
+fate-ffprobe-index-cache: tests/data/index_cache.mkv tests/data/index_cache.mpg
+fate-ffprobe-index-cache: CMD = index_cache tests/data/index_cache.mkv tests/data/index_cache.mpg
+
 fate-ffprobe: $(FATE_FFPROBE-yes)
@@ -126,6 +126,49 @@ FATE_HLSENC_PROBE-$(call FRAMECRC, HLS) += fate-hls-cmfa
 fate-hls-cmfa: tests/data/hls_cmfa.m3u8
 fate-hls-cmfa: CMD = framecrc -i $(TARGET_PATH)/tests/data/hls_cmfa.m3u8 -c copy
 
+# segments of elementary audio starting with an ID3 tag that carries the
+# timestamp and is larger than the demuxer read buffer, read from prefetched
+# segments
+tests/data/hls_id3_prefetch.m3u8: TAG = GEN
+tests/data/hls_id3_prefetch.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)for i in 0 1 2; do \
+	    $(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin -f lavfi -i anullsrc -frames:a 0 \
+	        -c:a aac -f adts -write_id3v2 1 -fflags +bitexact \
+	        -metadata "id3v2_priv.com.apple.streaming.transportStreamTimestamp=$$(printf '%016x' $$((i * 180000)) | sed 's/../\\x&/g')" \
+	        -metadata "id3v2_priv.padding=$$(printf '%040000d' 0)" \
+	        -y $(TARGET_PATH)/tests/data/hls_id3_prefetch_tag.aac 2>/dev/null && \
+	    $(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin -f lavfi -i "sine=d=2:f=$$((440 + i * 110))" \
+	        -c:a mp2fixed -flags +bitexact -fflags +bitexact -f mp2 \
+	        -y $(TARGET_PATH)/tests/data/hls_id3_prefetch_audio.mp2 2>/dev/null && \
+	    cat $(TARGET_PATH)/tests/data/hls_id3_prefetch_tag.aac $(TARGET_PATH)/tests/data/hls_id3_prefetch_audio.mp2 \
+	        > $(TARGET_PATH)/tests/data/hls_id3_prefetch_$$i.mp2 || exit 1; \
+	done; \
+	printf '#EXTM3U\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:0\n' > $(TARGET_PATH)/$@; \
+	for i in 0 1 2; do printf '#EXTINF:2.0,\nhls_id3_prefetch_%d.mp2\n' $$i >> $(TARGET_PATH)/$@; done; \
+	printf '#EXT-X-ENDLIST\n' >> $(TARGET_PATH)/$@
+
+FATE_HLSENC-$(call FRAMECRC, HLS MP3, , LAVFI_INDEV ANULLSRC_FILTER SINE_FILTER \
+                             ARESAMPLE_FILTER AAC_ENCODER ADTS_MUXER \
+                             MP2FIXED_ENCODER MP2_MUXER) += fate-hls-id3-prefetch
+fate-hls-id3-prefetch: tests/data/hls_id3_prefetch.m3u8
+fate-hls-id3-prefetch: CMD = framecrc -prefetch_segments 2 -i $(TARGET_PATH)/tests/data/hls_id3_prefetch.m3u8 -c copy
+
+# DASH fragments read from prefetched fragments, the last ones through a
+# window that reaches past the end of the manifest
+tests/data/dash_prefetch.mpd: TAG = GEN
+tests/data/dash_prefetch.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	    -f lavfi -i testsrc2=s=64x64:r=25:d=6,format=yuv420p \
+	    -c:v mpeg4 -g 25 -flags +bitexact -fflags +bitexact -seg_duration 1 \
+	    -init_seg_name 'dash_prefetch_init_$$RepresentationID$$.m4s' \
+	    -media_seg_name 'dash_prefetch_chunk_$$RepresentationID$$_$$Number%05d$$.m4s' \
+	    -f dash -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_HLSENC-$(call FRAMECRC, DASH MOV, , LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER \
+                             MPEG4_ENCODER DASH_MUXER) += fate-dash-prefetch
+fate-dash-prefetch: tests/data/dash_prefetch.mpd
+fate-dash-prefetch: CMD = framecrc -prefetch_segments 2 -i $(TARGET_PATH)/tests/data/dash_prefetch.mpd -c copy
+
 FATE_SAMPLES_FFMPEG += $(FATE_HLSENC-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_HLSENC_PROBE-yes)
 fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes)
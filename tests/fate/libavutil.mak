@@ -152,6 +152,11 @@ FATE_LIBAVUTIL += fate-side_data_array
 fate-side_data_array: libavutil/tests/side_data_array$(EXESUF)
 fate-side_data_array: CMD = run libavutil/tests/side_data_array$(EXESUF)
 
+FATE_LIBAVUTIL += fate-threadbudget
+fate-threadbudget: libavutil/tests/threadbudget$(EXESUF)
+fate-threadbudget: CMD = run libavutil/tests/threadbudget$(EXESUF)
+fate-threadbudget: CMP = null
+
 FATE_LIBAVUTIL += fate-tree
 fate-tree: libavutil/tests/tree$(EXESUF)
 fate-tree: CMD = run libavutil/tests/tree$(EXESUF)
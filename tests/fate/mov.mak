@@ -329,6 +329,18 @@ FATE_MOV_FFMPEG_SAMPLES-$(call REMUX, MP4 MOV, H264_PARSER) \
                           += fate-mov-mp4-multiple-stsd-muxing
 fate-mov-mp4-multiple-stsd-muxing: CMD = transcode mov $(TARGET_SAMPLES)/h264/extradata-reload-multi-stsd.mov mp4 "-c:v copy" "-c:v copy"
 
+# Atom layout with the moov written into space reserved in front of mdat.
+FATE_MOV_FFMPEG_FFPROBE-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER SINE_FILTER \
+                                       MPEG4_ENCODER MP2FIXED_ENCODER \
+                                       MP4_MUXER MOV_DEMUXER FRAMECRC_MUXER) \
+                          += fate-mov-reserve-moov \
+                             fate-mov-faststart-moov-size \
+                             fate-mov-faststart-moov-size-grow
+fate-mov-reserve-moov: CMD = mov_reserve_moov -movflags +reserve_moov
+fate-mov-faststart-moov-size: CMD = mov_reserve_moov -moov_size 100000 -movflags +faststart
+# The reserved space is too small, the media data has to be moved.
+fate-mov-faststart-moov-size-grow: CMD = mov_reserve_moov -moov_size 256 -movflags +faststart
+
 FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
 FATE_FFMPEG_FFPROBE += $(FATE_MOV_FFMPEG_FFPROBE-yes)
 
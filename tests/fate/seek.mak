@@ -199,13 +199,42 @@ fate-seek-mkv-codec-delay:   CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_
 
 FATE_SEEK_EXTRA += $(FATE_SEEK_EXTRA-yes)
 
+# sample tables expanded on demand, spanning several index blocks; the files
+# carry an edit list, which keeps the regular index with advanced_editlist
 
-$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA): libavformat/tests/seek$(EXESUF)
+tests/data/lazy_index.mp4: TAG = GEN
+tests/data/lazy_index.mp4: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc2=s=32x32:r=50:d=60,format=yuv420p -f lavfi -i sine=d=60 \
+        -c:v mpeg4 -g 25 -c:a mp2fixed -threads 1 -bitexact -fflags +bitexact \
+        -y $(TARGET_PATH)/$@ 2>/dev/null
+
+# stts with two runs of different durations: 100 x 1000, then 1001
+tests/data/lazy_index_stts.mp4: TAG = GEN
+tests/data/lazy_index_stts.mp4: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc2=s=32x32:r=30:d=60,format=yuv420p \
+        -c:v mpeg4 -g 25 -threads 1 -bitexact -fflags +bitexact \
+        -bsf:v "setts=ts=if(lt(N\,100)\,N*1000\,N*1001-100):duration=if(lt(N\,100)\,1000\,1001):time_base=1/30000" \
+        -video_track_timescale 30000 -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_SEEK_LAZY_INDEX-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER SINE_FILTER MPEG4_ENCODER MP2FIXED_ENCODER MP4_MUXER MOV_DEMUXER) += fate-seek-lazy-index-mp4
+FATE_SEEK_LAZY_INDEX-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER MPEG4_ENCODER SETTS_BSF MP4_MUXER MOV_DEMUXER) += fate-seek-lazy-index-stts-mp4
+
+fate-seek-lazy-index-mp4: tests/data/lazy_index.mp4
+fate-seek-lazy-index-mp4: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lazy_index.mp4 -lazy_index 1 -advanced_editlist 0 -duration 60 -frames 4
+fate-seek-lazy-index-stts-mp4: tests/data/lazy_index_stts.mp4
+fate-seek-lazy-index-stts-mp4: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lazy_index_stts.mp4 -lazy_index 1 -advanced_editlist 0 -duration 60 -frames 4
+
+FATE_SEEK_LAZY_INDEX += $(FATE_SEEK_LAZY_INDEX-yes)
+
+
+$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAZY_INDEX): libavformat/tests/seek$(EXESUF)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/$(SRC)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_LAZY_INDEX)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAZY_INDEX)
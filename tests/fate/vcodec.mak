@@ -519,16 +519,32 @@ VSYNTH3_OFF  = $(RESIZE_OFF) $(INC_PAR_OFF)
 FATE_VCODEC3 = $(filter-out $(VSYNTH3_OFF),$(FATE_VCODEC))
 FATE_VSYNTH3 = $(FATE_VCODEC3:%=fate-vsynth3-%)
 
+# Decode a damaged copy of fate-vsynth1-mpeg2-422 with frame threads; the
+# output must match the one of a single-threaded decoder.
+FATE_MPEG2_DAMAGED-$(CONFIG_NOISE_BSF) += $(if $(filter fate-vsynth1-mpeg2-422,$(FATE_VSYNTH1)),fate-mpeg2-422-damaged-thread)
+fate-mpeg2-422-damaged-thread: fate-vsynth1-mpeg2-422
+fate-vsynth1-mpeg2-422: KEEP_FILES ?= 1
+fate-mpeg2-422-damaged-thread: CMD = threads=4 thread_type=frame framecrc -flags +bitexact -idct simple -bsf:v noise=3300 -i $(TARGET_PATH)/tests/data/fate/vsynth1-mpeg2-422.mpeg2video
+
+# Decode fate-vsynth1-mjpeg, whose scans have restart markers, with slice and
+# with frame threads; the output must match the one of a single-threaded decoder.
+FATE_MJPEG_THREAD += $(if $(filter fate-vsynth1-mjpeg,$(FATE_VSYNTH1)),fate-mjpeg-slice-thread fate-mjpeg-frame-thread)
+fate-mjpeg-slice-thread fate-mjpeg-frame-thread: fate-vsynth1-mjpeg
+fate-vsynth1-mjpeg: KEEP_FILES ?= 1
+fate-mjpeg-slice-thread: CMD = threads=4 thread_type=slice framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/fate/vsynth1-mjpeg.avi
+fate-mjpeg-frame-thread: CMD = threads=4 thread_type=frame framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/fate/vsynth1-mjpeg.avi
+
 $(FATE_VSYNTH1): tests/data/vsynth1.yuv
 $(FATE_VSYNTH2): tests/data/vsynth2.yuv
 $(FATE_VSYNTH_LENA): tests/data/vsynth_lena.yuv
 $(FATE_VSYNTH3): tests/data/vsynth3.yuv
 
 FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_VSYNTH3)
+FATE_AVCONV += $(FATE_MPEG2_DAMAGED-yes) $(FATE_MJPEG_THREAD)
 FATE_SAMPLES_AVCONV += $(FATE_VSYNTH_LENA)
 
 fate-vsynth1: $(FATE_VSYNTH1)
 fate-vsynth2: $(FATE_VSYNTH2)
 fate-vsynth_lena: $(FATE_VSYNTH_LENA)
 fate-vsynth3: $(FATE_VSYNTH3)
-fate-vcodec:  fate-vsynth1 fate-vsynth_lena fate-vsynth2 fate-vsynth3
+fate-vcodec:  fate-vsynth1 fate-vsynth_lena fate-vsynth2 fate-vsynth3 $(FATE_MPEG2_DAMAGED-yes) $(FATE_MJPEG_THREAD)